@@ -0,0 +1,493 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EEGCodec.h"
+
+#include "Algo/UpperBound.h"
+#include "HAL/FileManager.h"
+
+namespace
+{
+	constexpr uint32 GFileMagic = 0x43474545;	// "EEGC"
+	constexpr uint32 GIndexMagic = 0x58444945;	// "EIDX"
+	constexpr uint32 GVersion = 1;
+	constexpr uint32 GBlockSync = 0xEE6C;
+	/** Rice quotients reaching this value are escaped and followed by the raw value */
+	constexpr int32 GRiceEscape = 24;
+	constexpr int32 GMaxDecimalDigits = 18;
+	constexpr double GPow10[GMaxDecimalDigits + 1] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+	};
+
+	enum EChannelMode : uint32
+	{
+		Constant = 0,
+		Predicted = 1,
+		Verbatim = 2
+	};
+
+	uint64 ToBits(double Value)
+	{
+		uint64 bits;
+		FMemory::Memcpy(&bits, &Value, sizeof(bits));
+		return bits;
+	}
+
+	double FromBits(uint64 Bits)
+	{
+		double value;
+		FMemory::Memcpy(&value, &Bits, sizeof(value));
+		return value;
+	}
+
+	uint64 ZigZag(int64 Value) { return (static_cast<uint64>(Value) << 1) ^ static_cast<uint64>(Value >> 63); }
+	int64 UnZigZag(uint64 Value) { return static_cast<int64>(Value >> 1) ^ -static_cast<int64>(Value & 1); }
+
+	/** Fixed polynomial predictors residual, the same as FLAC's */
+	int64 Residual(const int64* X, int32 Order)
+	{
+		switch (Order)
+		{
+		case 0: return X[0];
+		case 1: return X[0] - X[-1];
+		case 2: return X[0] - 2 * X[-1] + X[-2];
+		default: return X[0] - 3 * X[-1] + 3 * X[-2] - X[-3];
+		}
+	}
+
+	/** LSB first bit packer */
+	struct FEEGBitWriter
+	{
+		TArray<uint8>& bytes;
+		uint64 accumulator = 0;
+		int32 count = 0;
+
+		explicit FEEGBitWriter(TArray<uint8>& Bytes) : bytes(Bytes) {}
+
+		/** Writes up to 32 bits */
+		void Write(uint64 Value, int32 Bits)
+		{
+			accumulator |= (Value & ((1ull << Bits) - 1)) << count;
+			count += Bits;
+			while (count >= 8)
+			{
+				bytes.Add(static_cast<uint8>(accumulator));
+				accumulator >>= 8;
+				count -= 8;
+			}
+		}
+
+		/** Writes up to 64 bits */
+		void WriteLong(uint64 Value, int32 Bits)
+		{
+			if (Bits > 32)
+			{
+				Write(Value, 32);
+				Write(Value >> 32, Bits - 32);
+			}
+			else
+				Write(Value, Bits);
+		}
+
+		void WriteRice(uint64 Value, int32 K)
+		{
+			const uint64 quotient = Value >> K;
+			if (quotient < GRiceEscape)
+			{
+				// quotient ones then a zero
+				Write((1ull << quotient) - 1, static_cast<int32>(quotient) + 1);
+				WriteLong(Value, K);
+			}
+			else
+			{
+				Write((1ull << GRiceEscape) - 1, GRiceEscape);
+				WriteLong(Value, 64);
+			}
+		}
+
+		void Flush()
+		{
+			if (count > 0)
+				bytes.Add(static_cast<uint8>(accumulator));
+			accumulator = 0;
+			count = 0;
+		}
+	};
+
+	struct FEEGBitReader
+	{
+		const uint8* data;
+		int64 size;
+		int64 position = 0;
+		uint64 accumulator = 0;
+		int32 count = 0;
+
+		FEEGBitReader(const uint8* Data, int64 Size) : data(Data), size(Size) {}
+
+		void Refill()
+		{
+			while (count <= 56 && position < size)
+			{
+				accumulator |= static_cast<uint64>(data[position++]) << count;
+				count += 8;
+			}
+		}
+
+		/** Reads up to 32 bits */
+		uint64 Read(int32 Bits)
+		{
+			if (count < Bits)
+				Refill();
+			const uint64 value = accumulator & ((1ull << Bits) - 1);
+			accumulator >>= Bits;
+			count = FMath::Max(0, count - Bits);
+			return value;
+		}
+
+		/** Reads up to 64 bits */
+		uint64 ReadLong(int32 Bits)
+		{
+			if (Bits > 32)
+			{
+				const uint64 low = Read(32);
+				return low | Read(Bits - 32) << 32;
+			}
+			return Read(Bits);
+		}
+
+		uint64 ReadRice(int32 K)
+		{
+			Refill();
+			const int32 ones = FMath::Min<int32>(FMath::CountTrailingZeros64(~accumulator), GRiceEscape);
+			if (ones == GRiceEscape)
+			{
+				Read(GRiceEscape);
+				return ReadLong(64);
+			}
+
+			Read(ones + 1);
+			return static_cast<uint64>(ones) << K | ReadLong(K);
+		}
+	};
+}
+
+FEEGCodecWriter::FEEGCodecWriter(TUniquePtr<FArchive> Archive, const FEEGCodecHeader& Header)
+	: m_archive(MoveTemp(Archive))
+	, m_header(Header)
+{
+	check(m_header.blockSize > 0 && m_header.blockSize <= MAX_uint16);
+	m_header.decimalDigits.SetNumZeroed(m_header.numChannels);
+	for (int32& digits : m_header.decimalDigits)
+		digits = FMath::Clamp(digits, 0, GMaxDecimalDigits);
+
+	m_pending.SetNum(m_header.numChannels);
+	for (TArray<double>& channel : m_pending)
+		channel.SetNumUninitialized(m_header.blockSize);
+	m_integers.SetNumUninitialized(m_header.blockSize);
+	// Worst case is every channel verbatim
+	m_bytes.Reserve(16 + m_header.numChannels * (m_header.blockSize + 1) * sizeof(double));
+
+	uint32 magic = GFileMagic;
+	uint32 version = GVersion;
+	*m_archive << magic << version << m_header.numChannels << m_header.sampleRate << m_header.blockSize;
+	for (int32& digits : m_header.decimalDigits)
+		*m_archive << digits;
+}
+
+FEEGCodecWriter::~FEEGCodecWriter()
+{
+	Finish();
+}
+
+TUniquePtr<FEEGCodecWriter> FEEGCodecWriter::Create(const FString& Path, const FEEGCodecHeader& Header)
+{
+	TUniquePtr<FArchive> archive(IFileManager::Get().CreateFileWriter(*Path));
+	if (!archive)
+		return nullptr;
+	return MakeUnique<FEEGCodecWriter>(MoveTemp(archive), Header);
+}
+
+void FEEGCodecWriter::Append(const double* Interleaved, int32 NumFrames)
+{
+	for (int32 frame = 0; frame < NumFrames; ++frame)
+	{
+		for (int32 channel = 0; channel < m_header.numChannels; ++channel)
+			m_pending[channel][m_pendingFrames] = Interleaved[frame * m_header.numChannels + channel];
+
+		if (++m_pendingFrames == m_header.blockSize)
+			EncodeBlock();
+	}
+}
+
+void FEEGCodecWriter::Finish()
+{
+	if (!m_archive)
+		return;
+
+	if (m_pendingFrames > 0)
+		EncodeBlock();
+
+	int64 indexOffset = m_archive->Tell();
+	int32 blockCount = m_index.Num();
+	*m_archive << blockCount;
+	for (TPair<int64, int64>& entry : m_index)
+		*m_archive << entry.Key << entry.Value;
+
+	uint32 magic = GIndexMagic;
+	*m_archive << m_writtenFrames << indexOffset << magic;
+	m_archive->Close();
+	m_archive.Reset();
+}
+
+void FEEGCodecWriter::EncodeBlock()
+{
+	const int32 numFrames = m_pendingFrames;
+	m_bytes.Reset();
+	FEEGBitWriter writer(m_bytes);
+	writer.Write(GBlockSync, 16);
+	writer.Write(numFrames, 16);
+	writer.WriteLong(m_writtenFrames, 64);
+
+	for (int32 channel = 0; channel < m_header.numChannels; ++channel)
+	{
+		const double* samples = m_pending[channel].GetData();
+
+		const uint64 firstBits = ToBits(samples[0]);
+		bool bConstant = true;
+		for (int32 i = 1; i < numFrames && bConstant; ++i)
+			bConstant = ToBits(samples[i]) == firstBits;
+
+		if (bConstant)
+		{
+			writer.Write(Constant, 2);
+			writer.WriteLong(firstBits, 64);
+			continue;
+		}
+
+		// Turn samples into integers, only if they can be restored bit for bit
+		const double scale = GPow10[m_header.decimalDigits[channel]];
+		int64* integers = m_integers.GetData();
+		bool bExact = true;
+		for (int32 i = 0; i < numFrames && bExact; ++i)
+		{
+			const double scaled = samples[i] * scale;
+			bExact = FMath::Abs(scaled) < 9007199254740992.0;	// 2^53, integers above are not all representable
+			if (bExact)
+			{
+				integers[i] = static_cast<int64>(FMath::RoundToDouble(scaled));
+				bExact = ToBits(static_cast<double>(integers[i]) / scale) == ToBits(samples[i]);
+			}
+		}
+
+		if (!bExact)
+		{
+			writer.Write(Verbatim, 2);
+			for (int32 i = 0; i < numFrames; ++i)
+				writer.WriteLong(ToBits(samples[i]), 64);
+			continue;
+		}
+
+		// Pick the predictor with the smallest residuals, estimated on the samples every order can predict
+		double residualSums[4] = {};
+		for (int32 i = 3; i < numFrames; ++i)
+			for (int32 order = 0; order < 4; ++order)
+				residualSums[order] += static_cast<double>(ZigZag(Residual(integers + i, order)));
+
+		int32 order = 0;
+		for (int32 candidate = 1; candidate < 4; ++candidate)
+			if (residualSums[candidate] < residualSums[order])
+				order = candidate;
+		order = FMath::Min(order, numFrames - 1);
+
+		const double meanResidual = numFrames > 3 ? residualSums[order] / (numFrames - 3) : 0.0;
+		const int32 k = meanResidual >= 1.0 ? FMath::Min(60, static_cast<int32>(FMath::FloorLog2_64(static_cast<uint64>(meanResidual)))) : 0;
+
+		writer.Write(Predicted, 2);
+		writer.Write(order, 2);
+		writer.Write(k, 6);
+		for (int32 i = 0; i < order; ++i)
+			writer.WriteLong(ZigZag(integers[i]), 64);
+		for (int32 i = order; i < numFrames; ++i)
+			writer.WriteRice(ZigZag(Residual(integers + i, order)), k);
+	}
+
+	writer.Flush();
+	m_index.Emplace(m_writtenFrames, m_archive->Tell());
+	m_archive->Serialize(m_bytes.GetData(), m_bytes.Num());
+	m_writtenFrames += numFrames;
+	m_pendingFrames = 0;
+}
+
+TUniquePtr<FEEGCodecReader> FEEGCodecReader::Open(const FString& Path)
+{
+	TUniquePtr<FArchive> archive(IFileManager::Get().CreateFileReader(*Path));
+	if (!archive)
+		return nullptr;
+
+	TUniquePtr<FEEGCodecReader> reader = MakeUnique<FEEGCodecReader>();
+	FEEGCodecHeader& header = reader->m_header;
+	uint32 magic = 0;
+	uint32 version = 0;
+	*archive << magic << version;
+	if (magic != GFileMagic || version != GVersion)
+		return nullptr;
+
+	*archive << header.numChannels << header.sampleRate << header.blockSize;
+	if (header.numChannels <= 0 || header.blockSize <= 0 || header.blockSize > MAX_uint16
+		|| header.numChannels > (archive->TotalSize() - archive->Tell()) / static_cast<int64>(sizeof(int32)))
+		return nullptr;
+	header.decimalDigits.SetNum(header.numChannels);
+	for (int32& digits : header.decimalDigits)
+	{
+		*archive << digits;
+		// Scale of the predicted channels, see GPow10
+		if (digits < 0 || digits > GMaxDecimalDigits)
+			return nullptr;
+	}
+
+	// Footer: frame count, index offset, magic
+	const int64 headerEnd = archive->Tell();
+	const int64 footerSize = sizeof(int64) * 2 + sizeof(uint32);
+	const int64 indexEnd = archive->TotalSize() - footerSize;
+	if (archive->IsError() || indexEnd < headerEnd + static_cast<int64>(sizeof(int32)))
+		return nullptr;
+	archive->Seek(indexEnd);
+	*archive << reader->m_numFrames << reader->m_indexOffset << magic;
+	if (magic != GIndexMagic || reader->m_indexOffset < headerEnd || reader->m_indexOffset > indexEnd - static_cast<int64>(sizeof(int32)))
+		return nullptr;
+
+	archive->Seek(reader->m_indexOffset);
+	int32 blockCount = 0;
+	*archive << blockCount;
+	// Entries are a first frame and an offset, the index must hold them before the footer
+	if (blockCount < 0 || blockCount > (indexEnd - reader->m_indexOffset - static_cast<int64>(sizeof(int32))) / static_cast<int64>(2 * sizeof(int64)))
+		return nullptr;
+	reader->m_index.SetNum(blockCount);
+	for (TPair<int64, int64>& entry : reader->m_index)
+		*archive << entry.Key << entry.Value;
+
+	if (archive->IsError())
+		return nullptr;
+
+	// Blocks cover the frames from 0 without gap, one after the other in the file, and the last one ends the frames
+	int64 previousKey = -1;
+	int64 previousOffset = headerEnd - 1;
+	for (const TPair<int64, int64>& entry : reader->m_index)
+	{
+		if ((previousKey < 0 ? entry.Key != 0 : entry.Key <= previousKey || entry.Key - previousKey > header.blockSize)
+			|| entry.Value <= previousOffset || entry.Value >= reader->m_indexOffset)
+			return nullptr;
+		previousKey = entry.Key;
+		previousOffset = entry.Value;
+	}
+	const int64 lastKey = reader->m_index.Num() > 0 ? reader->m_index.Last().Key : 0;
+	if (reader->m_numFrames < 0 || (reader->m_index.Num() == 0 && reader->m_numFrames > 0) || reader->m_numFrames > lastKey + header.blockSize)
+		return nullptr;
+
+	reader->m_block.SetNum(header.numChannels);
+	for (TArray<double>& channel : reader->m_block)
+		channel.SetNumUninitialized(header.blockSize);
+	reader->m_integers.SetNumUninitialized(header.blockSize);
+	reader->m_archive = MoveTemp(archive);
+	return reader;
+}
+
+void FEEGCodecReader::Seek(int64 Frame)
+{
+	m_position = FMath::Clamp<int64>(Frame, 0, m_numFrames);
+}
+
+int32 FEEGCodecReader::Read(double* OutInterleaved, int32 MaxFrames)
+{
+	const int32 numChannels = m_header.numChannels;
+	int32 readFrames = 0;
+
+	while (readFrames < MaxFrames && m_position < m_numFrames)
+	{
+		// Block containing the current position
+		const int32 blockIndex = Algo::UpperBound(m_index, m_position, [](int64 Frame, const TPair<int64, int64>& Entry) { return Frame < Entry.Key; }) - 1;
+		if (blockIndex < 0 || (blockIndex != m_blockIndex && !DecodeBlock(blockIndex)))
+			break;
+
+		const int32 offset = static_cast<int32>(m_position - m_index[blockIndex].Key);
+		const int32 count = FMath::Min(MaxFrames - readFrames, m_blockFrames - offset);
+		// The block is shorter than the index says
+		if (count <= 0)
+			break;
+		for (int32 frame = 0; frame < count; ++frame)
+			for (int32 channel = 0; channel < numChannels; ++channel)
+				OutInterleaved[(readFrames + frame) * numChannels + channel] = m_block[channel][offset + frame];
+
+		readFrames += count;
+		m_position += count;
+	}
+
+	return readFrames;
+}
+
+bool FEEGCodecReader::DecodeBlock(int32 BlockIndex)
+{
+	if (!m_index.IsValidIndex(BlockIndex))
+		return false;
+
+	const int64 start = m_index[BlockIndex].Value;
+	const int64 end = BlockIndex + 1 < m_index.Num() ? m_index[BlockIndex + 1].Value : m_indexOffset;
+	m_bytes.SetNumUninitialized(static_cast<int32>(end - start), false);
+	m_archive->Seek(start);
+	m_archive->Serialize(m_bytes.GetData(), m_bytes.Num());
+
+	FEEGBitReader reader(m_bytes.GetData(), m_bytes.Num());
+	if (reader.Read(16) != GBlockSync)
+		return false;
+	const int32 numFrames = static_cast<int32>(reader.Read(16));
+	const int64 firstFrame = static_cast<int64>(reader.ReadLong(64));
+	if (numFrames <= 0 || numFrames > m_header.blockSize || firstFrame != m_index[BlockIndex].Key)
+		return false;
+
+	for (int32 channel = 0; channel < m_header.numChannels; ++channel)
+	{
+		double* samples = m_block[channel].GetData();
+
+		switch (reader.Read(2))
+		{
+		case Constant:
+		{
+			const double value = FromBits(reader.ReadLong(64));
+			for (int32 i = 0; i < numFrames; ++i)
+				samples[i] = value;
+			break;
+		}
+		case Predicted:
+		{
+			const int32 order = static_cast<int32>(reader.Read(2));
+			const int32 k = static_cast<int32>(reader.Read(6));
+			if (order > numFrames)
+				return false;
+			const double scale = GPow10[m_header.decimalDigits[channel]];
+			int64* integers = m_integers.GetData();
+
+			for (int32 i = 0; i < order; ++i)
+				integers[i] = UnZigZag(reader.ReadLong(64));
+			for (int32 i = order; i < numFrames; ++i)
+			{
+				// Prediction is the residual formula evaluated with a 0 current sample, negated
+				integers[i] = 0;
+				integers[i] = UnZigZag(reader.ReadRice(k)) - Residual(integers + i, order);
+			}
+			for (int32 i = 0; i < numFrames; ++i)
+				samples[i] = static_cast<double>(integers[i]) / scale;
+			break;
+		}
+		case Verbatim:
+			for (int32 i = 0; i < numFrames; ++i)
+				samples[i] = FromBits(reader.ReadLong(64));
+			break;
+		default:
+			return false;
+		}
+	}
+
+	m_blockIndex = BlockIndex;
+	m_blockFrames = numFrames;
+	return true;
+}
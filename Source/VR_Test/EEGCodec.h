@@ -0,0 +1,114 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Lossless streaming codec for multi-channel EEG sessions (.eegc files).
+ *
+ * Samples are encoded in blocks of blockSize frames. Every block starts with its first frame index and holds, per channel, either:
+ * - a constant value,
+ * - the residuals of the best fixed linear predictor (order 0 to 3) of the samples turned into integers with decimalDigits decimals, Rice coded,
+ * - the raw samples, when a channel does not fit in decimalDigits decimals exactly, so that decoding always gives back the exact same doubles.
+ * Blocks do not depend on each other and a seek index (first frame and byte offset of each block) is written at the end of the file.
+ *
+ * File layout: header, blocks, index, footer (index offset + magic).
+ */
+struct VR_TEST_API FEEGCodecHeader
+{
+	int32 numChannels = 0;
+	float sampleRate = 0.f;
+	/** Number of frames (one sample per channel) per block */
+	int32 blockSize = 512;
+	/** Number of decimals of each channel, e.g. 10 for OpenViBE's "CSV File Writer" default precision */
+	TArray<int32> decimalDigits;
+};
+
+class VR_TEST_API FEEGCodecWriter
+{
+	TUniquePtr<FArchive> m_archive;
+	FEEGCodecHeader m_header;
+	/** Frames waiting to be encoded, one array per channel */
+	TArray<TArray<double>> m_pending;
+	int32 m_pendingFrames = 0;
+	int64 m_writtenFrames = 0;
+	/** Preallocated encoding buffers */
+	TArray<int64> m_integers;
+	TArray<uint8> m_bytes;
+	/** Seek index, first frame and byte offset of every block */
+	TArray<TPair<int64, int64>> m_index;
+
+public:
+	/**
+	 * @param Archive	Destination, owned by the writer
+	 * @param Header	Stream description
+	 */
+	FEEGCodecWriter(TUniquePtr<FArchive> Archive, const FEEGCodecHeader& Header);
+	~FEEGCodecWriter();
+
+	/**
+	 * Creates a writer on a new file.
+	 * @param Path		File to create
+	 * @param Header	Stream description
+	 * @return			nullptr if the file cannot be created
+	 */
+	static TUniquePtr<FEEGCodecWriter> Create(const FString& Path, const FEEGCodecHeader& Header);
+
+	/**
+	 * Appends frames, encoding every block as soon as it is full, so the CPU cost per call is bounded by the number of appended frames.
+	 * @param Interleaved	NumFrames * numChannels samples, channel after channel for each frame
+	 * @param NumFrames		Number of frames
+	 */
+	void Append(const double* Interleaved, int32 NumFrames);
+	/** Encodes the last partial block, writes the seek index and closes the file. Called by the destructor if needed. */
+	void Finish();
+
+private:
+	void EncodeBlock();
+};
+
+class VR_TEST_API FEEGCodecReader
+{
+	TUniquePtr<FArchive> m_archive;
+	FEEGCodecHeader m_header;
+	TArray<TPair<int64, int64>> m_index;
+	int64 m_indexOffset = 0;
+	int64 m_numFrames = 0;
+	/** Decoded block, one array per channel */
+	TArray<TArray<double>> m_block;
+	TArray<int64> m_integers;
+	TArray<uint8> m_bytes;
+	int32 m_blockIndex = INDEX_NONE;
+	int32 m_blockFrames = 0;
+	/** Next frame to read */
+	int64 m_position = 0;
+
+public:
+	/**
+	 * Opens an .eegc file and reads its seek index.
+	 * @param Path	File to read
+	 * @return		nullptr if the file cannot be read or is not a valid stream
+	 */
+	static TUniquePtr<FEEGCodecReader> Open(const FString& Path);
+
+	const FEEGCodecHeader& GetHeader() const { return m_header; }
+	int64 GetNumFrames() const { return m_numFrames; }
+	int64 GetPosition() const { return m_position; }
+
+	/**
+	 * Moves to a frame. Only the block containing it will be decoded.
+	 * @param Frame		Frame index
+	 */
+	void Seek(int64 Frame);
+	/**
+	 * Reads frames from the current position.
+	 * @param OutInterleaved	Receives MaxFrames * numChannels samples at most
+	 * @param MaxFrames			Max number of frames to read
+	 * @return					Number of read frames, 0 at the end of the stream
+	 */
+	int32 Read(double* OutInterleaved, int32 MaxFrames);
+
+private:
+	bool DecodeBlock(int32 BlockIndex);
+};
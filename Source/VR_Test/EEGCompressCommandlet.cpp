@@ -0,0 +1,161 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EEGCompressCommandlet.h"
+
+#include "EEGCodec.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "VR_Test.h"
+
+namespace
+{
+	/** Samples of a multi-channel OpenViBE CSV recording */
+	struct FCsvRecording
+	{
+		float sampleRate = 0.f;
+		int32 numChannels = 0;
+		/** Frames, channel after channel */
+		TArray<double> samples;
+	};
+
+	/** Reads "Time:512Hz,Epoch,<channels...>,Event Id,Event Date,Event Duration" files */
+	bool LoadCsvRecording(const FString& Path, float DefaultSampleRate, FCsvRecording& OutRecording)
+	{
+		TArray<FString> lines;
+		if (!FFileHelper::LoadFileToStringArray(lines, *Path) || lines.Num() < 2)
+			return false;
+
+		TArray<FString> cells;
+		lines[0].ParseIntoArray(cells, TEXT(","), false);
+
+		int32 firstChannel = 1;
+		int32 endChannel = cells.Num();
+		OutRecording.sampleRate = DefaultSampleRate;
+		if (cells[0].StartsWith(TEXT("Time:")))
+		{
+			OutRecording.sampleRate = FCString::Atof(*cells[0].RightChop(5));
+			if (cells.IsValidIndex(1) && cells[1] == TEXT("Epoch"))
+				firstChannel = 2;
+		}
+		const int32 eventColumn = cells.IndexOfByKey(TEXT("Event Id"));
+		if (eventColumn != INDEX_NONE)
+			endChannel = eventColumn;
+
+		OutRecording.numChannels = endChannel - firstChannel;
+		if (OutRecording.numChannels <= 0 || OutRecording.sampleRate <= 0.f)
+			return false;
+
+		OutRecording.samples.Reset((lines.Num() - 1) * OutRecording.numChannels);
+		for (int32 i = 1; i < lines.Num(); ++i)
+		{
+			lines[i].ParseIntoArray(cells, TEXT(","), false);
+			if (cells.Num() < endChannel)
+				continue;
+			for (int32 column = firstChannel; column < endChannel; ++column)
+				OutRecording.samples.Add(FCString::Atod(*cells[column]));
+		}
+
+		return OutRecording.samples.Num() > 0;
+	}
+}
+
+UEEGCompressCommandlet::UEEGCompressCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UEEGCompressCommandlet::Main(const FString& Params)
+{
+	FString input;
+	if (!FParse::Value(*Params, TEXT("In="), input))
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Missing -In=<csv file or directory>"));
+		return 1;
+	}
+
+	int32 digits = 10;
+	int32 blockSize = 512;
+	float defaultSampleRate = 512.f;
+	FParse::Value(*Params, TEXT("Digits="), digits);
+	FParse::Value(*Params, TEXT("BlockSize="), blockSize);
+	FParse::Value(*Params, TEXT("Rate="), defaultSampleRate);
+	const bool bVerify = FParse::Param(*Params, TEXT("Verify"));
+
+	TArray<FString> files;
+	if (IFileManager::Get().DirectoryExists(*input))
+	{
+		IFileManager::Get().FindFiles(files, *(input / TEXT("*.csv")), true, false);
+		for (FString& file : files)
+			file = input / file;
+	}
+	else
+		files.Add(input);
+
+	int32 failures = 0;
+	for (const FString& file : files)
+	{
+		FString outDir = FPaths::GetPath(file);
+		FParse::Value(*Params, TEXT("Out="), outDir);
+		const FString outPath = outDir / FPaths::GetBaseFilename(file) + TEXT(".eegc");
+
+		FCsvRecording recording;
+		if (!LoadCsvRecording(file, defaultSampleRate, recording))
+		{
+			UE_LOG(LogMeditation, Warning, TEXT("Could not read %s"), *file);
+			++failures;
+			continue;
+		}
+
+		FEEGCodecHeader header;
+		header.numChannels = recording.numChannels;
+		header.sampleRate = recording.sampleRate;
+		header.blockSize = FMath::Clamp(blockSize, 1, static_cast<int32>(MAX_uint16));
+		header.decimalDigits.Init(digits, recording.numChannels);
+
+		const int32 numFrames = recording.samples.Num() / recording.numChannels;
+		const double encodeStart = FPlatformTime::Seconds();
+		{
+			TUniquePtr<FEEGCodecWriter> writer = FEEGCodecWriter::Create(outPath, header);
+			if (!writer)
+			{
+				UE_LOG(LogMeditation, Warning, TEXT("Could not create %s"), *outPath);
+				++failures;
+				continue;
+			}
+			writer->Append(recording.samples.GetData(), numFrames);
+		}
+		const double encodeDuration = FPlatformTime::Seconds() - encodeStart;
+
+		const int64 rawSize = static_cast<int64>(recording.samples.Num()) * sizeof(double);
+		const int64 fileSize = IFileManager::Get().FileSize(*outPath);
+		UE_LOG(LogMeditation, Display, TEXT("%s: %d channels, %d frames, %.2fx smaller than raw doubles, encoded in %.3f s"),
+			*FPaths::GetCleanFilename(outPath), recording.numChannels, numFrames, static_cast<double>(rawSize) / FMath::Max<int64>(fileSize, 1), encodeDuration);
+
+		if (!bVerify)
+			continue;
+
+		TUniquePtr<FEEGCodecReader> reader = FEEGCodecReader::Open(outPath);
+		TArray<double> decoded;
+		decoded.SetNumUninitialized(recording.samples.Num());
+		const double decodeStart = FPlatformTime::Seconds();
+		const int32 decodedFrames = reader ? reader->Read(decoded.GetData(), numFrames) : 0;
+		const double decodeDuration = FPlatformTime::Seconds() - decodeStart;
+
+		if (decodedFrames != numFrames || FMemory::Memcmp(decoded.GetData(), recording.samples.GetData(), rawSize) != 0)
+		{
+			UE_LOG(LogMeditation, Error, TEXT("%s does not decode back to the recorded samples"), *outPath);
+			++failures;
+			continue;
+		}
+
+		UE_LOG(LogMeditation, Display, TEXT("%s verified, decoded %.0fx faster than real time"), *FPaths::GetCleanFilename(outPath),
+			numFrames / recording.sampleRate / FMath::Max(decodeDuration, 1e-6));
+	}
+
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "EEGCompressCommandlet.generated.h"
+
+/**
+ * Converts sessions recorded by OpenViBE's "CSV File Writer" box into lossless .eegc archives (see FEEGCodecWriter), e.g.:
+ * UnrealEditor-Cmd VR_Test.uproject -run=EEGCompress -nullrhi -In=<csv file or dir> [-Out=<dir>] [-Digits=10] [-BlockSize=512] [-Verify]
+ * The time column is not stored, it is given back by the sample rate. -Verify decodes every archive, compares it with the CSV and reports the decoding speed.
+ */
+UCLASS()
+class UEEGCompressCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UEEGCompressCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
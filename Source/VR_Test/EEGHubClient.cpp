@@ -0,0 +1,122 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EEGHubClient.h"
+
+#include "EEGHubProtocol.h"
+#include "VR_Test.h"
+
+TUniquePtr<FEEGHubClient> FEEGHubClient::Connect(uint32 ChannelMask, int32 Decimation)
+{
+	FPlatformMemory::FSharedMemoryRegion* region = FPlatformMemory::MapNamedSharedMemoryRegion(EEGHub::RegionName, false,
+		FPlatformMemory::ESharedMemoryAccess::Read | FPlatformMemory::ESharedMemoryAccess::Write, sizeof(EEGHub::FLayout));
+	if (!region)
+		return nullptr;
+
+	EEGHub::FLayout* layout = static_cast<EEGHub::FLayout*>(region->GetAddress());
+	const int32 deviceChannels = layout->deviceChannels.load(std::memory_order_acquire);
+	if (layout->magic != EEGHub::Magic || layout->version != EEGHub::Version || deviceChannels <= 0)
+	{
+		UE_LOG(LogMeditation, Warning, TEXT("EEG hub found but not streaming"));
+		FPlatformMemory::UnmapNamedSharedMemoryRegion(region);
+		return nullptr;
+	}
+
+	ChannelMask &= deviceChannels >= 32 ? ~0u : (1u << deviceChannels) - 1;
+	if (ChannelMask == 0)
+	{
+		FPlatformMemory::UnmapNamedSharedMemoryRegion(region);
+		return nullptr;
+	}
+
+	for (EEGHub::FSlot& slot : layout->slots)
+	{
+		uint32 expected = EEGHub::Free;
+		if (slot.state.load(std::memory_order_relaxed) != expected)
+			continue;
+		// Before claiming, the hub would otherwise time the slot out on the heartbeat of its previous subscriber
+		slot.heartbeat.store(FPlatformTime::Seconds(), std::memory_order_relaxed);
+		if (!slot.state.compare_exchange_strong(expected, EEGHub::Claimed, std::memory_order_acq_rel))
+			continue;
+
+		slot.channelMask = ChannelMask;
+		slot.decimation = FMath::Max(Decimation, 1);
+		const uint32 generation = slot.generation.fetch_add(1, std::memory_order_relaxed) + 1;
+		// Start with an empty ring, the hub does not write to a claimed slot
+		slot.readIndex.store(slot.writeIndex.load(std::memory_order_acquire), std::memory_order_relaxed);
+		slot.droppedFrames.store(0, std::memory_order_relaxed);
+		slot.state.store(EEGHub::Active, std::memory_order_release);
+
+		TUniquePtr<FEEGHubClient> client(new FEEGHubClient());
+		client->m_region = region;
+		client->m_layout = layout;
+		client->m_slot = &slot;
+		client->m_generation = generation;
+		client->m_hubHeartbeat = layout->hubHeartbeat.load(std::memory_order_relaxed);
+		client->m_hubHeartbeatTime = FPlatformTime::Seconds();
+		client->m_numChannels = FMath::CountBits(ChannelMask);
+		client->m_sampleRate = layout->deviceSampleRate.load(std::memory_order_relaxed) / slot.decimation;
+		UE_LOG(LogMeditation, Log, TEXT("Subscribed to the EEG hub, slot %d, %d channels at %g Hz"), UE_PTRDIFF_TO_INT32(&slot - layout->slots),
+			client->m_numChannels, client->m_sampleRate);
+		return client;
+	}
+
+	UE_LOG(LogMeditation, Warning, TEXT("Every EEG hub slot is taken"));
+	FPlatformMemory::UnmapNamedSharedMemoryRegion(region);
+	return nullptr;
+}
+
+FEEGHubClient::~FEEGHubClient()
+{
+	// The slot may have been freed by the hub and claimed by another subscriber since
+	uint32 expected = EEGHub::Active;
+	if (m_slot && m_slot->generation.load(std::memory_order_relaxed) == m_generation)
+		m_slot->state.compare_exchange_strong(expected, EEGHub::Free, std::memory_order_acq_rel);
+	if (m_region)
+		FPlatformMemory::UnmapNamedSharedMemoryRegion(m_region);
+}
+
+bool FEEGHubClient::OwnsSlot() const
+{
+	return m_slot->state.load(std::memory_order_acquire) == EEGHub::Active && m_slot->generation.load(std::memory_order_relaxed) == m_generation;
+}
+
+int32 FEEGHubClient::Pull(float* OutInterleaved, double* OutTimestamps, int32 MaxFrames)
+{
+	if (!OwnsSlot())
+		return INDEX_NONE;
+	const double now = FPlatformTime::Seconds();
+	m_slot->heartbeat.store(now, std::memory_order_relaxed);
+
+	// A killed hub leaves the region mapped and the slot active, only its heartbeat stops
+	const uint64 hubHeartbeat = m_layout->hubHeartbeat.load(std::memory_order_relaxed);
+	if (hubHeartbeat != m_hubHeartbeat)
+	{
+		m_hubHeartbeat = hubHeartbeat;
+		m_hubHeartbeatTime = now;
+	}
+	else if (now - m_hubHeartbeatTime > EEGHub::HubTimeout)
+		return INDEX_NONE;
+
+	const uint64 read = m_slot->readIndex.load(std::memory_order_relaxed);
+	const uint64 write = m_slot->writeIndex.load(std::memory_order_acquire);
+	const int32 count = static_cast<int32>(FMath::Min<uint64>(write - read, MaxFrames));
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		const uint32 index = static_cast<uint32>(read + i) & (EEGHub::RingFrames - 1);
+		FMemory::Memcpy(OutInterleaved + i * m_numChannels, m_slot->frames + index * EEGHub::MaxChannels, sizeof(float) * m_numChannels);
+		OutTimestamps[i] = m_slot->timestamps[index];
+	}
+
+	// Freed while copying: the frames may belong to someone else, and so does the read index
+	if (!OwnsSlot())
+		return INDEX_NONE;
+	m_slot->readIndex.store(read + count, std::memory_order_release);
+	return count;
+}
+
+uint64 FEEGHubClient::GetDroppedFrames() const
+{
+	return m_slot->droppedFrames.load(std::memory_order_relaxed);
+}
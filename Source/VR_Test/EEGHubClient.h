@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EEGSampleSource.h"
+
+namespace EEGHub { struct FLayout; struct FSlot; }
+
+/**
+ * Subscription to the local EEG hub (see UEEGHubCommandlet). Claims a slot of the hub shared memory, and pulls the frames that the hub already
+ * filtered and decimated for it: pulling is a copy out of a ring, the client never touches the device stream or the other subscribers.
+ */
+class VR_TEST_API FEEGHubClient : public IEEGSampleSource
+{
+	FPlatformMemory::FSharedMemoryRegion* m_region = nullptr;
+	EEGHub::FLayout* m_layout = nullptr;
+	EEGHub::FSlot* m_slot = nullptr;
+	/** Generation of the slot when claimed, it changed if the hub freed the slot and someone else claimed it */
+	uint32 m_generation = 0;
+	/** Last hub heartbeat seen, and FPlatformTime::Seconds() when it was seen to advance */
+	uint64 m_hubHeartbeat = 0;
+	double m_hubHeartbeatTime = 0.0;
+	int32 m_numChannels = 0;
+	float m_sampleRate = 0.f;
+
+	FEEGHubClient() = default;
+	/** @return False once the hub freed the slot, even if it was claimed again since */
+	bool OwnsSlot() const;
+
+public:
+	virtual ~FEEGHubClient() override;
+
+	/**
+	 * Subscribes to the hub.
+	 * @param ChannelMask	Device channels to receive, bit i for channel i
+	 * @param Decimation	Keep one frame out of Decimation, frames are averaged in between
+	 * @return				Null if no hub runs or every slot is taken
+	 */
+	static TUniquePtr<FEEGHubClient> Connect(uint32 ChannelMask, int32 Decimation);
+
+	virtual int32 GetNumChannels() const override { return m_numChannels; }
+	virtual float GetSampleRate() const override { return m_sampleRate; }
+	/** Fails once the hub freed the slot, after a hitch longer than EEGHub::SubscriberTimeout, or once the hub stopped for EEGHub::HubTimeout */
+	virtual int32 Pull(float* OutInterleaved, double* OutTimestamps, int32 MaxFrames) override;
+
+	/** @return Frames the hub dropped because this subscriber did not pull fast enough */
+	uint64 GetDroppedFrames() const;
+};
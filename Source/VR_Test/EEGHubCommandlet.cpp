@@ -0,0 +1,251 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EEGHubCommandlet.h"
+
+#include "EEGHubProtocol.h"
+#include "SocketSubsystem.h"
+#include "Sockets.h"
+#include "VR_Test.h"
+
+namespace
+{
+	/** Raw TCP Writer header: version and endianness in network order, then frequency, channels, samples per chunk and 3 reserved words */
+	constexpr int32 TcpWriterHeaderWords = 8;
+	constexpr uint32 TcpWriterLittleEndian = 1;
+	constexpr double PollInterval = .1;
+
+	/** Hub side state of a subscriber slot */
+	struct FSubscriber
+	{
+		bool bActive = false;
+		uint32 generation = 0;
+		int32 decimation = 1;
+		int32 numChannels = 0;
+		int32 channels[EEGHub::MaxChannels];
+		/** Frames averaged since the last published one */
+		int32 accumulated = 0;
+		float sums[EEGHub::MaxChannels];
+		double firstTimestamp = 0.;
+	};
+
+	class FHub
+	{
+		FPlatformMemory::FSharedMemoryRegion* m_region = nullptr;
+		EEGHub::FLayout* m_layout = nullptr;
+		FSubscriber m_subscribers[EEGHub::MaxSubscribers];
+
+	public:
+		~FHub()
+		{
+			if (m_layout)
+				m_layout->deviceChannels.store(0, std::memory_order_release);
+			if (m_region)
+				FPlatformMemory::UnmapNamedSharedMemoryRegion(m_region);
+		}
+
+		bool Create()
+		{
+			m_region = FPlatformMemory::MapNamedSharedMemoryRegion(EEGHub::RegionName, true,
+				FPlatformMemory::ESharedMemoryAccess::Read | FPlatformMemory::ESharedMemoryAccess::Write, sizeof(EEGHub::FLayout));
+			if (!m_region)
+				return false;
+
+			// Keep the slots of a previous hub run so that running subscribers stay attached
+			m_layout = static_cast<EEGHub::FLayout*>(m_region->GetAddress());
+			if (m_layout->magic != EEGHub::Magic || m_layout->version != EEGHub::Version)
+			{
+				FMemory::Memzero(m_layout, sizeof(EEGHub::FLayout));
+				m_layout->magic = EEGHub::Magic;
+				m_layout->version = EEGHub::Version;
+			}
+			return true;
+		}
+
+		void SetDevice(int32 NumChannels, float SampleRate)
+		{
+			m_layout->deviceSampleRate.store(SampleRate, std::memory_order_relaxed);
+			m_layout->deviceChannels.store(NumChannels, std::memory_order_release);
+		}
+
+		/** Picks up new subscriptions and frees the slots of dead subscribers */
+		void UpdateSlots(double Now)
+		{
+			m_layout->hubHeartbeat.fetch_add(1, std::memory_order_relaxed);
+
+			for (int32 index = 0; index < EEGHub::MaxSubscribers; ++index)
+			{
+				EEGHub::FSlot& slot = m_layout->slots[index];
+				FSubscriber& subscriber = m_subscribers[index];
+				uint32 state = slot.state.load(std::memory_order_acquire);
+
+				if (state != EEGHub::Free && Now - slot.heartbeat.load(std::memory_order_relaxed) > EEGHub::SubscriberTimeout
+					&& slot.state.compare_exchange_strong(state, EEGHub::Free, std::memory_order_acq_rel))
+				{
+					UE_LOG(LogMeditation, Display, TEXT("Subscriber %d timed out"), index);
+					state = EEGHub::Free;
+				}
+
+				if (state != EEGHub::Active)
+				{
+					subscriber.bActive = false;
+					continue;
+				}
+				if (subscriber.bActive && subscriber.generation == slot.generation.load(std::memory_order_relaxed))
+					continue;
+
+				subscriber = FSubscriber();
+				subscriber.bActive = true;
+				subscriber.generation = slot.generation.load(std::memory_order_relaxed);
+				subscriber.decimation = FMath::Max(slot.decimation, 1);
+				for (int32 channel = 0; channel < EEGHub::MaxChannels; ++channel)
+					if (slot.channelMask & (1u << channel))
+						subscriber.channels[subscriber.numChannels++] = channel;
+				UE_LOG(LogMeditation, Display, TEXT("Subscriber %d: %d channels, decimation %d"), index, subscriber.numChannels, subscriber.decimation);
+			}
+		}
+
+		/** Adds a device frame to every subscription, never waits for a subscriber */
+		void Publish(const float* Frame, double Timestamp)
+		{
+			for (int32 index = 0; index < EEGHub::MaxSubscribers; ++index)
+			{
+				FSubscriber& subscriber = m_subscribers[index];
+				if (!subscriber.bActive)
+					continue;
+
+				if (subscriber.accumulated == 0)
+				{
+					subscriber.firstTimestamp = Timestamp;
+					FMemory::Memzero(subscriber.sums, sizeof(float) * subscriber.numChannels);
+				}
+				for (int32 i = 0; i < subscriber.numChannels; ++i)
+					subscriber.sums[i] += Frame[subscriber.channels[i]];
+				if (++subscriber.accumulated < subscriber.decimation)
+					continue;
+
+				// Boxcar average before decimating, cheap anti-aliasing
+				EEGHub::FSlot& slot = m_layout->slots[index];
+				const uint64 write = slot.writeIndex.load(std::memory_order_relaxed);
+				if (write - slot.readIndex.load(std::memory_order_acquire) >= EEGHub::RingFrames)
+					slot.droppedFrames.fetch_add(1, std::memory_order_relaxed);
+				else
+				{
+					const uint32 ringIndex = static_cast<uint32>(write) & (EEGHub::RingFrames - 1);
+					const float scale = 1.f / subscriber.accumulated;
+					float* dest = slot.frames + ringIndex * EEGHub::MaxChannels;
+					for (int32 i = 0; i < subscriber.numChannels; ++i)
+						dest[i] = subscriber.sums[i] * scale;
+					slot.timestamps[ringIndex] = (subscriber.firstTimestamp + Timestamp) * .5;
+					slot.writeIndex.store(write + 1, std::memory_order_release);
+				}
+				subscriber.accumulated = 0;
+			}
+		}
+	};
+
+	/** Receives exactly Size bytes, false on disconnection or exit request */
+	bool ReceiveAll(FSocket& Socket, uint8* Data, int32 Size)
+	{
+		while (Size > 0)
+		{
+			if (IsEngineExitRequested())
+				return false;
+			if (!Socket.Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromSeconds(PollInterval)))
+				continue;
+
+			int32 received = 0;
+			if (!Socket.Recv(Data, Size, received) || received <= 0)
+				return false;
+			Data += received;
+			Size -= received;
+		}
+		return true;
+	}
+}
+
+UEEGHubCommandlet::UEEGHubCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UEEGHubCommandlet::Main(const FString& Params)
+{
+	FString host = TEXT("127.0.0.1");
+	int32 port = 5670;
+	FParse::Value(*Params, TEXT("Host="), host);
+	FParse::Value(*Params, TEXT("Port="), port);
+
+	FHub hub;
+	if (!hub.Create())
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Could not create the shared memory region %s"), EEGHub::RegionName);
+		return 1;
+	}
+
+	ISocketSubsystem* sockets = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	TSharedRef<FInternetAddr> address = sockets->CreateInternetAddr();
+	bool bValidAddress = false;
+	address->SetIp(*host, bValidAddress);
+	address->SetPort(port);
+	if (!bValidAddress)
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Invalid host %s"), *host);
+		return 1;
+	}
+
+	TArray<double> chunk;
+	TArray<float> frame;
+	while (!IsEngineExitRequested())
+	{
+		hub.UpdateSlots(FPlatformTime::Seconds());
+
+		FSocket* socket = sockets->CreateSocket(NAME_Stream, TEXT("EEGHub"), false);
+		if (!socket || !socket->Connect(*address))
+		{
+			sockets->DestroySocket(socket);
+			FPlatformProcess::Sleep(1.f);
+			continue;
+		}
+
+		uint32 header[TcpWriterHeaderWords];
+		if (ReceiveAll(*socket, reinterpret_cast<uint8*>(header), sizeof(header)) && NETWORK_ORDER32(header[1]) == TcpWriterLittleEndian)
+		{
+			const float sampleRate = static_cast<float>(header[2]);
+			const int32 numChannels = static_cast<int32>(header[3]);
+			const int32 samplesPerChunk = static_cast<int32>(header[4]);
+			if (numChannels > 0 && numChannels <= EEGHub::MaxChannels && samplesPerChunk > 0 && sampleRate > 0.f)
+			{
+				UE_LOG(LogMeditation, Display, TEXT("Streaming %d channels at %g Hz from %s:%d"), numChannels, sampleRate, *host, port);
+				hub.SetDevice(numChannels, sampleRate);
+				chunk.SetNumUninitialized(numChannels * samplesPerChunk);
+				frame.SetNumUninitialized(numChannels);
+
+				while (ReceiveAll(*socket, reinterpret_cast<uint8*>(chunk.GetData()), chunk.Num() * sizeof(double)))
+				{
+					// The chunk is a channels x samples matrix, its last sample is the one that just arrived
+					const double now = FPlatformTime::Seconds();
+					hub.UpdateSlots(now);
+					for (int32 sample = 0; sample < samplesPerChunk; ++sample)
+					{
+						for (int32 channel = 0; channel < numChannels; ++channel)
+							frame[channel] = static_cast<float>(chunk[channel * samplesPerChunk + sample]);
+						hub.Publish(frame.GetData(), now - (samplesPerChunk - 1 - sample) / sampleRate);
+					}
+				}
+				hub.SetDevice(0, 0.f);
+			}
+			else
+				UE_LOG(LogMeditation, Warning, TEXT("Unsupported stream: %d channels, %d samples per chunk"), numChannels, samplesPerChunk);
+		}
+
+		UE_LOG(LogMeditation, Display, TEXT("Disconnected from %s:%d"), *host, port);
+		socket->Close();
+		sockets->DestroySocket(socket);
+	}
+
+	return 0;
+}
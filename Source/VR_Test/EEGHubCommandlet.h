@@ -0,0 +1,24 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "EEGHubCommandlet.generated.h"
+
+/**
+ * Local EEG hub: reads the device stream once from OpenViBE's "TCP Writer" box (raw format) and fans it out to every local subscriber
+ * (VR build, spectator build, recorder...) through shared memory, see EEGHubProtocol.h and FEEGHubClient.
+ * Each subscriber gets its own channel selection and decimation, and its own ring: a subscriber that stops pulling only loses its own frames.
+ * UnrealEditor-Cmd VR_Test.uproject -run=EEGHub -nullrhi [-Host=127.0.0.1] [-Port=5670]
+ */
+UCLASS()
+class UEEGHubCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UEEGHubCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
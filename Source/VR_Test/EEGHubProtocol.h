@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/**
+ * Layout of the shared memory region through which the EEG hub (UEEGHubCommandlet) fans device data out to local subscribers (FEEGHubClient).
+ * The hub is the only writer of frames. Each subscriber owns a slot with its own ring, channel selection and decimation: a slow or stalled
+ * subscriber only fills its own ring, the hub then drops frames for it and counts them, and never waits.
+ */
+namespace EEGHub
+{
+	constexpr TCHAR RegionName[] = TEXT("VR_Test_EEGHub");
+	constexpr uint32 Magic = 0x42554845;	// "EHUB"
+	constexpr uint32 Version = 1;
+	constexpr int32 MaxSubscribers = 8;
+	constexpr int32 MaxChannels = 32;
+	/** Frames per subscriber ring, power of two */
+	constexpr int32 RingFrames = 4096;
+	/** A subscriber whose heartbeat is older than that (s) is considered dead and its slot is freed by the hub */
+	constexpr double SubscriberTimeout = 5.0;
+	/** A hub whose heartbeat did not advance for that long (s) is considered dead by its subscribers */
+	constexpr double HubTimeout = 5.0;
+
+	enum ESlotState : uint32
+	{
+		Free,
+		/** Claimed by a subscriber that is writing its subscription */
+		Claimed,
+		Active
+	};
+
+	struct alignas(PLATFORM_CACHE_LINE_SIZE) FSlot
+	{
+		std::atomic<uint32> state;
+		/** Subscription, written by the subscriber before activating the slot */
+		uint32 channelMask;
+		int32 decimation;
+		/** Incremented on every claim, tells the hub that a slot changed hands between two of its updates, and a subscriber that it lost its slot */
+		std::atomic<uint32> generation;
+		/** Subscriber heartbeat, FPlatformTime::Seconds() of its last pull */
+		std::atomic<double> heartbeat;
+
+		/** Frames written by the hub */
+		alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint64> writeIndex;
+		std::atomic<uint64> droppedFrames;
+		/** Frames consumed by the subscriber */
+		alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint64> readIndex;
+
+		/** Selected channels only, in device order */
+		float frames[RingFrames * MaxChannels];
+		double timestamps[RingFrames];
+	};
+
+	struct FLayout
+	{
+		uint32 magic;
+		uint32 version;
+		/** Incremented by the hub on every ingest loop, 0 when no hub runs */
+		std::atomic<uint64> hubHeartbeat;
+		/** Device stream description, written by the hub when connected */
+		std::atomic<int32> deviceChannels;
+		std::atomic<float> deviceSampleRate;
+		FSlot slots[MaxSubscribers];
+	};
+
+	static_assert((RingFrames & (RingFrames - 1)) == 0, "RingFrames must be a power of two");
+	static_assert(std::atomic<double>::is_always_lock_free && std::atomic<uint64>::is_always_lock_free, "Shared memory atomics must be lock free");
+}
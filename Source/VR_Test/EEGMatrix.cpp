@@ -0,0 +1,267 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EEGMatrix.h"
+
+namespace
+{
+	constexpr int32 SimdWidth = 4;
+	constexpr int32 JacobiMaxSweeps = 12;
+	constexpr int32 RiemannMeanMaxIterations = 20;
+
+	/** Row = Row - Scale * Other, over a whole padded row */
+	FORCEINLINE void SubtractScaledRow(float* Row, const float* Other, float Scale)
+	{
+		const VectorRegister4Float scale = VectorSetFloat1(Scale);
+		for (int32 col = 0; col < EEGRowStride; col += SimdWidth)
+			VectorStoreAligned(VectorNegateMultiplyAdd(scale, VectorLoadAligned(Other + col), VectorLoadAligned(Row + col)), Row + col);
+	}
+
+	/** Out = L^-1 * A, row by row: Out[i] = (A[i] - sum(L[i][k] * Out[k], k < i)) / L[i][i] */
+	void ForwardSubstituteRows(const FEEGMatrix& L, const FEEGMatrix& A, FEEGMatrix& Out, int32 N)
+	{
+		for (int32 i = 0; i < N; ++i)
+		{
+			FMemory::Memcpy(Out[i], A[i], sizeof(float) * EEGRowStride);
+			for (int32 k = 0; k < i; ++k)
+				SubtractScaledRow(Out[i], Out[k], L[i][k]);
+
+			const VectorRegister4Float inverseDiagonal = VectorSetFloat1(1.f / L[i][i]);
+			for (int32 col = 0; col < EEGRowStride; col += SimdWidth)
+				VectorStoreAligned(VectorMultiply(VectorLoadAligned(Out[i] + col), inverseDiagonal), Out[i] + col);
+		}
+	}
+
+	float SafeLog(float Value) { return FMath::Loge(FMath::Max(Value, 1e-12f)); }
+	float SafeSqrt(float Value) { return FMath::Sqrt(FMath::Max(Value, 0.f)); }
+	float SafeInvSqrt(float Value) { return FMath::InvSqrt(FMath::Max(Value, 1e-12f)); }
+	float Exp(float Value) { return FMath::Exp(Value); }
+}
+
+void FEEGMatrix::SetIdentity(int32 N)
+{
+	SetZero();
+	for (int32 i = 0; i < N; ++i)
+		m[i][i] = 1.f;
+}
+
+void EEGMatrix::RankOneUpdate(FEEGMatrix& C, const float* X, float Lambda, int32 N)
+{
+	const VectorRegister4Float lambda = VectorSetFloat1(Lambda);
+	const VectorRegister4Float x[EEGRowStride / SimdWidth] = {
+		VectorLoadAligned(X), VectorLoadAligned(X + 4), VectorLoadAligned(X + 8), VectorLoadAligned(X + 12)
+	};
+
+	for (int32 row = 0; row < N; ++row)
+	{
+		const VectorRegister4Float scale = VectorSetFloat1((1.f - Lambda) * X[row]);
+		for (int32 chunk = 0; chunk < EEGRowStride / SimdWidth; ++chunk)
+		{
+			float* dest = C[row] + chunk * SimdWidth;
+			VectorStoreAligned(VectorMultiplyAdd(scale, x[chunk], VectorMultiply(lambda, VectorLoadAligned(dest))), dest);
+		}
+	}
+}
+
+void EEGMatrix::Multiply(const FEEGMatrix& A, const FEEGMatrix& B, FEEGMatrix& Out, int32 N)
+{
+	// Out[i] = sum(A[i][k] * B[k]), whole rows at once
+	for (int32 i = 0; i < N; ++i)
+	{
+		VectorRegister4Float acc[EEGRowStride / SimdWidth] = { VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat() };
+		for (int32 k = 0; k < N; ++k)
+		{
+			const VectorRegister4Float a = VectorSetFloat1(A[i][k]);
+			for (int32 chunk = 0; chunk < EEGRowStride / SimdWidth; ++chunk)
+				acc[chunk] = VectorMultiplyAdd(a, VectorLoadAligned(B[k] + chunk * SimdWidth), acc[chunk]);
+		}
+		for (int32 chunk = 0; chunk < EEGRowStride / SimdWidth; ++chunk)
+			VectorStoreAligned(acc[chunk], Out[i] + chunk * SimdWidth);
+	}
+}
+
+void EEGMatrix::Transpose(const FEEGMatrix& A, FEEGMatrix& Out, int32 N)
+{
+	for (int32 i = 0; i < N; ++i)
+		for (int32 j = 0; j < N; ++j)
+			Out[j][i] = A[i][j];
+}
+
+void EEGMatrix::Regularize(FEEGMatrix& A, float Epsilon, int32 N)
+{
+	float trace = 0.f;
+	for (int32 i = 0; i < N; ++i)
+		trace += A[i][i];
+
+	const float shrinkage = FMath::Max(Epsilon * trace / N, SMALL_NUMBER);
+	for (int32 i = 0; i < N; ++i)
+		A[i][i] += shrinkage;
+}
+
+bool EEGMatrix::Cholesky(const FEEGMatrix& A, FEEGMatrix& L, int32 N)
+{
+	L.SetZero();
+	for (int32 j = 0; j < N; ++j)
+	{
+		float diagonal = A[j][j];
+		for (int32 k = 0; k < j; ++k)
+			diagonal -= L[j][k] * L[j][k];
+		if (diagonal <= 0.f)
+			return false;
+
+		L[j][j] = FMath::Sqrt(diagonal);
+		const float inverseDiagonal = 1.f / L[j][j];
+		for (int32 i = j + 1; i < N; ++i)
+		{
+			float sum = A[i][j];
+			for (int32 k = 0; k < j; ++k)
+				sum -= L[i][k] * L[j][k];
+			L[i][j] = sum * inverseDiagonal;
+		}
+	}
+	return true;
+}
+
+void EEGMatrix::Whiten(const FEEGMatrix& L, const FEEGMatrix& C, FEEGMatrix& Temp, FEEGMatrix& Out, int32 N)
+{
+	// Y = L^-1 C, then L^-1 Y^T = L^-1 C L^-T as C is symmetric
+	ForwardSubstituteRows(L, C, Out, N);
+	Transpose(Out, Temp, N);
+	ForwardSubstituteRows(L, Temp, Out, N);
+}
+
+void EEGMatrix::SymmetricEigen(FEEGMatrix& A, float* OutValues, FEEGMatrix* OutVectors, int32 N)
+{
+	if (OutVectors)
+		OutVectors->SetIdentity(N);
+
+	for (int32 sweep = 0; sweep < JacobiMaxSweeps; ++sweep)
+	{
+		float offDiagonal = 0.f;
+		float diagonal = 0.f;
+		for (int32 p = 0; p < N; ++p)
+		{
+			diagonal += A[p][p] * A[p][p];
+			for (int32 q = p + 1; q < N; ++q)
+				offDiagonal += A[p][q] * A[p][q];
+		}
+		if (offDiagonal <= 1e-12f * diagonal)
+			break;
+
+		for (int32 p = 0; p < N - 1; ++p)
+			for (int32 q = p + 1; q < N; ++q)
+			{
+				const float apq = A[p][q];
+				if (FMath::Abs(apq) <= 1e-20f)
+					continue;
+
+				// Rotation cancelling A[p][q], see Numerical Recipes' jacobi
+				const float theta = (A[q][q] - A[p][p]) / (2.f * apq);
+				const float t = (theta >= 0.f ? 1.f : -1.f) / (FMath::Abs(theta) + FMath::Sqrt(theta * theta + 1.f));
+				const float c = FMath::InvSqrt(t * t + 1.f);
+				const float s = t * c;
+
+				for (int32 k = 0; k < N; ++k)
+				{
+					const float akp = A[k][p];
+					const float akq = A[k][q];
+					A[k][p] = c * akp - s * akq;
+					A[k][q] = s * akp + c * akq;
+				}
+				for (int32 k = 0; k < N; ++k)
+				{
+					const float apk = A[p][k];
+					const float aqk = A[q][k];
+					A[p][k] = c * apk - s * aqk;
+					A[q][k] = s * apk + c * aqk;
+				}
+				if (OutVectors)
+				{
+					FEEGMatrix& v = *OutVectors;
+					for (int32 k = 0; k < N; ++k)
+					{
+						const float vkp = v[k][p];
+						const float vkq = v[k][q];
+						v[k][p] = c * vkp - s * vkq;
+						v[k][q] = s * vkp + c * vkq;
+					}
+				}
+			}
+	}
+
+	for (int32 i = 0; i < N; ++i)
+		OutValues[i] = A[i][i];
+}
+
+void EEGMatrix::ApplySpdFunction(const FEEGMatrix& A, FEEGMatrix& Out, int32 N, float (*Function)(float))
+{
+	FEEGMatrix work = A;
+	FEEGMatrix vectors;
+	float values[EEGMaxChannels];
+	SymmetricEigen(work, values, &vectors, N);
+
+	// Out = V * diag(f) * V^T, V * diag(f) is built in work
+	work.SetZero();
+	for (int32 i = 0; i < N; ++i)
+		for (int32 j = 0; j < N; ++j)
+			work[i][j] = vectors[i][j] * Function(values[j]);
+
+	FEEGMatrix transposed;
+	Transpose(vectors, transposed, N);
+	Multiply(work, transposed, Out, N);
+}
+
+float EEGMatrix::SquaredRiemannDistance(const FEEGMatrix& C, const FEEGMatrix& RefL, FEEGMatrix Scratch[2], int32 N)
+{
+	Whiten(RefL, C, Scratch[0], Scratch[1], N);
+
+	float values[EEGMaxChannels];
+	SymmetricEigen(Scratch[1], values, nullptr, N);
+
+	float distance = 0.f;
+	for (int32 i = 0; i < N; ++i)
+		distance += FMath::Square(SafeLog(values[i]));
+	return distance;
+}
+
+void EEGMatrix::RiemannMean(TArrayView<const FEEGMatrix> Matrices, FEEGMatrix& Out, int32 N)
+{
+	// Start from the arithmetic mean
+	Out.SetZero();
+	for (const FEEGMatrix& matrix : Matrices)
+		for (int32 i = 0; i < N; ++i)
+			for (int32 j = 0; j < N; ++j)
+				Out[i][j] += matrix[i][j] / Matrices.Num();
+
+	FEEGMatrix sqrtMean, invSqrtMean, tangentMean, temp, whitened, logarithm;
+	for (int32 iteration = 0; iteration < RiemannMeanMaxIterations; ++iteration)
+	{
+		ApplySpdFunction(Out, sqrtMean, N, &SafeSqrt);
+		ApplySpdFunction(Out, invSqrtMean, N, &SafeInvSqrt);
+
+		// Mean of the matrices projected on the tangent space at the current mean
+		tangentMean.SetZero();
+		for (const FEEGMatrix& matrix : Matrices)
+		{
+			Multiply(invSqrtMean, matrix, temp, N);
+			Multiply(temp, invSqrtMean, whitened, N);
+			ApplySpdFunction(whitened, logarithm, N, &SafeLog);
+			for (int32 i = 0; i < N; ++i)
+				for (int32 j = 0; j < N; ++j)
+					tangentMean[i][j] += logarithm[i][j] / Matrices.Num();
+		}
+
+		float norm = 0.f;
+		for (int32 i = 0; i < N; ++i)
+			for (int32 j = 0; j < N; ++j)
+				norm += FMath::Square(tangentMean[i][j]);
+
+		// Back to the manifold
+		ApplySpdFunction(tangentMean, logarithm, N, &Exp);
+		Multiply(sqrtMean, logarithm, temp, N);
+		Multiply(temp, sqrtMean, Out, N);
+
+		if (norm < 1e-10f)
+			break;
+	}
+}
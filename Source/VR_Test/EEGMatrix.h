@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Max number of EEG channels handled by the spatial stages, the Emotiv Epoc+ has 14 */
+constexpr int32 EEGMaxChannels = 14;
+/** Rows are padded so that they can be processed with 4-wide vector registers */
+constexpr int32 EEGRowStride = 16;
+
+/**
+ * Small fixed-size square matrix used for channel covariances. Only the top-left N x N block is meaningful, padding stays zero.
+ * Every kernel works in place or on caller provided matrices, nothing allocates.
+ */
+struct alignas(16) FEEGMatrix
+{
+	float m[EEGMaxChannels][EEGRowStride];
+
+	FEEGMatrix() { SetZero(); }
+
+	void SetZero() { FMemory::Memzero(m, sizeof(m)); }
+	void SetIdentity(int32 N);
+	float* operator[](int32 Row) { return m[Row]; }
+	const float* operator[](int32 Row) const { return m[Row]; }
+};
+
+namespace EEGMatrix
+{
+	/**
+	 * C = Lambda * C + (1 - Lambda) * X * X^T, vectorised over rows.
+	 * @param C			Covariance to update
+	 * @param X			Sample, EEGRowStride floats, 16 bytes aligned, padding set to zero
+	 * @param Lambda	Forgetting factor
+	 * @param N			Number of channels
+	 */
+	VR_TEST_API void RankOneUpdate(FEEGMatrix& C, const float* X, float Lambda, int32 N);
+	/** Out = A * B */
+	VR_TEST_API void Multiply(const FEEGMatrix& A, const FEEGMatrix& B, FEEGMatrix& Out, int32 N);
+	VR_TEST_API void Transpose(const FEEGMatrix& A, FEEGMatrix& Out, int32 N);
+	/** A += Epsilon * trace(A) / N * I, keeps nearly singular covariances positive definite */
+	VR_TEST_API void Regularize(FEEGMatrix& A, float Epsilon, int32 N);
+	/**
+	 * Cholesky factorisation A = L * L^T.
+	 * @return	False if A is not positive definite
+	 */
+	VR_TEST_API bool Cholesky(const FEEGMatrix& A, FEEGMatrix& L, int32 N);
+	/** Out = L^-1 * C * L^-T, by two row-wise forward substitutions. Temp is scratch space */
+	VR_TEST_API void Whiten(const FEEGMatrix& L, const FEEGMatrix& C, FEEGMatrix& Temp, FEEGMatrix& Out, int32 N);
+	/**
+	 * Eigen decomposition of a symmetric matrix with the cyclic Jacobi method.
+	 * @param A				Symmetric matrix, destroyed
+	 * @param OutValues		N eigenvalues
+	 * @param OutVectors	Eigenvectors as columns, optional
+	 */
+	VR_TEST_API void SymmetricEigen(FEEGMatrix& A, float* OutValues, FEEGMatrix* OutVectors, int32 N);
+	/** Out = V * diag(F(eigenvalues)) * V^T, for symmetric positive definite A */
+	VR_TEST_API void ApplySpdFunction(const FEEGMatrix& A, FEEGMatrix& Out, int32 N, float (*Function)(float));
+	/**
+	 * Squared affine invariant Riemannian distance between C and a reference whose Cholesky factor is given: sum of log^2 of the eigenvalues of L^-1 C L^-T.
+	 * @param C			Covariance
+	 * @param RefL		Cholesky factor of the reference
+	 * @param Scratch	Two scratch matrices
+	 */
+	VR_TEST_API float SquaredRiemannDistance(const FEEGMatrix& C, const FEEGMatrix& RefL, FEEGMatrix Scratch[2], int32 N);
+	/**
+	 * Riemannian (Karcher) mean of SPD matrices, by fixed point iteration. Allocation free but slow, for calibration only.
+	 * @param Matrices	Matrices to average
+	 * @param Out		Mean
+	 */
+	VR_TEST_API void RiemannMean(TArrayView<const FEEGMatrix> Matrices, FEEGMatrix& Out, int32 N);
+}
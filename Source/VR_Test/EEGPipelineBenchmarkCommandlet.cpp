@@ -0,0 +1,163 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EEGPipelineBenchmarkCommandlet.h"
+
+#include "Async/TaskGraphInterfaces.h"
+#include "EEGStagePipeline.h"
+#include "RiemannClassifier.h"
+#include "VR_Test.h"
+
+namespace
+{
+	/**
+	 * Sums of theta, alpha and beta oscillations with a per channel phase, plus noise. The relaxed state has more alpha, the unrelaxed one more beta.
+	 * @param Out		NumFrames * NumChannels samples
+	 */
+	void Synthesize(TArray<float>& Out, int32 NumChannels, int32 NumFrames, float SampleRate, bool bRelaxed, FRandomStream& Random)
+	{
+		const float alpha = bRelaxed ? 20.f : 5.f;
+		const float beta = bRelaxed ? 4.f : 12.f;
+		Out.SetNumUninitialized(NumChannels * NumFrames);
+		for (int32 frame = 0; frame < NumFrames; ++frame)
+		{
+			const float time = frame / SampleRate;
+			for (int32 channel = 0; channel < NumChannels; ++channel)
+			{
+				const float phase = channel * .7f;
+				Out[frame * NumChannels + channel] = 8.f * FMath::Sin(2.f * PI * 6.f * time + phase)
+					+ alpha * FMath::Sin(2.f * PI * 10.f * time + phase * (1.f + channel % 3))
+					+ beta * FMath::Sin(2.f * PI * 20.f * time - phase)
+					+ Random.FRandRange(-5.f, 5.f);
+			}
+		}
+	}
+}
+
+UEEGPipelineBenchmarkCommandlet::UEEGPipelineBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UEEGPipelineBenchmarkCommandlet::Main(const FString& Params)
+{
+	FRiemannClassifierSettings settings;
+	settings.bEnabled = true;
+	float seconds = 600.f;
+	int32 pullFrames = 64;
+	FParse::Value(*Params, TEXT("Channels="), settings.numChannels);
+	FParse::Value(*Params, TEXT("SampleRate="), settings.sampleRate);
+	FParse::Value(*Params, TEXT("HopSize="), settings.hopSize);
+	FParse::Value(*Params, TEXT("Seconds="), seconds);
+	FParse::Value(*Params, TEXT("PullFrames="), pullFrames);
+	settings.numChannels = FMath::Clamp(settings.numChannels, 1, EEGMaxChannels);
+	settings.sampleRate = FMath::Max(settings.sampleRate, 1.f);
+	settings.hopSize = FMath::Max(settings.hopSize, 1);
+	pullFrames = FMath::Max(pullFrames, 1);
+	const int32 numChannels = settings.numChannels;
+
+	// Thirty seconds of each state to calibrate, then the benchmarked session alternating between them every minute
+	FRandomStream random(42);
+	FRiemannClassifier calibrated;
+	calibrated.Setup(settings);
+	TArray<float> frames;
+	// Whole hops, so that both runs start on a hop boundary
+	const int32 calibrationFrames = FMath::DivideAndRoundUp(FMath::CeilToInt(30.f * settings.sampleRate), settings.hopSize) * settings.hopSize;
+	for (const bool bRelaxed : { false, true })
+	{
+		Synthesize(frames, numChannels, calibrationFrames, settings.sampleRate, bRelaxed, random);
+		calibrated.BeginCalibration(bRelaxed);
+		for (int32 frame = 0; frame < calibrationFrames; ++frame)
+			calibrated.AddSample(frames.GetData() + frame * numChannels);
+		calibrated.EndCalibration();
+	}
+	if (!calibrated.IsCalibrated())
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Could not calibrate the classifier on the synthetic EEG"));
+		return 1;
+	}
+
+	const int32 numFrames = FMath::CeilToInt(seconds * settings.sampleRate);
+	const int32 minuteFrames = FMath::CeilToInt(60.f * settings.sampleRate);
+	TArray<float> session;
+	session.Reserve(numFrames * numChannels);
+	for (int32 start = 0; start < numFrames; start += minuteFrames)
+	{
+		Synthesize(frames, numChannels, FMath::Min(minuteFrames, numFrames - start), settings.sampleRate, (start / minuteFrames) % 2 == 1, random);
+		session.Append(frames);
+	}
+
+	// Serial: what the game thread does without the pipeline, every stage timed
+	TArray<float> serialPosteriors;
+	serialPosteriors.Reserve(numFrames / settings.hopSize + 1);
+	uint64 filterCycles = 0;
+	uint64 classifyCycles = 0;
+	{
+		FRiemannClassifier classifier = calibrated;
+		for (int32 frame = 0; frame < numFrames; ++frame)
+		{
+			const uint64 filterStart = FPlatformTime::Cycles64();
+			const bool bHop = classifier.AddSample(session.GetData() + frame * numChannels);
+			const uint64 classifyStart = FPlatformTime::Cycles64();
+			filterCycles += classifyStart - filterStart;
+			if (bHop)
+			{
+				serialPosteriors.Add(classifier.Classify());
+				classifyCycles += FPlatformTime::Cycles64() - classifyStart;
+			}
+		}
+	}
+	const double serialTime = FPlatformTime::ToSeconds64(filterCycles + classifyCycles);
+
+	// Pipelined: frames handed over in pulls, posteriors popped as they come like the pawn does every tick
+	TArray<float> pipelinedPosteriors;
+	pipelinedPosteriors.Reserve(serialPosteriors.Num());
+	double pipelinedTime;
+	FEEGStagePipeline::FStats stats;
+	{
+		FRiemannClassifier classifier = calibrated;
+		// Too large for the stack
+		TUniquePtr<FEEGStagePipeline> pipeline = MakeUnique<FEEGStagePipeline>();
+		pipeline->Setup(classifier, settings.hopSize);
+
+		const double start = FPlatformTime::Seconds();
+		float posterior;
+		for (int32 frame = 0; frame < numFrames; frame += pullFrames)
+		{
+			pipeline->AddSamples(session.GetData() + frame * numChannels, FMath::Min(pullFrames, numFrames - frame), numChannels);
+			while (pipeline->PopPosterior(posterior))
+				pipelinedPosteriors.Add(posterior);
+		}
+		pipeline->Flush();
+		while (pipeline->PopPosterior(posterior))
+			pipelinedPosteriors.Add(posterior);
+		pipelinedTime = FPlatformTime::Seconds() - start;
+		stats = pipeline->GetStats();
+	}
+
+	float maxDifference = 0.f;
+	for (int32 hop = 0; hop < FMath::Min(serialPosteriors.Num(), pipelinedPosteriors.Num()); ++hop)
+		maxDifference = FMath::Max(maxDifference, FMath::Abs(serialPosteriors[hop] - pipelinedPosteriors[hop]));
+
+	const double stageTime = FPlatformTime::ToSeconds64(stats.filterCycles + stats.classifyCycles);
+	UE_LOG(LogMeditation, Display, TEXT("%d channels at %g Hz, hops of %d frames, %.0f s of EEG, %d task graph workers"),
+		numChannels, settings.sampleRate, settings.hopSize, seconds, FTaskGraphInterface::Get().GetNumWorkerThreads());
+	UE_LOG(LogMeditation, Display, TEXT("Serial:    %.1f ms (filter %.1f ms, classify %.1f ms), %.0f hops/s"),
+		serialTime * 1e3, FPlatformTime::ToMilliseconds64(filterCycles), FPlatformTime::ToMilliseconds64(classifyCycles), serialPosteriors.Num() / FMath::Max(serialTime, 1e-9));
+	UE_LOG(LogMeditation, Display, TEXT("Pipelined: %.1f ms (filter %.1f ms, classify %.1f ms over the workers), %.0f hops/s, %lld stalls"),
+		pipelinedTime * 1e3, FPlatformTime::ToMilliseconds64(stats.filterCycles), FPlatformTime::ToMilliseconds64(stats.classifyCycles),
+		pipelinedPosteriors.Num() / FMath::Max(pipelinedTime, 1e-9), stats.stalls);
+	UE_LOG(LogMeditation, Display, TEXT("Speedup x%.2f, %.2f stages running at once on average"),
+		serialTime / FMath::Max(pipelinedTime, 1e-9), stageTime / FMath::Max(pipelinedTime, 1e-9));
+
+	if (serialPosteriors.Num() != pipelinedPosteriors.Num() || maxDifference > 1e-5f)
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Pipelined posteriors differ: %d against %d serial, max difference %g"), pipelinedPosteriors.Num(), serialPosteriors.Num(), maxDifference);
+		return 1;
+	}
+	UE_LOG(LogMeditation, Display, TEXT("Posteriors match (%d hops)"), serialPosteriors.Num());
+	return 0;
+}
@@ -0,0 +1,23 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "EEGPipelineBenchmarkCommandlet.generated.h"
+
+/**
+ * Compares the classifier run serially on one thread with the same classifier run by FEEGStagePipeline, on synthetic EEG, e.g.:
+ * UnrealEditor-Cmd VR_Test.uproject -run=EEGPipelineBenchmark -nullrhi [-Channels=14] [-SampleRate=128] [-HopSize=16] [-Seconds=600] [-PullFrames=64]
+ * Reports the serial cost of each stage, the pipelined wall time, the speedup, how many stages ran at once on average, and checks that both give the same posteriors.
+ */
+UCLASS()
+class UEEGPipelineBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UEEGPipelineBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EEGPlotWidget.h"
+
+#include "Rendering/DrawElements.h"
+
+void UEEGPlotWidget::SetColumns(TArrayView<const FVector2f> Columns)
+{
+	m_columns = Columns;
+}
+
+int32 UEEGPlotWidget::NativePaint(const FPaintArgs& Args, const FGeometry& AllottedGeometry, const FSlateRect& MyCullingRect,
+	FSlateWindowElementList& OutDrawElements, int32 LayerId, const FWidgetStyle& InWidgetStyle, bool bParentEnabled) const
+{
+	LayerId = Super::NativePaint(Args, AllottedGeometry, MyCullingRect, OutDrawElements, LayerId, InWidgetStyle, bParentEnabled);
+
+	if (m_columns.Num() == 0)
+		return LayerId;
+
+	const FVector2D size = AllottedGeometry.GetLocalSize();
+	const float columnWidth = size.X / m_columns.Num();
+
+	// A single zigzag polyline going down and up each column fills the envelope, the whole plot is one draw element
+	TArray<FVector2D> points;
+	points.Reserve(m_columns.Num() * 2);
+	for (int32 column = 0; column < m_columns.Num(); ++column)
+	{
+		const FVector2f& bounds = m_columns[column];
+		if (bounds.Y < bounds.X)
+			continue;
+
+		const float x = (column + .5f) * columnWidth;
+		const bool bDown = column & 1;
+		points.Emplace(x, (1.f - (bDown ? bounds.Y : bounds.X)) * size.Y);
+		points.Emplace(x, (1.f - (bDown ? bounds.X : bounds.Y)) * size.Y);
+	}
+
+	if (points.Num() >= 2)
+		FSlateDrawElement::MakeLines(OutDrawElements, ++LayerId, AllottedGeometry.ToPaintGeometry(), points,
+			ESlateDrawEffect::None, lineColor * InWidgetStyle.GetColorAndOpacityTint(), true, lineThickness);
+
+	return LayerId;
+}
@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Blueprint/UserWidget.h"
+#include "EEGPlotWidget.generated.h"
+
+/**
+ * Draws a min/max envelope with one column per pixel. Columns are computed by UEEGPlotWidgetComponent, the widget only paints them.
+ */
+UCLASS()
+class VR_TEST_API UEEGPlotWidget : public UUserWidget
+{
+	GENERATED_BODY()
+
+	/** Top and bottom of each column, in [0, 1] from the bottom of the widget. Top < bottom for empty columns */
+	TArray<FVector2f> m_columns;
+
+public:
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Plot")
+	FLinearColor lineColor = FLinearColor(.3f, .8f, 1.f);
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin="0.5"), Category = "Plot")
+	float lineThickness = 1.f;
+
+	/**
+	 * Replaces the painted columns.
+	 * @param Columns	Bottom (X) and top (Y) of each column, normalised
+	 */
+	void SetColumns(TArrayView<const FVector2f> Columns);
+
+protected:
+	virtual int32 NativePaint(const FPaintArgs& Args, const FGeometry& AllottedGeometry, const FSlateRect& MyCullingRect,
+		FSlateWindowElementList& OutDrawElements, int32 LayerId, const FWidgetStyle& InWidgetStyle, bool bParentEnabled) const override;
+};
@@ -0,0 +1,69 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EEGPlotWidgetComponent.h"
+
+#include "EEGPlotWidget.h"
+
+UEEGPlotWidgetComponent::UEEGPlotWidgetComponent()
+{
+	// Redraws are requested only when the plotted pixels change
+	bManuallyRedraw = true;
+	SetWidgetClass(UEEGPlotWidget::StaticClass());
+}
+
+void UEEGPlotWidgetComponent::SetStore(TSharedPtr<const FEEGTimeSeriesStore> Store)
+{
+	m_store = MoveTemp(Store);
+	m_drawnPixels.Reset();
+}
+
+void UEEGPlotWidgetComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	const int32 columns = FMath::Max(1, FMath::RoundToInt(GetDrawSize().X));
+	m_summaries.SetNum(columns);
+	m_columns.SetNum(columns);
+	m_pixels.SetNum(columns);
+}
+
+void UEEGPlotWidgetComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	UEEGPlotWidget* widget = Cast<UEEGPlotWidget>(GetUserWidgetObject());
+	if (!m_store || !widget || channel >= m_store->GetNumChannels() || m_summaries.Num() == 0)
+		return;
+
+	// Snap the range to whole columns so that columns keep the same samples while scrolling, otherwise every new sample would shift every pixel
+	const int32 columns = m_summaries.Num();
+	const double columnDuration = timeWindow / columns;
+	const double endTime = FMath::CeilToDouble(m_store->GetDuration() / columnDuration) * columnDuration;
+	m_store->Query(channel, endTime - timeWindow, endTime, m_summaries.GetData(), columns);
+
+	const float height = GetDrawSize().Y;
+	const float range = FMath::Max(valueMax - valueMin, KINDA_SMALL_NUMBER);
+	for (int32 column = 0; column < columns; ++column)
+	{
+		const FEEGSampleSummary& summary = m_summaries[column];
+		if (summary.IsEmpty())
+		{
+			m_columns[column] = FVector2f(1.f, 0.f);
+			m_pixels[column] = FIntPoint(1, 0);
+			continue;
+		}
+
+		const float bottom = FMath::Clamp((summary.min - valueMin) / range, 0.f, 1.f);
+		const float top = FMath::Clamp((summary.max - valueMin) / range, 0.f, 1.f);
+		m_columns[column] = FVector2f(bottom, top);
+		m_pixels[column] = FIntPoint(FMath::FloorToInt(bottom * height), FMath::FloorToInt(top * height));
+	}
+
+	if (m_pixels != m_drawnPixels)
+	{
+		m_drawnPixels = m_pixels;
+		widget->SetColumns(m_columns);
+		RequestRedraw();
+	}
+}
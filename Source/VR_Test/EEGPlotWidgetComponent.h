@@ -0,0 +1,51 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AntiAliasedTextWidgetComponent.h"
+#include "EEGTimeSeriesStore.h"
+#include "EEGPlotWidgetComponent.generated.h"
+
+/**
+ * Widget component plotting the last seconds of one channel of a FEEGTimeSeriesStore.
+ * The widget is manually redrawn: each tick the visible range is summarised at pixel resolution, and the render target is only invalidated
+ * when a column changes on screen.
+ */
+UCLASS(ClassGroup = UserInterface, meta = (BlueprintSpawnableComponent))
+class VR_TEST_API UEEGPlotWidgetComponent : public UAntiAliasedTextWidgetComponent
+{
+	GENERATED_BODY()
+
+	TSharedPtr<const FEEGTimeSeriesStore> m_store;
+	/** Preallocated buffers, sized to the number of columns */
+	TArray<FEEGSampleSummary> m_summaries;
+	TArray<FVector2f> m_columns;
+	/** Columns currently drawn, in pixel rows, to detect visible changes */
+	TArray<FIntPoint> m_drawnPixels;
+	TArray<FIntPoint> m_pixels;
+
+public:
+	UEEGPlotWidgetComponent();
+
+	/** Store channel to plot */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin="0"), Category = "Plot")
+	int32 channel = 0;
+	/** Duration (s) of the plotted time range, ending at the most recent sample */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin="0.1"), Category = "Plot")
+	float timeWindow = 60.f;
+	/** Values mapped to the bottom and top of the plot */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Plot")
+	float valueMin = 0.f;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Plot")
+	float valueMax = 100.f;
+
+	/**
+	 * Sets the store to plot. The store is only read from the game thread, during TickComponent.
+	 * @param Store		Store to plot, or nullptr to stop plotting
+	 */
+	void SetStore(TSharedPtr<const FEEGTimeSeriesStore> Store);
+
+	virtual void BeginPlay() override;
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+};
@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EEGQualityGovernor.h"
+
+#include "HAL/FileManager.h"
+#include "MeditationAllocGuard.h"
+#include "Misc/Paths.h"
+#include "RenderCore.h"
+#include "RHI.h"
+#include "VR_Test.h"
+
+namespace
+{
+	/** Smoothing of the measured costs, per frame */
+	constexpr float CostSmoothing = .2f;
+	constexpr TCHAR GStageNames[FEEGQualityGovernor::NumStages][9] = { TEXT("Filter"), TEXT("Classify") };
+}
+
+FEEGQualityGovernor::FEEGQualityGovernor()
+{
+	m_levels.Add({ 1, 1, false });
+}
+
+FEEGQualityGovernor::~FEEGQualityGovernor() = default;
+
+void FEEGQualityGovernor::Setup(const FEEGQualitySettings& Settings, int32 HopSize, int32 NumChannels, const FString& Participant)
+{
+	m_settings = Settings;
+	m_levels.Reset();
+	m_level = 0;
+	m_timeSinceDowngrade = Settings.downgradeCooldown;
+	m_comfortableTime = 0.f;
+
+	// Cheapest quality losses first: one hop of latency, then fewer classifications, then less spatial information
+	FLevel level = { FMath::Max(HopSize, 1), NumChannels, false };
+	m_levels.Add(level);
+	if (Settings.bAllowWorker)
+	{
+		level.bWorker = true;
+		m_levels.Add(level);
+	}
+	while (level.hopSize * 2 <= Settings.maxHopSize)
+	{
+		level.hopSize *= 2;
+		m_levels.Add(level);
+	}
+	const int32 minChannels = FMath::Clamp(Settings.minChannels, 1, NumChannels);
+	while (level.numChannels > minChannels)
+	{
+		level.numChannels = FMath::Max(level.numChannels - 2, minChannels);
+		m_levels.Add(level);
+	}
+
+	m_log.Reset();
+	if (Settings.bEnabled && Settings.bLogDecisions)
+	{
+		const FString path = FPaths::ProjectSavedDir() / TEXT("Meditation") / FString::Printf(TEXT("Governor-%s-%s.csv"), *FPaths::MakeValidFileName(Participant), *FDateTime::Now().ToString());
+		m_log.Reset(IFileManager::Get().CreateFileWriter(*path));
+		if (m_log)
+		{
+			const ANSICHAR header[] = "Time,FrameMs,FilterMs,ClassifyMs,FromLevel,ToLevel,HopSize,Channels,Worker,Reason\n";
+			m_log->Serialize(const_cast<ANSICHAR*>(header), sizeof(header) - 1);
+		}
+	}
+}
+
+bool FEEGQualityGovernor::Update(float DeltaTime)
+{
+	m_time += DeltaTime;
+	if (!m_settings.bEnabled)
+		return false;
+
+	// The slowest of the game, render and GPU frames limits the frame rate
+	const uint32 frameCycles = FMath::Max3(GGameThreadTime, GRenderThreadTime, RHIGetGPUFrameCycles());
+	const float frameCost = FPlatformTime::ToMilliseconds(frameCycles);
+	m_frameCost = FMath::Lerp(m_frameCost, frameCost, CostSmoothing);
+	for (int32 stage = 0; stage < NumStages; ++stage)
+	{
+		const uint64 cycles = m_stageCycles[stage].exchange(0, std::memory_order_relaxed);
+		m_stageCosts[stage] = FMath::Lerp(m_stageCosts[stage], static_cast<float>(FPlatformTime::ToMilliseconds64(cycles)), CostSmoothing);
+	}
+
+	const float headroom = 1.f - m_frameCost / m_settings.frameBudget;
+	m_timeSinceDowngrade += DeltaTime;
+	m_comfortableTime = headroom > m_settings.upgradeHeadroom ? m_comfortableTime + DeltaTime : 0.f;
+
+	// Lowering the quality only saves what the stages cost, hold the level when the missing time is spent elsewhere
+	const float missingTime = m_settings.frameBudget * (m_settings.minHeadroom - headroom);
+	const bool bStagesCostly = m_stageCosts[Filter] + m_stageCosts[Classify] > m_settings.minStageShare * missingTime;
+	if (headroom < m_settings.minHeadroom && bStagesCostly && m_level + 1 < m_levels.Num() && m_timeSinceDowngrade >= m_settings.downgradeCooldown)
+	{
+		ChangeLevel(m_level + 1, TEXT("LowHeadroom"));
+		m_timeSinceDowngrade = 0.f;
+		return true;
+	}
+	if (m_comfortableTime >= m_settings.upgradeDelay && m_level > 0)
+	{
+		ChangeLevel(m_level - 1, TEXT("HighHeadroom"));
+		m_comfortableTime = 0.f;
+		return true;
+	}
+	return false;
+}
+
+void FEEGQualityGovernor::ChangeLevel(int32 Level, const TCHAR* Reason)
+{
+	// Rare, the log and the CSV line may allocate within the guarded tick
+	FMeditationAllocGuard::FAllow allow;
+	const FLevel& level = m_levels[Level];
+	UE_LOG(LogMeditation, Log, TEXT("EEG quality level %d -> %d (%s): hop %d, %d channels, %s thread. Frame %.2f ms, %s %.3f ms, %s %.3f ms"),
+		m_level, Level, Reason, level.hopSize, level.numChannels, level.bWorker ? TEXT("worker") : TEXT("game"),
+		m_frameCost, GStageNames[Filter], m_stageCosts[Filter], GStageNames[Classify], m_stageCosts[Classify]);
+
+	if (m_log)
+	{
+		const FString line = FString::Printf(TEXT("%.3f,%.3f,%.4f,%.4f,%d,%d,%d,%d,%d,%s\n"), m_time, m_frameCost, m_stageCosts[Filter], m_stageCosts[Classify],
+			m_level, Level, level.hopSize, level.numChannels, level.bWorker ? 1 : 0, Reason);
+		m_log->Serialize(TCHAR_TO_ANSI(*line), line.Len());
+	}
+
+	m_level = Level;
+}
@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+#include "EEGQualityGovernor.generated.h"
+
+/** Bounds within which the governor may trade EEG processing quality for frame time */
+USTRUCT(BlueprintType)
+struct FEEGQualitySettings
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, Category = "Governor")
+	bool bEnabled = true;
+	/** Frame budget (ms), 11.1 at 90 Hz */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1"), Category = "Governor")
+	float frameBudget = 11.1f;
+	/** Quality is lowered when less than this share of the budget is left */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0", ClampMax="1"), Category = "Governor")
+	float minHeadroom = .1f;
+	/** Quality is only lowered when the EEG stages cost more than this share of the missing headroom, else the frame time is spent elsewhere */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0", ClampMax="1"), Category = "Governor")
+	float minStageShare = .25f;
+	/** Quality is raised when more than this share of the budget has been left for upgradeDelay */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0", ClampMax="1"), Category = "Governor")
+	float upgradeHeadroom = .3f;
+	/** Time (s) the headroom must stay high before raising the quality */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0"), Category = "Governor")
+	float upgradeDelay = 2.f;
+	/** Min time (s) between two lowerings, so that the effect of one is measured before the next */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0"), Category = "Governor")
+	float downgradeCooldown = .25f;
+	/** Allow classifying on a worker thread, one hop late */
+	UPROPERTY(EditAnywhere, Category = "Governor")
+	bool bAllowWorker = true;
+	/** Largest classifier hop size, the hop size is doubled from the classifier's own up to it */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1"), Category = "Governor")
+	int32 maxHopSize = 64;
+	/** Fewest leading channels to classify with */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1", ClampMax="14"), Category = "Governor")
+	int32 minChannels = 8;
+	/** Write every decision to Saved/Meditation/Governor-<participant>-<date>.csv */
+	UPROPERTY(EditAnywhere, Category = "Governor")
+	bool bLogDecisions = true;
+};
+
+/**
+ * Keeps the EEG processing within the frame budget. Measures the cost of each processing stage and the frame headroom,
+ * and walks a quality ladder built from the declared bounds: full quality, then classification moved to a worker, then larger hops, then fewer channels.
+ * Lowers the quality as soon as the headroom is short, raises it back only once the headroom stayed large for a while.
+ */
+class VR_TEST_API FEEGQualityGovernor
+{
+public:
+	enum EStage { Filter, Classify, NumStages };
+
+	struct FLevel
+	{
+		int32 hopSize;
+		int32 numChannels;
+		bool bWorker;
+	};
+
+private:
+	FEEGQualitySettings m_settings;
+	TArray<FLevel> m_levels;
+	int32 m_level = 0;
+
+	/** Cycles spent in each stage since the last update */
+	std::atomic<uint64> m_stageCycles[NumStages] = {};
+	/** Smoothed frame and stage costs (ms) */
+	float m_frameCost = 0.f;
+	float m_stageCosts[NumStages] = {};
+	float m_timeSinceDowngrade = 0.f;
+	float m_comfortableTime = 0.f;
+	double m_time = 0.0;
+	TUniquePtr<FArchive> m_log;
+
+	void ChangeLevel(int32 Level, const TCHAR* Reason);
+
+public:
+	FEEGQualityGovernor();
+	~FEEGQualityGovernor();
+
+	/**
+	 * Builds the quality ladder and goes back to full quality.
+	 * @param Settings		Bounds
+	 * @param HopSize		Classifier hop size at full quality
+	 * @param NumChannels	Classifier channel count at full quality
+	 * @param Participant	Participant the decisions are logged for
+	 */
+	void Setup(const FEEGQualitySettings& Settings, int32 HopSize, int32 NumChannels, const FString& Participant);
+	/**
+	 * Accounts for the cost of a stage, from any thread.
+	 * @param Stage		Stage
+	 * @param Cycles	Cycles spent
+	 */
+	void AddStageCost(EStage Stage, uint64 Cycles) { m_stageCycles[Stage].fetch_add(Cycles, std::memory_order_relaxed); }
+	/**
+	 * Measures the last frame, and changes the quality level if needed. Once per frame, game thread.
+	 * @param DeltaTime	DeltaTime
+	 * @return			True if the level changed
+	 */
+	bool Update(float DeltaTime);
+
+	const FLevel& GetLevel() const { return m_levels[m_level]; }
+};
@@ -0,0 +1,138 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EEGSampleBlock.h"
+
+namespace
+{
+	constexpr uint64 GEmptyList = MAX_uint32;
+
+	uint32 GetIndex(uint64 Head) { return static_cast<uint32>(Head); }
+	uint64 MakeHead(uint32 Index, uint64 Tag) { return Tag << 32 | Index; }
+}
+
+int32 FEEGSampleBlock::GetFrameCapacity() const
+{
+	return m_pool->GetFrameCapacity();
+}
+
+void FEEGSampleBlock::SetFrames(int32 NumChannels, int32 NumFrames)
+{
+	check(NumChannels <= m_pool->GetMaxChannels() && NumFrames <= m_pool->GetFrameCapacity());
+	m_numChannels = NumChannels;
+	m_numFrames = NumFrames;
+}
+
+FEEGBlockRef::FEEGBlockRef(FEEGSampleBlock* Block)
+	: m_block(Block)
+{
+	if (m_block)
+		m_block->m_refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+FEEGBlockRef::FEEGBlockRef(const FEEGBlockRef& Other)
+	: FEEGBlockRef(Other.m_block)
+{
+}
+
+FEEGBlockRef& FEEGBlockRef::operator=(const FEEGBlockRef& Other)
+{
+	if (m_block != Other.m_block)
+	{
+		Reset();
+		m_block = Other.m_block;
+		if (m_block)
+			m_block->m_refCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	return *this;
+}
+
+FEEGBlockRef& FEEGBlockRef::operator=(FEEGBlockRef&& Other)
+{
+	if (this != &Other)
+	{
+		Reset();
+		m_block = Other.m_block;
+		Other.m_block = nullptr;
+	}
+	return *this;
+}
+
+void FEEGBlockRef::Reset()
+{
+	if (!m_block)
+		return;
+
+	// Release so that the writes of this holder are visible to the next one
+	if (m_block->m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		m_block->m_pool->Release(m_block);
+	m_block = nullptr;
+}
+
+FEEGBlockPool::~FEEGBlockPool()
+{
+	ensureMsgf(m_numFree.load() == m_numBlocks, TEXT("EEG block pool destroyed with %d blocks in use"), m_numBlocks - m_numFree.load());
+}
+
+void FEEGBlockPool::Setup(int32 NumBlocks, int32 FrameCapacity, int32 MaxChannels)
+{
+	check(m_numFree.load() == m_numBlocks);
+	m_numBlocks = NumBlocks;
+	m_frameCapacity = FrameCapacity;
+	m_maxChannels = MaxChannels;
+	m_samples.SetNumUninitialized(NumBlocks * FrameCapacity * MaxChannels);
+	m_timestamps.SetNumUninitialized(NumBlocks * FrameCapacity);
+	m_blocks = MakeUnique<FEEGSampleBlock[]>(NumBlocks);
+
+	for (int32 index = 0; index < NumBlocks; ++index)
+	{
+		FEEGSampleBlock& block = m_blocks[index];
+		block.m_samples = m_samples.GetData() + index * FrameCapacity * MaxChannels;
+		block.m_timestamps = m_timestamps.GetData() + index * FrameCapacity;
+		block.m_pool = this;
+		block.m_next.store(index + 1 < NumBlocks ? index + 1 : INDEX_NONE, std::memory_order_relaxed);
+	}
+	m_freeHead.store(NumBlocks > 0 ? MakeHead(0, 0) : GEmptyList);
+	m_numFree.store(NumBlocks);
+	m_exhausted.store(0);
+}
+
+FEEGBlockRef FEEGBlockPool::Acquire()
+{
+	uint64 head = m_freeHead.load(std::memory_order_acquire);
+	for (;;)
+	{
+		const uint32 index = GetIndex(head);
+		if (index == GetIndex(GEmptyList))
+		{
+			m_exhausted.fetch_add(1, std::memory_order_relaxed);
+			return FEEGBlockRef();
+		}
+
+		// The tag changes with every pop, so a block popped and pushed back in between fails the exchange even though its index is the same
+		const int32 next = m_blocks[index].m_next.load(std::memory_order_relaxed);
+		const uint64 newHead = MakeHead(next == INDEX_NONE ? GetIndex(GEmptyList) : next, (head >> 32) + 1);
+		if (m_freeHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+		{
+			m_numFree.fetch_sub(1, std::memory_order_relaxed);
+			FEEGSampleBlock* block = &m_blocks[index];
+			block->m_numChannels = 0;
+			block->m_numFrames = 0;
+			return FEEGBlockRef(block);
+		}
+	}
+}
+
+void FEEGBlockPool::Release(FEEGSampleBlock* Block)
+{
+	const int32 index = static_cast<int32>(Block - m_blocks.Get());
+	uint64 head = m_freeHead.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		const uint32 next = GetIndex(head);
+		Block->m_next.store(next == GetIndex(GEmptyList) ? INDEX_NONE : static_cast<int32>(next), std::memory_order_relaxed);
+		if (m_freeHead.compare_exchange_weak(head, MakeHead(index, head >> 32), std::memory_order_release, std::memory_order_relaxed))
+			break;
+	}
+	m_numFree.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,148 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+class FEEGBlockPool;
+
+/**
+ * Fixed capacity block of interleaved sample frames and their timestamps, owned by a FEEGBlockPool.
+ * Blocks are handed between stages and threads with FEEGBlockRef, only the holder of the single reference may write to it.
+ */
+class VR_TEST_API FEEGSampleBlock
+{
+	friend class FEEGBlockPool;
+	friend class FEEGBlockRef;
+
+	float* m_samples = nullptr;
+	double* m_timestamps = nullptr;
+	int32 m_numChannels = 0;
+	int32 m_numFrames = 0;
+	FEEGBlockPool* m_pool = nullptr;
+	std::atomic<int32> m_refCount{0};
+	/** Next free block of the pool */
+	std::atomic<int32> m_next{INDEX_NONE};
+
+public:
+	float* GetSamples() { return m_samples; }
+	const float* GetSamples() const { return m_samples; }
+	double* GetTimestamps() { return m_timestamps; }
+	const double* GetTimestamps() const { return m_timestamps; }
+	int32 GetNumChannels() const { return m_numChannels; }
+	int32 GetNumFrames() const { return m_numFrames; }
+	int32 GetFrameCapacity() const;
+	/** Sets the layout of the frames written to the block */
+	void SetFrames(int32 NumChannels, int32 NumFrames);
+};
+
+/** Shared handle of a pooled block, copies only touch the reference count and the last one gives the block back to its pool, on any thread */
+class VR_TEST_API FEEGBlockRef
+{
+	FEEGSampleBlock* m_block = nullptr;
+
+public:
+	FEEGBlockRef() = default;
+	explicit FEEGBlockRef(FEEGSampleBlock* Block);
+	FEEGBlockRef(const FEEGBlockRef& Other);
+	FEEGBlockRef(FEEGBlockRef&& Other) : m_block(Other.m_block) { Other.m_block = nullptr; }
+	FEEGBlockRef& operator=(const FEEGBlockRef& Other);
+	FEEGBlockRef& operator=(FEEGBlockRef&& Other);
+	~FEEGBlockRef() { Reset(); }
+
+	void Reset();
+	bool IsValid() const { return m_block != nullptr; }
+	explicit operator bool() const { return IsValid(); }
+	/** @return True if this is the only reference, which may then write to the block */
+	bool IsUnique() const { return m_block && m_block->m_refCount.load(std::memory_order_acquire) == 1; }
+
+	FEEGSampleBlock* operator->() { return m_block; }
+	const FEEGSampleBlock* operator->() const { return m_block; }
+	FEEGSampleBlock& operator*() { return *m_block; }
+	const FEEGSampleBlock& operator*() const { return *m_block; }
+};
+
+/**
+ * Pool of same size sample blocks allocated once. Acquiring and releasing never allocate and are lock free (tagged index free list),
+ * so that producers and consumers on different threads do not contend on the allocator.
+ */
+class VR_TEST_API FEEGBlockPool
+{
+	friend class FEEGBlockRef;
+
+	TUniquePtr<FEEGSampleBlock[]> m_blocks;
+	int32 m_numBlocks = 0;
+	/** One allocation for every block */
+	TArray<float> m_samples;
+	TArray<double> m_timestamps;
+	int32 m_frameCapacity = 0;
+	int32 m_maxChannels = 0;
+	/** Free list head, block index in the low 32 bits and a tag incremented by every pop in the high ones, against ABA */
+	std::atomic<uint64> m_freeHead{MAX_uint32};
+	std::atomic<int32> m_numFree{0};
+	std::atomic<int32> m_exhausted{0};
+
+public:
+	FEEGBlockPool() = default;
+	FEEGBlockPool(const FEEGBlockPool&) = delete;
+	FEEGBlockPool& operator=(const FEEGBlockPool&) = delete;
+	~FEEGBlockPool();
+
+	/**
+	 * Allocates every block. Must not be called while blocks are acquired.
+	 * @param NumBlocks			Number of blocks
+	 * @param FrameCapacity		Frames per block
+	 * @param MaxChannels		Channels per frame at most
+	 */
+	void Setup(int32 NumBlocks, int32 FrameCapacity, int32 MaxChannels);
+
+	/** @return	An empty block, or an invalid handle if every block is in use */
+	FEEGBlockRef Acquire();
+
+	int32 GetFrameCapacity() const { return m_frameCapacity; }
+	int32 GetMaxChannels() const { return m_maxChannels; }
+	int32 GetNumFree() const { return m_numFree.load(std::memory_order_relaxed); }
+	/** @return Number of failed Acquire calls, the pool should be larger if not 0 */
+	int32 GetNumExhausted() const { return m_exhausted.load(std::memory_order_relaxed); }
+
+private:
+	void Release(FEEGSampleBlock* Block);
+};
+
+/**
+ * Linear allocator over a buffer allocated once, for the scratch memory of a stage. Everything allocated is dropped at once by Reset, usually every tick.
+ * Not thread safe, every stage owns its arena.
+ */
+class VR_TEST_API FEEGFrameArena
+{
+	TArray<uint8> m_buffer;
+	int32 m_used = 0;
+	int32 m_highWater = 0;
+
+public:
+	explicit FEEGFrameArena(int32 Capacity = 0) { m_buffer.SetNumUninitialized(Capacity); }
+
+	/**
+	 * @param Count	Number of elements, left uninitialised
+	 * @return		16 bytes aligned memory, null if the arena is full
+	 */
+	template <typename T>
+	T* Alloc(int32 Count)
+	{
+		static_assert(TIsTriviallyDestructible<T>::Value, "Arena memory is dropped without destructing");
+		const int32 start = Align(m_used, 16);
+		const int32 size = Count * static_cast<int32>(sizeof(T));
+		if (!ensureMsgf(start + size <= m_buffer.Num(), TEXT("Frame arena of %d bytes is full"), m_buffer.Num()))
+			return nullptr;
+
+		m_used = start + size;
+		m_highWater = FMath::Max(m_highWater, m_used);
+		return reinterpret_cast<T*>(m_buffer.GetData() + start);
+	}
+
+	void Reset() { m_used = 0; }
+	int32 GetCapacity() const { return m_buffer.Num(); }
+	/** @return Most bytes ever in use, to size the arena */
+	int32 GetHighWater() const { return m_highWater; }
+};
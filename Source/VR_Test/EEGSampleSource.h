@@ -0,0 +1,26 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Source of multi-channel EEG frames for the native pipeline (hub subscription, LSL inlet...).
+ * Pulling never blocks, it returns whatever arrived since the last pull.
+ */
+class IEEGSampleSource
+{
+public:
+	virtual ~IEEGSampleSource() = default;
+
+	virtual int32 GetNumChannels() const = 0;
+	virtual float GetSampleRate() const = 0;
+	/**
+	 * Copies the frames received since the last call.
+	 * @param OutInterleaved	Receives MaxFrames * GetNumChannels() samples at most, channel after channel for each frame
+	 * @param OutTimestamps		Receives one timestamp (s, FPlatformTime::Seconds clock) per frame
+	 * @param MaxFrames			Max number of frames
+	 * @return					Number of frames copied, INDEX_NONE if the source was lost and must be connected again
+	 */
+	virtual int32 Pull(float* OutInterleaved, double* OutTimestamps, int32 MaxFrames) = 0;
+};
@@ -0,0 +1,184 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EEGStagePipeline.h"
+
+#include "EEGQualityGovernor.h"
+#include "MeditationAllocGuard.h"
+
+FEEGStagePipeline::~FEEGStagePipeline()
+{
+	// The tasks reference the slots and the classifier
+	Flush();
+}
+
+void FEEGStagePipeline::Setup(FRiemannClassifier& Classifier, int32 MaxHopSize, FEEGQualityGovernor* Governor)
+{
+	Flush();
+	m_filling.Reset();
+	m_classifier = &Classifier;
+	m_governor = Governor;
+	m_hopSize = FMath::Clamp(Classifier.GetHopSize(), 1, MaxHopSize);
+	m_hopFrames = 0;
+	// A block per slot, and the one being filled
+	m_blocks.Setup(NumSlots + 1, FMath::Max(MaxHopSize, 1), Classifier.GetNumChannels());
+}
+
+void FEEGStagePipeline::AddSamples(const float* Interleaved, int32 NumFrames, int32 Stride)
+{
+	const int32 numChannels = m_classifier->GetNumChannels();
+	check(Stride >= numChannels);
+	for (int32 frame = 0; frame < NumFrames;)
+	{
+		if (!m_filling)
+		{
+			m_filling = m_blocks.Acquire();
+			check(m_filling);
+			m_filling->SetFrames(numChannels, 0);
+		}
+
+		const int32 filled = m_filling->GetNumFrames();
+		const int32 count = FMath::Min(NumFrames - frame, m_hopSize - m_hopFrames - filled);
+		float* samples = m_filling->GetSamples() + filled * numChannels;
+		if (Stride == numChannels)
+			FMemory::Memcpy(samples, Interleaved + frame * Stride, count * numChannels * sizeof(float));
+		else
+		{
+			// The classifier uses the leading channels of each frame
+			for (int32 i = 0; i < count; ++i)
+				FMemory::Memcpy(samples + i * numChannels, Interleaved + (frame + i) * Stride, numChannels * sizeof(float));
+		}
+		m_filling->SetFrames(numChannels, filled + count);
+		frame += count;
+
+		if (m_hopFrames + m_filling->GetNumFrames() == m_hopSize)
+			LaunchFilling();
+	}
+}
+
+void FEEGStagePipeline::AddBlock(FEEGBlockRef Block, int32 Stride)
+{
+	check(Stride >= m_classifier->GetNumChannels());
+	// Frames copied before go first
+	if (m_filling && m_filling->GetNumFrames() > 0)
+		LaunchFilling();
+
+	for (int32 start = 0; start < Block->GetNumFrames();)
+	{
+		const int32 count = FMath::Min(Block->GetNumFrames() - start, m_hopSize - m_hopFrames);
+		LaunchSegment(Block, start, count, Stride);
+		start += count;
+	}
+}
+
+void FEEGStagePipeline::LaunchFilling()
+{
+	const int32 numFrames = m_filling ? m_filling->GetNumFrames() : 0;
+	LaunchSegment(m_filling, 0, numFrames, m_classifier->GetNumChannels());
+	m_filling.Reset();
+}
+
+void FEEGStagePipeline::LaunchSegment(const FEEGBlockRef& Block, int32 Start, int32 Count, int32 Stride)
+{
+	FHop* hop = nullptr;
+	if (m_hopFrames + Count >= m_hopSize)
+	{
+		hop = &m_hops[m_nextSlot];
+		m_nextSlot = (m_nextSlot + 1) % NumSlots;
+		if (hop->done.IsValid() && !hop->done.IsCompleted())
+		{
+			++m_stalls;
+			hop->done.Wait();
+		}
+		++m_numHops;
+		m_hopFrames = 0;
+	}
+	else
+		m_hopFrames += Count;
+
+	// Task launches go through the task system allocator
+	FMeditationAllocGuard::FAllow allow;
+	UE::Tasks::FTask prerequisites[NumDistances + 1];
+
+	for (int32 band = 0; band < NumBands; ++band)
+	{
+		// Every filter task holds a reference on the block, the last one done gives it back to its pool
+		auto filter = [this, hop, band, block = Block, Start, Count, Stride]() mutable
+		{
+			FMeditationAllocGuard::FScope allocGuard;
+			const uint64 start = FPlatformTime::Cycles64();
+			if (Count > 0)
+				m_classifier->FilterBand(band, block->GetSamples() + Start * Stride, Count, Stride);
+			if (hop)
+				hop->covariances[band] = m_classifier->GetCovariance(band);
+			block.Reset();
+
+			const uint64 cycles = FPlatformTime::Cycles64() - start;
+			m_filterCycles.fetch_add(cycles, std::memory_order_relaxed);
+			if (m_governor)
+				m_governor->AddStageCost(FEEGQualityGovernor::Filter, cycles);
+		};
+		if (m_filterTasks[band].IsValid())
+			m_filterTasks[band] = UE::Tasks::Launch(UE_SOURCE_LOCATION, MoveTemp(filter), UE::Tasks::Prerequisites(m_filterTasks[band]));
+		else
+			m_filterTasks[band] = UE::Tasks::Launch(UE_SOURCE_LOCATION, MoveTemp(filter));
+
+		if (!hop)
+			continue;
+		for (int32 cls = 0; cls < NumClasses; ++cls)
+			prerequisites[band * NumClasses + cls] = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, hop, band, cls]
+			{
+				FMeditationAllocGuard::FScope allocGuard;
+				const uint64 start = FPlatformTime::Cycles64();
+				hop->distances[band][cls] = m_classifier->GetClassDistance(hop->covariances[band], band, cls, hop->scratch[band][cls]);
+
+				const uint64 cycles = FPlatformTime::Cycles64() - start;
+				m_classifyCycles.fetch_add(cycles, std::memory_order_relaxed);
+				if (m_governor)
+					m_governor->AddStageCost(FEEGQualityGovernor::Classify, cycles);
+			}, UE::Tasks::Prerequisites(m_filterTasks[band]));
+	}
+	if (!hop)
+		return;
+
+	// Posteriors are chained, they reach the ring in hop order and record calibration examples one at a time
+	prerequisites[NumDistances] = m_lastPosterior.IsValid() ? m_lastPosterior : prerequisites[0];
+	m_lastPosterior = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, hop]
+	{
+		FMeditationAllocGuard::FScope allocGuard;
+		m_classifier->RecordCalibrationSample(hop->covariances);
+		if (m_classifier->IsCalibrated() && !m_posteriors.Push(m_classifier->GetPosterior(hop->distances)))
+			m_overflowed.fetch_add(1, std::memory_order_relaxed);
+	}, prerequisites);
+	hop->done = m_lastPosterior;
+}
+
+void FEEGStagePipeline::Flush()
+{
+	// Segments that did not complete a hop have no posterior task
+	for (UE::Tasks::FTask& filter : m_filterTasks)
+		if (filter.IsValid())
+			filter.Wait();
+	if (m_lastPosterior.IsValid())
+		m_lastPosterior.Wait();
+}
+
+void FEEGStagePipeline::SetHopSize(int32 HopSize)
+{
+	Flush();
+	m_hopSize = FMath::Clamp(HopSize, 1, m_blocks.GetFrameCapacity());
+	// Classified as is, the next hops have the new size
+	if (m_hopFrames + (m_filling ? m_filling->GetNumFrames() : 0) >= m_hopSize)
+		LaunchFilling();
+}
+
+FEEGStagePipeline::FStats FEEGStagePipeline::GetStats() const
+{
+	FStats stats;
+	stats.hops = m_numHops;
+	stats.stalls = m_stalls;
+	stats.overflowed = m_overflowed.load(std::memory_order_relaxed);
+	stats.filterCycles = m_filterCycles.load(std::memory_order_relaxed);
+	stats.classifyCycles = m_classifyCycles.load(std::memory_order_relaxed);
+	return stats;
+}
@@ -0,0 +1,130 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EEGSampleBlock.h"
+#include "RiemannClassifier.h"
+#include "SpscRingBuffer.h"
+#include "Tasks/Task.h"
+#include <atomic>
+
+class FEEGQualityGovernor;
+
+/**
+ * Runs the classifier stages of consecutive hops on the task graph, as a graph of dependent tasks:
+ *   Filter[band] of hop N+1		after Filter[band] of hop N, the filter state of a band being sequential
+ *   Distance[band][class] of hop N	after Filter[band] of hop N, on a copy of the band covariance taken at the end of the hop
+ *   Posterior of hop N				after every Distance of hop N and the Posterior of hop N-1, so that results come out in order
+ * Bands are filtered in parallel (the channels are the lanes of the vector registers), the six distances in parallel, and hop N+1 is filtered while hop N
+ * is classified. Filtering runs on segments of frames: the blocks an EEG source was pulled into are handed to the filter tasks as is (AddBlock),
+ * frames coming one by one are first copied into hop blocks (AddSamples). The game thread only hands blocks over and pops the posteriors.
+ *
+ * The classifier must not be used otherwise while hops are in flight: Flush before touching its calibration or settings.
+ */
+class VR_TEST_API FEEGStagePipeline
+{
+public:
+	/** Hops in flight at most, the game thread waits for the oldest one beyond */
+	static constexpr int32 NumSlots = 8;
+
+	struct FStats
+	{
+		int64 hops = 0;
+		/** Hops submitted while every slot was busy */
+		int64 stalls = 0;
+		/** Posteriors lost because nobody popped them */
+		int64 overflowed = 0;
+		/** Cycles spent in each stage, summed over the threads */
+		uint64 filterCycles = 0;
+		uint64 classifyCycles = 0;
+	};
+
+private:
+	static constexpr int32 NumBands = FRiemannClassifier::NumBands;
+	static constexpr int32 NumClasses = FRiemannClassifier::NumClasses;
+	static constexpr int32 NumDistances = NumBands * NumClasses;
+
+	/** State of a hop between its stages */
+	struct FHop
+	{
+		FEEGMatrix covariances[NumBands];
+		FEEGMatrix scratch[NumBands][NumClasses][3];
+		float distances[NumBands][NumClasses];
+		/** Posterior stage, the slot is free once it is done */
+		UE::Tasks::FTask done;
+	};
+
+	FRiemannClassifier* m_classifier = nullptr;
+	FEEGQualityGovernor* m_governor = nullptr;
+	int32 m_hopSize = 1;
+	/** Frames of the current hop whose filter tasks are launched */
+	int32 m_hopFrames = 0;
+	/** Blocks AddSamples copies frames into */
+	FEEGBlockPool m_blocks;
+	/** Frames copied by AddSamples, not filtered yet */
+	FEEGBlockRef m_filling;
+	FHop m_hops[NumSlots];
+	int32 m_nextSlot = 0;
+	UE::Tasks::FTask m_filterTasks[NumBands];
+	UE::Tasks::FTask m_lastPosterior;
+	TSpscRingBuffer<float, 64> m_posteriors;
+
+	int64 m_numHops = 0;
+	int64 m_stalls = 0;
+	std::atomic<int64> m_overflowed{0};
+	std::atomic<uint64> m_filterCycles{0};
+	std::atomic<uint64> m_classifyCycles{0};
+
+	/**
+	 * Launches the filter tasks of a segment of a block, then the classifier stages of the hop if the segment completes it.
+	 * @param Block		Block holding the frames, referenced until filtered. May be null if Count is 0
+	 * @param Start		First frame of the segment
+	 * @param Count		Number of frames, at most what the hop misses
+	 * @param Stride	Samples per frame in the block
+	 */
+	void LaunchSegment(const FEEGBlockRef& Block, int32 Start, int32 Count, int32 Stride);
+	/** Launches the frames copied by AddSamples */
+	void LaunchFilling();
+
+public:
+	FEEGStagePipeline() = default;
+	FEEGStagePipeline(const FEEGStagePipeline&) = delete;
+	FEEGStagePipeline& operator=(const FEEGStagePipeline&) = delete;
+	~FEEGStagePipeline();
+
+	/**
+	 * @param Classifier	Classifier whose stages are run, must outlive the pipeline
+	 * @param MaxHopSize	Largest hop size SetHopSize will be given
+	 * @param Governor		Governor the stage costs are reported to, optional
+	 */
+	void Setup(FRiemannClassifier& Classifier, int32 MaxHopSize, FEEGQualityGovernor* Governor = nullptr);
+	/**
+	 * Copies frames into hop blocks and launches the stages of every completed hop. Game thread.
+	 * @param Interleaved	NumFrames * Stride samples
+	 * @param NumFrames		Number of frames
+	 * @param Stride		Samples per frame, at least the classifier channel count. Only the leading channels are classified
+	 */
+	void AddSamples(const float* Interleaved, int32 NumFrames, int32 Stride);
+	/**
+	 * Hands a block of frames to the filter tasks without copying it, it goes back to its pool once filtered. Game thread.
+	 * @param Block			Frames to classify, in order with the ones given before
+	 * @param Stride		Samples per frame in the block, at least the classifier channel count. Only the leading channels are classified
+	 */
+	void AddBlock(FEEGBlockRef Block, int32 Stride);
+	/**
+	 * Pops the posterior of the oldest classified hop. Hops are only classified once the classifier is calibrated.
+	 * @param OutPosterior	Posterior probability of the relaxed class
+	 * @return				False if no hop finished since the last pop
+	 */
+	bool PopPosterior(float& OutPosterior) { return m_posteriors.Pop(OutPosterior); }
+	/** Waits for every task in flight. The frames copied by AddSamples and not filtered yet stay there */
+	void Flush();
+	/**
+	 * Flushes, then changes the number of frames per hop, classifying the current hop right away if it already reached it.
+	 * @param HopSize	At most the MaxHopSize given to Setup
+	 */
+	void SetHopSize(int32 HopSize);
+
+	FStats GetStats() const;
+};
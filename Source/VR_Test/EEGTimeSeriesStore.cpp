@@ -0,0 +1,100 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EEGTimeSeriesStore.h"
+
+/** Finest pyramid level. Ranges smaller than 2^MinLevel samples are read from the raw samples, which keeps the pyramid memory below the raw data size */
+static constexpr int32 MinLevel = 4;
+/** Coarsest pyramid level, 2^MaxLevel samples is more than a day at 512 Hz */
+static constexpr int32 MaxLevel = 32;
+
+FEEGTimeSeriesStore::FEEGTimeSeriesStore(int32 NumChannels, float SampleRate)
+	: m_numChannels(NumChannels)
+	, m_sampleRate(SampleRate)
+{
+	m_samples.SetNum(NumChannels);
+	m_levels.SetNum(NumChannels);
+	for (TArray<TArray<FEEGSampleSummary>>& levels : m_levels)
+		levels.SetNum(MaxLevel - MinLevel + 1);
+}
+
+void FEEGTimeSeriesStore::Append(const float* Values)
+{
+	for (int32 channel = 0; channel < m_numChannels; ++channel)
+	{
+		const float value = Values[channel];
+		m_samples[channel].Add(value);
+
+		// One bucket per level contains the new sample
+		TArray<TArray<FEEGSampleSummary>>& levels = m_levels[channel];
+		for (int32 level = MinLevel; level <= MaxLevel; ++level)
+		{
+			TArray<FEEGSampleSummary>& buckets = levels[level - MinLevel];
+			const int64 bucket = m_numSamples >> level;
+			if (bucket == buckets.Num())
+				buckets.AddDefaulted();
+			buckets[bucket].Add(value);
+		}
+	}
+
+	++m_numSamples;
+}
+
+void FEEGTimeSeriesStore::Append(float Value)
+{
+	check(m_numChannels == 1);
+	Append(&Value);
+}
+
+void FEEGTimeSeriesStore::Reserve(int32 NumSamples)
+{
+	for (int32 channel = 0; channel < m_numChannels; ++channel)
+	{
+		m_samples[channel].Reserve(NumSamples);
+		TArray<TArray<FEEGSampleSummary>>& levels = m_levels[channel];
+		for (int32 level = MinLevel; level <= MaxLevel; ++level)
+			levels[level - MinLevel].Reserve(((NumSamples - 1) >> level) + 1);
+	}
+}
+
+FEEGSampleSummary FEEGTimeSeriesStore::Summarize(int32 Channel, int64 First, int64 Last) const
+{
+	FEEGSampleSummary summary;
+	const TArray<float>& samples = m_samples[Channel];
+	const TArray<TArray<FEEGSampleSummary>>& levels = m_levels[Channel];
+	Last = FMath::Min(Last, m_numSamples);
+
+	for (int64 index = FMath::Max<int64>(First, 0); index < Last;)
+	{
+		// Largest bucket starting at index and ending before Last
+		int32 level = FMath::Min<int32>(FMath::CountTrailingZeros64(index), MaxLevel);
+		while (level >= MinLevel && index + (1ll << level) > Last)
+			--level;
+
+		if (level < MinLevel)
+		{
+			summary.Add(samples[index]);
+			++index;
+		}
+		else
+		{
+			summary.Merge(levels[level - MinLevel][index >> level]);
+			index += 1ll << level;
+		}
+	}
+
+	return summary;
+}
+
+void FEEGTimeSeriesStore::Query(int32 Channel, double StartTime, double EndTime, FEEGSampleSummary* OutColumns, int32 Columns) const
+{
+	const double firstSample = StartTime * m_sampleRate;
+	const double samplesPerColumn = (EndTime - StartTime) * m_sampleRate / Columns;
+
+	for (int32 column = 0; column < Columns; ++column)
+	{
+		const int64 first = FMath::FloorToInt64(firstSample + column * samplesPerColumn);
+		const int64 last = FMath::FloorToInt64(firstSample + (column + 1) * samplesPerColumn);
+		OutColumns[column] = Summarize(Channel, first, last);
+	}
+}
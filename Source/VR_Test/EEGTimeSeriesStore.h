@@ -0,0 +1,98 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Aggregate of a range of samples */
+struct FEEGSampleSummary
+{
+	float min = MAX_flt;
+	float max = -MAX_flt;
+	float sum = 0.f;
+	int32 count = 0;
+
+	void Add(float Value)
+	{
+		min = FMath::Min(min, Value);
+		max = FMath::Max(max, Value);
+		sum += Value;
+		++count;
+	}
+
+	void Merge(const FEEGSampleSummary& Other)
+	{
+		min = FMath::Min(min, Other.min);
+		max = FMath::Max(max, Other.max);
+		sum += Other.sum;
+		count += Other.count;
+	}
+
+	float GetMean() const { return count > 0 ? sum / count : 0.f; }
+	bool IsEmpty() const { return count == 0; }
+};
+
+/**
+ * Append-only multi-channel time series, sampled at a fixed rate.
+ * Each channel keeps a pyramid of min/max/mean summaries: level L bucket i summarises samples [i * 2^L, (i + 1) * 2^L).
+ * Appending a sample updates one bucket per level, O(log N), and a range can be summarised at any resolution by reading the coarsest level whose buckets
+ * still fit in the requested resolution.
+ */
+class VR_TEST_API FEEGTimeSeriesStore
+{
+	int32 m_numChannels;
+	float m_sampleRate;
+	int64 m_numSamples = 0;
+	/** Raw samples of each channel, level 0 */
+	TArray<TArray<float>> m_samples;
+	/** m_levels[Channel][Level - MinLevel] holds the buckets of level Level, ranges finer than MinLevel (see the .cpp) are read from the raw samples */
+	TArray<TArray<TArray<FEEGSampleSummary>>> m_levels;
+
+public:
+	/**
+	 * @param NumChannels	Number of channels
+	 * @param SampleRate	Samples per second and per channel
+	 */
+	FEEGTimeSeriesStore(int32 NumChannels, float SampleRate);
+
+	/**
+	 * Appends one sample to every channel.
+	 * @param Values	One value per channel
+	 */
+	void Append(const float* Values);
+	/**
+	 * Appends one sample to a single channel store. Only valid for single channel stores.
+	 * @param Value		New value
+	 */
+	void Append(float Value);
+	/**
+	 * Allocates the raw samples and pyramid buckets of a session length up front, so that appending within it never allocates.
+	 * @param NumSamples	Samples per channel
+	 */
+	void Reserve(int32 NumSamples);
+
+	/**
+	 * Summarises a range of samples into Columns buckets of equal duration. Each column reads O(log N) buckets whatever its duration.
+	 * @param Channel		Channel to read
+	 * @param StartTime		Start of the range (s), relative to the first sample
+	 * @param EndTime		End of the range (s)
+	 * @param OutColumns	Receives one summary per column. Columns without any sample are empty
+	 * @param Columns		Number of columns, usually the plot width in pixels
+	 */
+	void Query(int32 Channel, double StartTime, double EndTime, FEEGSampleSummary* OutColumns, int32 Columns) const;
+
+	/**
+	 * Summarises samples [First, Last) of a channel using the fewest pyramid buckets.
+	 * @param Channel	Channel to read
+	 * @param First		First sample index
+	 * @param Last		End sample index, exclusive
+	 * @return			Summary of the range
+	 */
+	FEEGSampleSummary Summarize(int32 Channel, int64 First, int64 Last) const;
+
+	int32 GetNumChannels() const { return m_numChannels; }
+	float GetSampleRate() const { return m_sampleRate; }
+	int64 GetNumSamples() const { return m_numSamples; }
+	/** @return Duration (s) covered by the stored samples */
+	double GetDuration() const { return m_numSamples / static_cast<double>(m_sampleRate); }
+};
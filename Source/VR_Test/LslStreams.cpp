@@ -0,0 +1,106 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LslStreams.h"
+
+#include "VR_Test.h"
+
+#if WITH_LSL
+#include "lsl_c.h"
+#endif
+
+FLslInlet::~FLslInlet()
+{
+#if WITH_LSL
+	if (m_inlet)
+		lsl_destroy_inlet(static_cast<lsl_inlet>(m_inlet));
+#endif
+}
+
+TUniquePtr<FLslInlet> FLslInlet::Connect(const FString& StreamType, double Timeout)
+{
+#if WITH_LSL
+	// Streams of this machine only, the hub and the recorders run on the same box
+	const FString predicate = FString::Printf(TEXT("type='%s' and hostname='%s'"), *StreamType, FPlatformProcess::ComputerName());
+	lsl_streaminfo info = nullptr;
+	if (lsl_resolve_bypred(&info, 1, TCHAR_TO_UTF8(*predicate), 1, Timeout) <= 0)
+		return nullptr;
+
+	TUniquePtr<FLslInlet> inlet(new FLslInlet());
+	inlet->m_numChannels = lsl_get_channel_count(info);
+	inlet->m_sampleRate = static_cast<float>(lsl_get_nominal_srate(info));
+	// One second of buffering, chunks as sent
+	lsl_inlet handle = lsl_create_inlet(info, FMath::Max(1, FMath::CeilToInt(inlet->m_sampleRate)), 0, 1);
+	lsl_destroy_streaminfo(info);
+	if (!handle)
+		return nullptr;
+	inlet->m_inlet = handle;
+
+	int32_t error = 0;
+	lsl_set_postprocessing(handle, proc_clocksync | proc_dejitter | proc_monotonize);
+	lsl_open_stream(handle, Timeout, &error);
+	if (error != 0)
+	{
+		UE_LOG(LogMeditation, Warning, TEXT("Could not open the LSL %s stream (%d)"), *StreamType, error);
+		return nullptr;
+	}
+
+	UE_LOG(LogMeditation, Log, TEXT("LSL %s stream: %d channels at %g Hz"), *StreamType, inlet->m_numChannels, inlet->m_sampleRate);
+	return inlet;
+#else
+	UE_LOG(LogMeditation, Warning, TEXT("Built without liblsl, see VR_Test.Build.cs"));
+	return nullptr;
+#endif
+}
+
+int32 FLslInlet::Pull(float* OutInterleaved, double* OutTimestamps, int32 MaxFrames)
+{
+#if WITH_LSL
+	int32_t error = 0;
+	const unsigned long numValues = lsl_pull_chunk_f(static_cast<lsl_inlet>(m_inlet), OutInterleaved, OutTimestamps,
+		static_cast<unsigned long>(MaxFrames * m_numChannels), static_cast<unsigned long>(MaxFrames), 0.0, &error);
+	const int32 numFrames = static_cast<int32>(numValues) / m_numChannels;
+
+	// Both are monotonic clocks, their offset only drifts slowly
+	const double clockOffset = FPlatformTime::Seconds() - lsl_local_clock();
+	for (int32 i = 0; i < numFrames; ++i)
+		OutTimestamps[i] += clockOffset;
+	return numFrames;
+#else
+	return 0;
+#endif
+}
+
+FLslMarkerOutlet::~FLslMarkerOutlet()
+{
+#if WITH_LSL
+	if (m_outlet)
+		lsl_destroy_outlet(static_cast<lsl_outlet>(m_outlet));
+#endif
+}
+
+TUniquePtr<FLslMarkerOutlet> FLslMarkerOutlet::Create(const FString& Name, const FString& SourceId)
+{
+#if WITH_LSL
+	lsl_streaminfo info = lsl_create_streaminfo(TCHAR_TO_UTF8(*Name), "Markers", 1, LSL_IRREGULAR_RATE, cft_string, TCHAR_TO_UTF8(*SourceId));
+	lsl_outlet handle = lsl_create_outlet(info, 0, 360);
+	lsl_destroy_streaminfo(info);
+	if (!handle)
+		return nullptr;
+
+	TUniquePtr<FLslMarkerOutlet> outlet(new FLslMarkerOutlet());
+	outlet->m_outlet = handle;
+	return outlet;
+#else
+	return nullptr;
+#endif
+}
+
+void FLslMarkerOutlet::Push(const FString& Marker)
+{
+#if WITH_LSL
+	const FTCHARToUTF8 utf8(*Marker);
+	const char* data = utf8.Get();
+	lsl_push_sample_strt(static_cast<lsl_outlet>(m_outlet), &data, lsl_local_clock());
+#endif
+}
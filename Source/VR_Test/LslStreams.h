@@ -0,0 +1,56 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EEGSampleSource.h"
+
+/**
+ * Lab Streaming Layer inlet: pulls multi-channel EEG chunks from an LSL stream resolved on this machine.
+ * LSL corrects the clock offset with the sender and dejitters the timestamps, which are then moved to the FPlatformTime::Seconds clock.
+ * Only available when the module is built with liblsl (WITH_LSL, see VR_Test.Build.cs).
+ */
+class VR_TEST_API FLslInlet : public IEEGSampleSource
+{
+	void* m_inlet = nullptr;
+	int32 m_numChannels = 0;
+	float m_sampleRate = 0.f;
+
+	FLslInlet() = default;
+
+public:
+	virtual ~FLslInlet() override;
+
+	/**
+	 * Resolves a stream of this machine and opens it.
+	 * @param StreamType	LSL stream type, e.g. "EEG"
+	 * @param Timeout		Max time (s) to wait for the stream
+	 * @return				Null if no stream was found or LSL is not available
+	 */
+	static TUniquePtr<FLslInlet> Connect(const FString& StreamType, double Timeout);
+
+	virtual int32 GetNumChannels() const override { return m_numChannels; }
+	virtual float GetSampleRate() const override { return m_sampleRate; }
+	virtual int32 Pull(float* OutInterleaved, double* OutTimestamps, int32 MaxFrames) override;
+};
+
+/** Lab Streaming Layer outlet of irregular string markers, timestamped with the LSL clock so that external recorders can align them with the EEG */
+class VR_TEST_API FLslMarkerOutlet
+{
+	void* m_outlet = nullptr;
+
+	FLslMarkerOutlet() = default;
+
+public:
+	~FLslMarkerOutlet();
+
+	/**
+	 * @param Name		Stream name
+	 * @param SourceId	Unique source identifier, lets recorders reconnect to the same stream after a restart
+	 * @return			Null if LSL is not available
+	 */
+	static TUniquePtr<FLslMarkerOutlet> Create(const FString& Name, const FString& SourceId);
+
+	/** @param Marker	Marker to publish now */
+	void Push(const FString& Marker);
+};
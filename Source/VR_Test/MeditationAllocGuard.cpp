@@ -0,0 +1,108 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationAllocGuard.h"
+
+#include "HAL/MemoryBase.h"
+#include "Misc/CommandLine.h"
+#include "VR_Test.h"
+#include <atomic>
+
+namespace
+{
+	thread_local int32 GArmed = 0;
+	thread_local int32 GAllowed = 0;
+	std::atomic<int64> GViolations{0};
+	std::atomic<bool> GInstalled{false};
+
+#if !UE_BUILD_SHIPPING
+	/** Forwards everything to the wrapped allocator, and reports the allocations of the guarded threads */
+	class FAllocGuardMalloc final : public FMalloc
+	{
+		FMalloc* m_inner;
+
+		void Check(SIZE_T Count) const
+		{
+			if (GArmed == 0 || GAllowed > 0 || Count == 0)
+				return;
+
+			GViolations.fetch_add(1, std::memory_order_relaxed);
+			// Reporting allocates
+			++GAllowed;
+			ensureMsgf(false, TEXT("Allocation of %llu bytes in a steady state meditation tick"), static_cast<uint64>(Count));
+			--GAllowed;
+		}
+
+	public:
+		explicit FAllocGuardMalloc(FMalloc* Inner) : m_inner(Inner) {}
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override { Check(Count); return m_inner->Malloc(Count, Alignment); }
+		virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override { Check(Count); return m_inner->TryMalloc(Count, Alignment); }
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override { Check(Count); return m_inner->Realloc(Original, Count, Alignment); }
+		virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override { Check(Count); return m_inner->TryRealloc(Original, Count, Alignment); }
+		virtual void Free(void* Original) override { m_inner->Free(Original); }
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return m_inner->QuantizeSize(Count, Alignment); }
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return m_inner->GetAllocationSize(Original, SizeOut); }
+		virtual void Trim(bool bTrimThreadCaches) override { m_inner->Trim(bTrimThreadCaches); }
+		virtual void SetupTLSCachesOnCurrentThread() override { m_inner->SetupTLSCachesOnCurrentThread(); }
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override { m_inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+		virtual void InitializeStatsMetadata() override { m_inner->InitializeStatsMetadata(); }
+		virtual void UpdateStats() override { m_inner->UpdateStats(); }
+		virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { m_inner->GetAllocatorStats(OutStats); }
+		virtual void DumpAllocatorStats(FOutputDevice& Ar) override { m_inner->DumpAllocatorStats(Ar); }
+		virtual bool IsInternallyThreadSafe() const override { return m_inner->IsInternallyThreadSafe(); }
+		virtual bool ValidateHeap() override { return m_inner->ValidateHeap(); }
+		virtual const TCHAR* GetDescriptiveName() override { return m_inner->GetDescriptiveName(); }
+	};
+#endif
+}
+
+bool FMeditationAllocGuard::Install()
+{
+#if !UE_BUILD_SHIPPING
+	if (GInstalled.load() || !FParse::Param(FCommandLine::Get(), TEXT("AllocGuard")))
+		return GInstalled.load();
+
+	check(IsInGameThread());
+	// Blocks allocated before are freed through the proxy to the same allocator, it is never removed
+	GMalloc = new FAllocGuardMalloc(GMalloc);
+	GInstalled.store(true);
+	UE_LOG(LogMeditation, Log, TEXT("Allocation guard installed over %s"), GMalloc->GetDescriptiveName());
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool FMeditationAllocGuard::IsInstalled()
+{
+	return GInstalled.load(std::memory_order_relaxed);
+}
+
+int64 FMeditationAllocGuard::GetViolations()
+{
+	return GViolations.load(std::memory_order_relaxed);
+}
+
+FMeditationAllocGuard::FScope::FScope(bool bArm)
+	: m_bArmed(bArm)
+{
+	if (m_bArmed)
+		++GArmed;
+}
+
+FMeditationAllocGuard::FScope::~FScope()
+{
+	if (m_bArmed)
+		--GArmed;
+}
+
+FMeditationAllocGuard::FAllow::FAllow()
+{
+	++GAllowed;
+}
+
+FMeditationAllocGuard::FAllow::~FAllow()
+{
+	--GAllowed;
+}
@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Debug check that the steady state meditation tick does not allocate. With -AllocGuard on the command line, Install wraps GMalloc in a proxy that
+ * ensures (with the callstack) on every allocation made by a thread inside an armed FScope, outside of any FAllow.
+ * Without it, and in shipping builds, the scopes only update thread local counters.
+ */
+class VR_TEST_API FMeditationAllocGuard
+{
+public:
+	/**
+	 * Wraps GMalloc if -AllocGuard is on the command line. Does nothing the next times.
+	 * @return	True if the guard is installed
+	 */
+	static bool Install();
+	static bool IsInstalled();
+	/** @return Number of allocations made in armed scopes */
+	static int64 GetViolations();
+
+	/** Allocations of this thread are errors while a scope constructed with bArm is alive */
+	class VR_TEST_API FScope
+	{
+		bool m_bArmed;
+
+	public:
+		explicit FScope(bool bArm = true);
+		~FScope();
+		FScope(const FScope&) = delete;
+		FScope& operator=(const FScope&) = delete;
+	};
+
+	/** Allows the allocations of this thread within an armed scope, around engine calls or rare paths (connecting, launching tasks) */
+	class VR_TEST_API FAllow
+	{
+	public:
+		FAllow();
+		~FAllow();
+		FAllow(const FAllow&) = delete;
+		FAllow& operator=(const FAllow&) = delete;
+	};
+};
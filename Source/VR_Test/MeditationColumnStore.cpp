@@ -0,0 +1,334 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationColumnStore.h"
+
+#include "HAL/FileManager.h"
+#include "MeditationAllocGuard.h"
+#include "Misc/Compression.h"
+#include "VR_Test.h"
+
+namespace
+{
+	constexpr uint32 GFileMagic = 0x4C4F434D;	// "MCOL"
+	constexpr uint32 GIndexMagic = 0x5844494D;	// "MIDX"
+	constexpr uint32 GVersion = 1;
+	/** One chunk being filled and two queued for the writer */
+	constexpr int32 GChunkBlocks = 3;
+	/** Index entries allocated up front, an hour at 30 Hz */
+	constexpr int32 GReservedChunks = 3600 * 30 / MeditationColumnStore::ChunkRows + 1;
+
+	const TCHAR* GColumnNames[MeditationColumnStore::NumColumns] = {
+		TEXT("relaxationValue"), TEXT("bRelaxed"), TEXT("curZVelocity"), TEXT("altitude"), TEXT("phase")
+	};
+
+	uint32 ToBits(float Value)
+	{
+		uint32 bits;
+		FMemory::Memcpy(&bits, &Value, sizeof(bits));
+		return bits;
+	}
+
+	float FromBits(uint32 Bits)
+	{
+		float value;
+		FMemory::Memcpy(&value, &Bits, sizeof(value));
+		return value;
+	}
+
+	/** XOR with the previous value and split the bytes in planes, see FMeditationColumnWriter. Values are Stride floats apart */
+	void EncodeColumn(const float* Values, int32 Stride, int32 NumRows, TArray<uint8>& Planes, TArray<uint8>& Out)
+	{
+		const int32 rawSize = NumRows * static_cast<int32>(sizeof(float));
+		Planes.SetNumUninitialized(rawSize, false);
+		uint32 previous = 0;
+		for (int32 row = 0; row < NumRows; ++row)
+		{
+			const uint32 bits = ToBits(Values[row * Stride]);
+			const uint32 delta = bits ^ previous;
+			previous = bits;
+			for (int32 plane = 0; plane < 4; ++plane)
+				Planes[plane * NumRows + row] = static_cast<uint8>(delta >> (plane * 8));
+		}
+
+		int32 compressedSize = FCompression::CompressMemoryBound(NAME_Zlib, rawSize);
+		Out.SetNumUninitialized(compressedSize, false);
+		// Stored as is when it does not shrink, the reader tells them apart by their size
+		if (!FCompression::CompressMemory(NAME_Zlib, Out.GetData(), compressedSize, Planes.GetData(), rawSize) || compressedSize >= rawSize)
+		{
+			// Copied in place, assigning would reallocate Out to the size of Planes
+			Out.SetNumUninitialized(rawSize, false);
+			FMemory::Memcpy(Out.GetData(), Planes.GetData(), rawSize);
+			return;
+		}
+		Out.SetNum(compressedSize, false);
+	}
+
+	/** Serialized size of an FMeditationChunkInfo */
+	constexpr int64 GChunkInfoSize = sizeof(int64) + sizeof(int32) + MeditationColumnStore::NumColumns * (sizeof(int32) + 2 * sizeof(float));
+	/** Row count, index offset, magic */
+	constexpr int64 GFooterSize = sizeof(int64) * 2 + sizeof(uint32);
+
+	void SerializeChunkInfo(FArchive& Ar, FMeditationChunkInfo& Info)
+	{
+		Ar << Info.offset << Info.numRows;
+		for (int32 column = 0; column < MeditationColumnStore::NumColumns; ++column)
+			Ar << Info.sizes[column] << Info.min[column] << Info.max[column];
+	}
+}
+
+const TCHAR* MeditationColumnStore::GetColumnName(EMeditationColumn Column)
+{
+	return GColumnNames[static_cast<int32>(Column)];
+}
+
+EMeditationColumn MeditationColumnStore::FindColumn(const FString& Name)
+{
+	for (int32 column = 0; column < NumColumns; ++column)
+		if (Name.Equals(GColumnNames[column], ESearchCase::IgnoreCase))
+			return static_cast<EMeditationColumn>(column);
+	return EMeditationColumn::Num;
+}
+
+FMeditationColumnWriter::FMeditationColumnWriter(TUniquePtr<FArchive> Archive, float SampleRate, const FString& SessionName)
+	: m_archive(MoveTemp(Archive))
+{
+	m_chunkPool.Setup(GChunkBlocks, MeditationColumnStore::ChunkRows, MeditationColumnStore::NumColumns);
+	AcquireChunk();
+	m_index.Reserve(GReservedChunks);
+	const int32 rawSize = MeditationColumnStore::ChunkRows * static_cast<int32>(sizeof(float));
+	m_planes.Reserve(rawSize);
+	m_encoded.Reserve(FMath::Max(FCompression::CompressMemoryBound(NAME_Zlib, rawSize), rawSize));
+
+	uint32 magic = GFileMagic;
+	uint32 version = GVersion;
+	int32 numColumns = MeditationColumnStore::NumColumns;
+	int32 chunkRows = MeditationColumnStore::ChunkRows;
+	FString sessionName = SessionName;
+	int64 startUtcTicks = FDateTime::UtcNow().GetTicks();
+	*m_archive << magic << version << numColumns << chunkRows << SampleRate << sessionName << startUtcTicks;
+}
+
+FMeditationColumnWriter::~FMeditationColumnWriter()
+{
+	Finish();
+}
+
+TUniquePtr<FMeditationColumnWriter> FMeditationColumnWriter::Create(const FString& Path, float SampleRate, const FString& SessionName)
+{
+	TUniquePtr<FArchive> archive(IFileManager::Get().CreateFileWriter(*Path));
+	if (!archive)
+		return nullptr;
+	return MakeUnique<FMeditationColumnWriter>(MoveTemp(archive), SampleRate, SessionName);
+}
+
+void FMeditationColumnWriter::Append(const FMeditationColumnRow& Row)
+{
+	FMemory::Memcpy(m_chunk->GetSamples() + m_chunkRows * MeditationColumnStore::NumColumns, Row.values, sizeof(Row.values));
+	++m_numRows;
+
+	if (++m_chunkRows == MeditationColumnStore::ChunkRows)
+		FlushChunk();
+}
+
+void FMeditationColumnWriter::Finish()
+{
+	if (!m_archive)
+		return;
+
+	if (m_chunkRows > 0)
+		FlushChunk();
+	if (m_writeTask.IsValid())
+		m_writeTask.Wait();
+	m_chunk.Reset();
+
+	int64 indexOffset = m_archive->Tell();
+	int32 chunkCount = m_index.Num();
+	*m_archive << chunkCount;
+	for (FMeditationChunkInfo& info : m_index)
+		SerializeChunkInfo(*m_archive, info);
+
+	uint32 magic = GIndexMagic;
+	*m_archive << m_numRows << indexOffset << magic;
+	m_archive->Close();
+	m_archive.Reset();
+}
+
+void FMeditationColumnWriter::FlushChunk()
+{
+	m_chunk->SetFrames(MeditationColumnStore::NumColumns, m_chunkRows);
+	auto write = [this, chunk = MoveTemp(m_chunk)]() mutable
+	{
+		FMeditationAllocGuard::FScope allocGuard;
+		const int32 numRows = chunk->GetNumFrames();
+		FMeditationChunkInfo info;
+		info.offset = m_archive->Tell();
+		info.numRows = numRows;
+
+		for (int32 column = 0; column < MeditationColumnStore::NumColumns; ++column)
+		{
+			const float* values = chunk->GetSamples() + column;
+			info.min[column] = MAX_flt;
+			info.max[column] = -MAX_flt;
+			for (int32 row = 0; row < numRows; ++row)
+			{
+				info.min[column] = FMath::Min(info.min[column], values[row * MeditationColumnStore::NumColumns]);
+				info.max[column] = FMath::Max(info.max[column], values[row * MeditationColumnStore::NumColumns]);
+			}
+
+			{
+				// Compressing and writing are engine calls
+				FMeditationAllocGuard::FAllow allow;
+				EncodeColumn(values, MeditationColumnStore::NumColumns, numRows, m_planes, m_encoded);
+				info.sizes[column] = m_encoded.Num();
+				m_archive->Serialize(m_encoded.GetData(), m_encoded.Num());
+			}
+		}
+		if (m_index.Num() == m_index.Max())
+		{
+			// Past the reserved hour, the index grows an hour at a time
+			FMeditationAllocGuard::FAllow allow;
+			m_index.Reserve(m_index.Num() + GReservedChunks);
+		}
+		m_index.Add(info);
+		// Back to the pool before the task completes, Finish may destroy the pool right after
+		chunk.Reset();
+	};
+
+	{
+		// Task launches go through the task system allocator
+		FMeditationAllocGuard::FAllow allow;
+		// Chained so that chunks reach the file in order
+		if (m_writeTask.IsValid())
+			m_writeTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, MoveTemp(write), UE::Tasks::Prerequisites(m_writeTask));
+		else
+			m_writeTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, MoveTemp(write));
+	}
+
+	m_chunkRows = 0;
+	AcquireChunk();
+}
+
+void FMeditationColumnWriter::AcquireChunk()
+{
+	m_chunk = m_chunkPool.Acquire();
+	if (!m_chunk)
+	{
+		// The disk is behind, the game thread waits rather than allocating a chunk
+		m_writeTask.Wait();
+		m_chunk = m_chunkPool.Acquire();
+	}
+	check(m_chunk);
+}
+
+TUniquePtr<FMeditationColumnReader> FMeditationColumnReader::Open(const FString& Path)
+{
+	TUniquePtr<FArchive> archive(IFileManager::Get().CreateFileReader(*Path));
+	if (!archive)
+		return nullptr;
+
+	auto invalid = [&Path](const TCHAR* Reason) -> TUniquePtr<FMeditationColumnReader>
+	{
+		UE_LOG(LogMeditation, Warning, TEXT("%s is not a valid session store: %s"), *Path, Reason);
+		return nullptr;
+	};
+
+	TUniquePtr<FMeditationColumnReader> reader = MakeUnique<FMeditationColumnReader>();
+	uint32 magic = 0;
+	uint32 version = 0;
+	int32 numColumns = 0;
+	int32 chunkRows = 0;
+	*archive << magic << version;
+	if (magic != GFileMagic || version != GVersion)
+		return invalid(TEXT("unknown format or version"));
+
+	*archive << numColumns << chunkRows << reader->m_sampleRate << reader->m_sessionName << reader->m_startUtcTicks;
+	if (archive->IsError() || numColumns != MeditationColumnStore::NumColumns || chunkRows != MeditationColumnStore::ChunkRows || reader->m_sampleRate <= 0.f)
+		return invalid(TEXT("bad header"));
+
+	// Every offset and size read from now on must fall between the header and the footer
+	const int64 headerEnd = archive->Tell();
+	const int64 totalSize = archive->TotalSize();
+	if (totalSize < headerEnd + static_cast<int64>(sizeof(int32)) + GFooterSize)
+		return invalid(TEXT("truncated"));
+
+	archive->Seek(totalSize - GFooterSize);
+	int64 indexOffset = 0;
+	*archive << reader->m_numRows << indexOffset << magic;
+	if (magic != GIndexMagic)
+		return invalid(TEXT("no index, the session was not finished"));
+	const int64 indexEnd = totalSize - GFooterSize;
+	if (indexOffset < headerEnd || indexOffset > indexEnd - static_cast<int64>(sizeof(int32)))
+		return invalid(TEXT("index offset out of the file"));
+
+	archive->Seek(indexOffset);
+	int32 chunkCount = 0;
+	*archive << chunkCount;
+	if (chunkCount < 0 || chunkCount > (indexEnd - indexOffset - static_cast<int64>(sizeof(int32))) / GChunkInfoSize)
+		return invalid(TEXT("chunk count does not fit the index"));
+
+	reader->m_index.SetNum(chunkCount);
+	int64 numRows = 0;
+	for (FMeditationChunkInfo& info : reader->m_index)
+	{
+		SerializeChunkInfo(*archive, info);
+		if (info.numRows <= 0 || info.numRows > MeditationColumnStore::ChunkRows)
+			return invalid(TEXT("bad chunk row count"));
+		numRows += info.numRows;
+
+		// Columns are stored one after the other, before the index
+		int64 chunkEnd = info.offset;
+		for (const int32 size : info.sizes)
+		{
+			if (size <= 0)
+				return invalid(TEXT("bad column size"));
+			chunkEnd += size;
+		}
+		if (info.offset < headerEnd || chunkEnd > indexOffset)
+			return invalid(TEXT("chunk out of the file"));
+	}
+	if (numRows != reader->m_numRows)
+		return invalid(TEXT("row count does not match the chunks"));
+
+	if (archive->IsError())
+		return invalid(TEXT("read error"));
+
+	reader->m_archive = MoveTemp(archive);
+	return reader;
+}
+
+bool FMeditationColumnReader::ReadColumn(int32 Chunk, EMeditationColumn Column, float* OutValues)
+{
+	const FMeditationChunkInfo& info = m_index[Chunk];
+	const int32 column = static_cast<int32>(Column);
+	int64 offset = info.offset;
+	for (int32 previous = 0; previous < column; ++previous)
+		offset += info.sizes[previous];
+
+	// Sizes and row counts were checked against the file by Open
+	const int32 numRows = info.numRows;
+	const int32 rawSize = numRows * static_cast<int32>(sizeof(float));
+	m_encoded.SetNumUninitialized(info.sizes[column], false);
+	m_archive->Seek(offset);
+	m_archive->Serialize(m_encoded.GetData(), m_encoded.Num());
+	if (m_archive->IsError())
+		return false;
+
+	if (m_encoded.Num() == rawSize)
+		Swap(m_planes, m_encoded);
+	else
+	{
+		m_planes.SetNumUninitialized(rawSize, false);
+		if (!FCompression::UncompressMemory(NAME_Zlib, m_planes.GetData(), rawSize, m_encoded.GetData(), m_encoded.Num()))
+			return false;
+	}
+
+	uint32 previous = 0;
+	for (int32 row = 0; row < numRows; ++row)
+	{
+		const uint32 delta = m_planes[row] | m_planes[numRows + row] << 8 | m_planes[2 * numRows + row] << 16 | static_cast<uint32>(m_planes[3 * numRows + row]) << 24;
+		previous ^= delta;
+		OutValues[row] = FromBits(previous);
+	}
+	return true;
+}
@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EEGSampleBlock.h"
+#include "Tasks/Task.h"
+
+/** Columns of a session store, every value is stored as a float */
+enum class EMeditationColumn : uint8
+{
+	RelaxationValue,
+	/** 0 or 1 */
+	Relaxed,
+	ZVelocity,
+	/** Pawn height above its start location (cm) */
+	Altitude,
+	/** EMeditationPhase */
+	Phase,
+	Num
+};
+
+namespace MeditationColumnStore
+{
+	constexpr int32 NumColumns = static_cast<int32>(EMeditationColumn::Num);
+	/** Rows per chunk, about two minutes at 30 Hz */
+	constexpr int32 ChunkRows = 4096;
+
+	/** Column names, as used by query predicates */
+	VR_TEST_API const TCHAR* GetColumnName(EMeditationColumn Column);
+	/** @return	EMeditationColumn::Num if the name is unknown */
+	VR_TEST_API EMeditationColumn FindColumn(const FString& Name);
+}
+
+/** One sampled pawn state */
+struct FMeditationColumnRow
+{
+	float values[MeditationColumnStore::NumColumns] = {};
+
+	float& operator[](EMeditationColumn Column) { return values[static_cast<int32>(Column)]; }
+	float operator[](EMeditationColumn Column) const { return values[static_cast<int32>(Column)]; }
+};
+
+/** Location and zone map of a chunk, read without decoding anything */
+struct FMeditationChunkInfo
+{
+	int64 offset = 0;
+	int32 numRows = 0;
+	/** Encoded size of every column, columns are stored one after the other */
+	int32 sizes[MeditationColumnStore::NumColumns] = {};
+	float min[MeditationColumnStore::NumColumns] = {};
+	float max[MeditationColumnStore::NumColumns] = {};
+};
+
+/**
+ * Columnar session store (.mcol files), written alongside the OpenViBE recordings so that study-wide queries do not have to parse CSV.
+ *
+ * Rows are grouped in chunks of ChunkRows, and each chunk stores every column separately so that a query only decodes the columns it reads.
+ * A column is encoded losslessly: every float is XORed with the previous one, the four bytes of the results are split in four planes, and the planes
+ * are Zlib compressed. Slowly varying values and constant flags leave long runs of zero bytes, the planes of the exponents and flags shrink to almost nothing.
+ * The chunk index at the end of the file keeps the min and max of every column of every chunk, queries use them to skip chunks.
+ *
+ * File layout: header, chunks, index, footer (row count, index offset, magic), like the .eegc archives.
+ *
+ * Chunks are filled in pooled blocks (one frame per row) handed to the worker without copy, and the worker encodes into buffers allocated once,
+ * so that appending does not allocate once the session runs.
+ */
+class VR_TEST_API FMeditationColumnWriter
+{
+	TUniquePtr<FArchive> m_archive;
+	/** Blocks of ChunkRows rows, one being filled and the others waiting for their worker */
+	FEEGBlockPool m_chunkPool;
+	/** Rows of the chunk being filled */
+	FEEGBlockRef m_chunk;
+	int32 m_chunkRows = 0;
+	int64 m_numRows = 0;
+	TArray<FMeditationChunkInfo> m_index;
+	/** Chunks are encoded and written on workers, one after the other */
+	UE::Tasks::FTask m_writeTask;
+	/** Encoding buffers of the worker */
+	TArray<uint8> m_planes;
+	TArray<uint8> m_encoded;
+
+public:
+	/**
+	 * @param Archive		Destination, owned by the writer
+	 * @param SampleRate	Rows per second
+	 * @param SessionName	Participant or session identifier
+	 */
+	FMeditationColumnWriter(TUniquePtr<FArchive> Archive, float SampleRate, const FString& SessionName);
+	~FMeditationColumnWriter();
+
+	/**
+	 * Creates a writer on a new file.
+	 * @return	nullptr if the file cannot be created
+	 */
+	static TUniquePtr<FMeditationColumnWriter> Create(const FString& Path, float SampleRate, const FString& SessionName);
+
+	/** Appends a row. Full chunks are handed over to a worker, the caller never waits for the compression or the disk */
+	void Append(const FMeditationColumnRow& Row);
+	/** Writes the last partial chunk and the index, and closes the file. Called by the destructor if needed */
+	void Finish();
+
+private:
+	void FlushChunk();
+	/** Takes an empty block for the next chunk, waiting for the worker if every block is queued */
+	void AcquireChunk();
+};
+
+class VR_TEST_API FMeditationColumnReader
+{
+	TUniquePtr<FArchive> m_archive;
+	float m_sampleRate = 0.f;
+	FString m_sessionName;
+	int64 m_startUtcTicks = 0;
+	int64 m_numRows = 0;
+	TArray<FMeditationChunkInfo> m_index;
+	/** Encoded column being decoded */
+	TArray<uint8> m_encoded;
+	TArray<uint8> m_planes;
+
+public:
+	/**
+	 * Opens a .mcol file and reads its chunk index.
+	 * @return	nullptr if the file cannot be read or is not a valid store
+	 */
+	static TUniquePtr<FMeditationColumnReader> Open(const FString& Path);
+
+	float GetSampleRate() const { return m_sampleRate; }
+	const FString& GetSessionName() const { return m_sessionName; }
+	FDateTime GetStartTime() const { return FDateTime(m_startUtcTicks); }
+	int64 GetNumRows() const { return m_numRows; }
+	int32 GetNumChunks() const { return m_index.Num(); }
+	const FMeditationChunkInfo& GetChunk(int32 Chunk) const { return m_index[Chunk]; }
+
+	/**
+	 * Decodes one column of a chunk.
+	 * @param Chunk		Chunk index
+	 * @param Column	Column to decode
+	 * @param OutValues	Receives the chunk rows, ChunkRows floats at most
+	 * @return			False if the file is corrupted
+	 */
+	bool ReadColumn(int32 Chunk, EMeditationColumn Column, float* OutValues);
+};
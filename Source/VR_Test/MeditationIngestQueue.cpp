@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationIngestQueue.h"
+
+#include "Algo/Rotate.h"
+#include "VRPawn.h"
+
+void FMeditationIngestQueue::Setup(const FMeditationIngestSettings& Settings)
+{
+	m_settings = Settings;
+	m_values.SetNumZeroed(FMath::Max(Settings.capacity, 1));
+	m_head = 0;
+	m_num = 0;
+	m_stats = FMeditationIngestStats();
+}
+
+void FMeditationIngestQueue::Push(float Value)
+{
+	++m_stats.pushed;
+	if (m_num == m_values.Num())
+	{
+		m_head = (m_head + 1) % m_values.Num();
+		--m_num;
+		++m_stats.overflowed;
+	}
+
+	m_values[(m_head + m_num) % m_values.Num()] = Value;
+	++m_num;
+}
+
+bool FMeditationIngestQueue::Drain(FMeditationData& Data)
+{
+	m_stats.lastDepth = m_num;
+	m_stats.maxDepth = FMath::Max(m_stats.maxDepth, m_num);
+	if (m_num == 0)
+		return false;
+
+	// Make the pending values contiguous, the ring is small
+	if (m_head + m_num > m_values.Num())
+	{
+		Algo::Rotate(m_values, m_head);
+		m_head = 0;
+	}
+	const float* pending = m_values.GetData() + m_head;
+
+	switch (m_settings.policy)
+	{
+	case EMeditationIngestPolicy::Coalesce:
+	{
+		float sum = 0.f;
+		for (int32 i = 0; i < m_num; ++i)
+			sum += pending[i];
+		Data.RegisterValue(sum / m_num);
+		m_stats.coalesced += m_num - 1;
+		break;
+	}
+	case EMeditationIngestPolicy::DropOldest:
+		Data.RegisterValue(pending[m_num - 1]);
+		m_stats.dropped += m_num - 1;
+		break;
+	case EMeditationIngestPolicy::CatchUp:
+		Data.RegisterValues(pending, m_num);
+		break;
+	}
+	Data.ComputeAvg();
+
+	m_head = 0;
+	m_num = 0;
+	return true;
+}
@@ -0,0 +1,87 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MeditationIngestQueue.generated.h"
+
+struct FMeditationData;
+
+/** What to do with the meditation values that piled up during a hitch */
+UENUM(BlueprintType)
+enum class EMeditationIngestPolicy : uint8
+{
+	/** Register their mean as a single value */
+	Coalesce,
+	/** Register the most recent one only */
+	DropOldest,
+	/** Register all of them, the state following each one as if it had arrived on time */
+	CatchUp
+};
+
+USTRUCT(BlueprintType)
+struct FMeditationIngestSettings
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, Category = "Ingest")
+	EMeditationIngestPolicy policy = EMeditationIngestPolicy::Coalesce;
+	/** Max number of pending values, the oldest ones are dropped beyond */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1", ClampMax="4096"), Category = "Ingest")
+	int32 capacity = 64;
+};
+
+USTRUCT(BlueprintType)
+struct FMeditationIngestStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Ingest")
+	int64 pushed = 0;
+	/** Values dropped because the queue was full */
+	UPROPERTY(BlueprintReadOnly, Category = "Ingest")
+	int64 overflowed = 0;
+	/** Values merged into their mean by the Coalesce policy, i.e. not registered as such */
+	UPROPERTY(BlueprintReadOnly, Category = "Ingest")
+	int64 coalesced = 0;
+	/** Older values discarded by the DropOldest policy */
+	UPROPERTY(BlueprintReadOnly, Category = "Ingest")
+	int64 dropped = 0;
+	/** Number of values pending at the last drain */
+	UPROPERTY(BlueprintReadOnly, Category = "Ingest")
+	int32 lastDepth = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Ingest")
+	int32 maxDepth = 0;
+};
+
+/**
+ * Bounded queue between the meditation value producers (Blueprint, classifier) and FMeditationData, drained once per tick.
+ * A burst of values after a hitch then resets the relaxation interpolation once instead of once per value, and costs at most capacity values to catch up.
+ * Storage is allocated by Setup only.
+ */
+class VR_TEST_API FMeditationIngestQueue
+{
+	FMeditationIngestSettings m_settings;
+	TArray<float> m_values;
+	/** Index of the oldest pending value */
+	int32 m_head = 0;
+	int32 m_num = 0;
+	FMeditationIngestStats m_stats;
+
+public:
+	void Setup(const FMeditationIngestSettings& Settings);
+	/**
+	 * Queues a value, dropping the oldest one if the queue is full.
+	 * @param Value	Meditation value
+	 */
+	void Push(float Value);
+	/**
+	 * Registers the pending values into the meditation data according to the policy, and updates its averages.
+	 * @param Data	Meditation data
+	 * @return		True if anything was registered
+	 */
+	bool Drain(FMeditationData& Data);
+
+	int32 Num() const { return m_num; }
+	const FMeditationIngestStats& GetStats() const { return m_stats; }
+};
@@ -0,0 +1,69 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationNetState.h"
+
+namespace
+{
+	constexpr uint32 MaxRelaxation = (1u << FMeditationNetState::RelaxationBits) - 1;
+	/** 0.1 cm precision for locations and velocities */
+	constexpr uint32 VectorScale = 10;
+	constexpr int32 VectorMaxBits = 24;
+
+	uint32 QuantizeRelaxation(float Value)
+	{
+		return FMath::RoundToInt(FMath::Clamp(Value / 100.f, 0.f, 1.f) * MaxRelaxation);
+	}
+
+	bool SerializeZVelocity(float& Value, FArchive& Ar)
+	{
+		if (Ar.IsSaving())
+			return WriteFixedCompressedFloat<FMeditationNetState::MaxZVelocity, FMeditationNetState::VelocityBits>(Value, Ar);
+		return ReadFixedCompressedFloat<FMeditationNetState::MaxZVelocity, FMeditationNetState::VelocityBits>(Value, Ar);
+	}
+}
+
+bool FMeditationNetState::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	uint32 relaxation = Ar.IsSaving() ? QuantizeRelaxation(relaxationValue) : 0;
+	Ar.SerializeBits(&relaxation, RelaxationBits);
+
+	uint8 flags = Ar.IsSaving() ? (bRelaxed ? 1 : 0) | (bGrounded ? 2 : 0) | (bFlying ? 4 : 0) : 0;
+	Ar.SerializeBits(&flags, 3);
+
+	bOutSuccess = SerializeZVelocity(curZVelocity, Ar);
+	bOutSuccess &= SerializeZVelocity(targetZVelocity, Ar);
+	bOutSuccess &= SerializePackedVector<VectorScale, VectorMaxBits>(offset, Ar);
+	rotation.SerializeCompressedShort(Ar);
+
+	if (Ar.IsLoading())
+	{
+		relaxationValue = relaxation * 100.f / MaxRelaxation;
+		bRelaxed = (flags & 1) != 0;
+		bGrounded = (flags & 2) != 0;
+		bFlying = (flags & 4) != 0;
+		velocity = FVector::ZeroVector;
+	}
+
+	// Rising and falling are given by the up velocities, the velocity is only sent when flying
+	if (bFlying)
+		bOutSuccess &= SerializePackedVector<VectorScale, VectorMaxBits>(velocity, Ar);
+
+	return true;
+}
+
+bool FMeditationNetState::operator==(const FMeditationNetState& Other) const
+{
+	constexpr float velocityPrecision = static_cast<float>(MaxZVelocity) / (1 << (VelocityBits - 1));
+	constexpr float vectorPrecision = 1.f / VectorScale;
+
+	return QuantizeRelaxation(relaxationValue) == QuantizeRelaxation(Other.relaxationValue)
+		&& bRelaxed == Other.bRelaxed && bGrounded == Other.bGrounded && bFlying == Other.bFlying
+		&& FMath::IsNearlyEqual(curZVelocity, Other.curZVelocity, velocityPrecision)
+		&& FMath::IsNearlyEqual(targetZVelocity, Other.targetZVelocity, velocityPrecision)
+		&& offset.Equals(Other.offset, vectorPrecision)
+		&& FRotator::CompressAxisToShort(rotation.Pitch) == FRotator::CompressAxisToShort(Other.rotation.Pitch)
+		&& FRotator::CompressAxisToShort(rotation.Yaw) == FRotator::CompressAxisToShort(Other.rotation.Yaw)
+		&& FRotator::CompressAxisToShort(rotation.Roll) == FRotator::CompressAxisToShort(Other.rotation.Roll)
+		&& (!bFlying || velocity.Equals(Other.velocity, vectorPrecision));
+}
@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/NetSerialization.h"
+#include "MeditationNetState.generated.h"
+
+/**
+ * Meditation and floating state of a pawn, as replicated to spectators. Quantised in NetSerialize to a few bytes:
+ * relaxation on 10 bits, up velocities on 14 bits, location as a packed offset to an anchor replicated separately, rotation on 16 bits per axis.
+ * State flips are not part of it, they are sent as reliable events.
+ */
+USTRUCT()
+struct FMeditationNetState
+{
+	GENERATED_BODY()
+
+	static constexpr uint32 RelaxationBits = 10;
+	static constexpr uint32 VelocityBits = 14;
+	/** Max up velocity that can be represented */
+	static constexpr int32 MaxZVelocity = 512;
+	/** The anchor is moved once the pawn gets further from it, so that offsets stay small */
+	static constexpr float MaxAnchorOffset = 10000.f;
+
+	/** 0-100 */
+	float relaxationValue = 0.f;
+	bool bRelaxed = false;
+	bool bGrounded = false;
+	/** Flying with the hands, velocity is then meaningful */
+	bool bFlying = false;
+	float curZVelocity = 0.f;
+	float targetZVelocity = 0.f;
+	/** Location relative to the anchor */
+	FVector offset = FVector::ZeroVector;
+	FRotator rotation = FRotator::ZeroRotator;
+	/** Flying velocity */
+	FVector velocity = FVector::ZeroVector;
+
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+	/** Equality at the replicated precision, so that changes lost in quantisation are not sent */
+	bool operator==(const FMeditationNetState& Other) const;
+};
+
+template<>
+struct TStructOpsTypeTraits<FMeditationNetState> : public TStructOpsTypeTraitsBase2<FMeditationNetState>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true
+	};
+};
@@ -0,0 +1,362 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationParams.h"
+
+#include "Common/UdpSocketBuilder.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Interfaces/IPv4/IPv4Address.h"
+#include "SocketSubsystem.h"
+#include "Sockets.h"
+#include "VRPawn.h"
+#include "VR_Test.h"
+
+namespace
+{
+	struct FParamField
+	{
+		const TCHAR* name;
+		float FMeditationParams::* field;
+	};
+
+	const FParamField GParamFields[] =
+	{
+		{ TEXT("riseVelocity"), &FMeditationParams::riseVelocity },
+		{ TEXT("fallVelocity"), &FMeditationParams::fallVelocity },
+		{ TEXT("relaxedThreshold"), &FMeditationParams::relaxedThreshold },
+		{ TEXT("oppositeStateThreshold"), &FMeditationParams::oppositeStateThreshold },
+		{ TEXT("interpDuration"), &FMeditationParams::interpDuration },
+		{ TEXT("drag"), &FMeditationParams::drag },
+		{ TEXT("cdMin"), &FMeditationParams::cdMin },
+		{ TEXT("cdMax"), &FMeditationParams::cdMax },
+		{ TEXT("AMin"), &FMeditationParams::AMin },
+		{ TEXT("AMax"), &FMeditationParams::AMax },
+		{ TEXT("mass"), &FMeditationParams::mass }
+	};
+
+	/** Receives the update datagrams of the operator tools, only from this machine */
+	class FMeditationParamListener : public FRunnable
+	{
+		FSocket* m_socket = nullptr;
+		FRunnableThread* m_thread = nullptr;
+		std::atomic<bool> m_bStopping{false};
+
+	public:
+		virtual ~FMeditationParamListener() override
+		{
+			if (m_thread)
+			{
+				m_thread->Kill(true);
+				delete m_thread;
+			}
+			if (m_socket)
+				ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(m_socket);
+		}
+
+		/** @return False if the port could not be bound or the thread created */
+		bool Start(int32 Port)
+		{
+			m_socket = FUdpSocketBuilder(TEXT("MeditationParams")).BoundToAddress(FIPv4Address::InternalLoopback).BoundToPort(Port).Build();
+			if (!m_socket)
+				return false;
+			m_thread = FRunnableThread::Create(this, TEXT("MeditationParams"), 0, TPri_BelowNormal);
+			return m_thread != nullptr;
+		}
+
+		virtual uint32 Run() override
+		{
+			uint8 datagram[1024];
+			while (!m_bStopping.load(std::memory_order_relaxed))
+			{
+				int32 bytesRead = 0;
+				if (!m_socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromMilliseconds(100))
+					|| !m_socket->Recv(datagram, sizeof(datagram), bytesRead) || bytesRead <= 0)
+					continue;
+
+				const FUTF8ToTCHAR text(reinterpret_cast<const ANSICHAR*>(datagram), bytesRead);
+				const FString line(text.Length(), text.Get());
+				if (FMeditationParamService::Dispatch(line) == 0)
+					UE_LOG(LogMeditation, Warning, TEXT("No participant matches the parameter update \"%s\""), *line);
+			}
+			return 0;
+		}
+
+		virtual void Stop() override
+		{
+			m_bStopping.store(true, std::memory_order_relaxed);
+		}
+	};
+
+	/** Services updates can be dispatched to, and the listener they share */
+	FCriticalSection GServicesLock;
+	TArray<FMeditationParamService*> GServices;
+	TUniquePtr<FMeditationParamListener> GListener;
+
+	FAutoConsoleCommand GParamsCommand(
+		TEXT("Meditation.Params"),
+		TEXT("Retunes the meditation parameters of a participant: Meditation.Params <participant|*> name=value ... (riseVelocity, fallVelocity, relaxedThreshold, ")
+		TEXT("oppositeStateThreshold, interpDuration, drag, cdMin, cdMax, AMin, AMax, mass)"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			if (FMeditationParamService::Dispatch(FString::Join(Args, TEXT(" "))) == 0)
+				UE_LOG(LogMeditation, Warning, TEXT("No participant matches, usage: Meditation.Params <participant|*> name=value ..."));
+		}));
+}
+
+FMeditationParams::FMeditationParams(const FMeditationData& Meditation, const FFloatingData& Floating)
+	: riseVelocity(Meditation.riseVelocity)
+	, fallVelocity(Meditation.fallVelocity)
+	, relaxedThreshold(Meditation.relaxedThreshold)
+	, oppositeStateThreshold(Meditation.oppositeStateThreshold)
+	, interpDuration(Meditation.interpDuration)
+	, drag(Floating.drag)
+	, cdMin(Floating.cdMin)
+	, cdMax(Floating.cdMax)
+	, AMin(Floating.AMin)
+	, AMax(Floating.AMax)
+	, mass(Floating.mass)
+{
+}
+
+bool FMeditationParams::Set(const FString& Name, float Value)
+{
+	for (const FParamField& field : GParamFields)
+	{
+		if (Name.Equals(field.name, ESearchCase::IgnoreCase))
+		{
+			this->*field.field = Value;
+			return true;
+		}
+	}
+	return false;
+}
+
+FString FMeditationParams::Validate() const
+{
+	for (const FParamField& field : GParamFields)
+	{
+		if (!FMath::IsFinite(this->*field.field))
+			return FString::Printf(TEXT("%s is not finite"), field.name);
+	}
+	if (riseVelocity < 0.f)
+		return TEXT("riseVelocity must be positive");
+	if (fallVelocity > 0.f)
+		return TEXT("fallVelocity must be negative");
+	if (relaxedThreshold < 0.f || relaxedThreshold > 100.f)
+		return TEXT("relaxedThreshold must be in [0, 100]");
+	if (oppositeStateThreshold < 0.f || oppositeStateThreshold > 1.f)
+		return TEXT("oppositeStateThreshold must be in [0, 1]");
+	if (interpDuration <= KINDA_SMALL_NUMBER)
+		return TEXT("interpDuration must be strictly positive");
+	if (drag < 0.f || drag > 1.f)
+		return TEXT("drag must be in [0, 1]");
+	if (cdMin < 0.f || cdMin > cdMax)
+		return TEXT("cdMin and cdMax must satisfy 0 <= cdMin <= cdMax");
+	if (AMin < 0.f || AMin > AMax)
+		return TEXT("AMin and AMax must satisfy 0 <= AMin <= AMax");
+	if (mass <= 0.f)
+		return TEXT("mass must be strictly positive");
+	return FString();
+}
+
+void FMeditationParams::Derive()
+{
+	interpSpeed = (riseVelocity - fallVelocity) / interpDuration;
+	introInterpSpeed = 1.f / interpDuration;
+}
+
+void FMeditationParams::ApplyTo(FMeditationData& Meditation, FFloatingData& Floating, bool bIntro) const
+{
+	Meditation.riseVelocity = riseVelocity;
+	Meditation.fallVelocity = fallVelocity;
+	Meditation.relaxedThreshold = relaxedThreshold;
+	Meditation.oppositeStateThreshold = oppositeStateThreshold;
+	Meditation.interpDuration = interpDuration;
+	Meditation.interpSpeed = bIntro ? introInterpSpeed : interpSpeed;
+	Meditation.targetZVelocity = Meditation.bRelaxed ? riseVelocity : fallVelocity;
+	Floating.drag = drag;
+	Floating.cdMin = cdMin;
+	Floating.cdMax = cdMax;
+	Floating.AMin = AMin;
+	Floating.AMax = AMax;
+	Floating.mass = mass;
+}
+
+FMeditationParamService::FReader::FReader(FMeditationParamService& Service)
+	: m_service(Service)
+	, m_slot(INDEX_NONE)
+{
+	for (int32 slot = 0; slot < MaxReaders; ++slot)
+	{
+		bool bUsed = false;
+		if (m_service.m_readers[slot].bUsed.compare_exchange_strong(bUsed, true))
+		{
+			m_slot = slot;
+			break;
+		}
+	}
+	checkf(m_slot != INDEX_NONE, TEXT("More than %d readers of the parameters of %s"), MaxReaders, *m_service.m_participant);
+}
+
+FMeditationParamService::FReader::~FReader()
+{
+	Unpin();
+	m_service.m_readers[m_slot].bUsed.store(false);
+}
+
+const FMeditationParams& FMeditationParamService::FReader::Pin()
+{
+	// Sequentially consistent: an update that swaps the snapshot after this load sees the pinned epoch when it reclaims,
+	// one that swapped it before has already moved to a later epoch, so the older snapshots are not this reader's concern
+	m_service.m_readers[m_slot].epoch.store(m_service.m_epoch.load());
+	return *m_service.m_current.load();
+}
+
+void FMeditationParamService::FReader::Unpin()
+{
+	m_service.m_readers[m_slot].epoch.store(0, std::memory_order_release);
+}
+
+FMeditationParamService::FMeditationParamService(const FString& Participant, const FMeditationParams& Initial, int32 ListenPort)
+	: m_participant(Participant)
+{
+	FMeditationParams* initial = new FMeditationParams(Initial);
+	initial->Derive();
+	m_current.store(initial);
+
+	FScopeLock lock(&GServicesLock);
+	GServices.Add(this);
+	if (ListenPort > 0 && !GListener)
+	{
+		GListener = MakeUnique<FMeditationParamListener>();
+		if (GListener->Start(ListenPort))
+			UE_LOG(LogMeditation, Log, TEXT("Listening to parameter updates on port %d"), ListenPort);
+		else
+		{
+			UE_LOG(LogMeditation, Warning, TEXT("Could not listen to parameter updates on port %d"), ListenPort);
+			GListener.Reset();
+		}
+	}
+}
+
+FMeditationParamService::~FMeditationParamService()
+{
+	TUniquePtr<FMeditationParamListener> listener;
+	{
+		FScopeLock lock(&GServicesLock);
+		GServices.Remove(this);
+		if (GServices.Num() == 0)
+			listener = MoveTemp(GListener);
+	}
+	// Joins the listener thread, which may be dispatching and waiting for the lock
+	listener.Reset();
+
+	Flush();
+	for (const FReaderSlot& reader : m_readers)
+		ensureMsgf(!reader.bUsed.load(), TEXT("Parameters of %s destroyed while read"), *m_participant);
+	for (const FRetired& retired : m_retired)
+		delete retired.params;
+	delete m_current.load();
+}
+
+void FMeditationParamService::Submit(const FString& Update)
+{
+	FScopeLock lock(&m_submitLock);
+	auto update = [this, Update] { ApplyUpdate(Update); };
+	if (m_lastUpdate.IsValid())
+		m_lastUpdate = UE::Tasks::Launch(UE_SOURCE_LOCATION, MoveTemp(update), UE::Tasks::Prerequisites(m_lastUpdate));
+	else
+		m_lastUpdate = UE::Tasks::Launch(UE_SOURCE_LOCATION, MoveTemp(update));
+}
+
+void FMeditationParamService::Flush()
+{
+	UE::Tasks::FTask lastUpdate;
+	{
+		FScopeLock lock(&m_submitLock);
+		lastUpdate = m_lastUpdate;
+	}
+	if (lastUpdate.IsValid())
+		lastUpdate.Wait();
+}
+
+void FMeditationParamService::ApplyUpdate(const FString& Update)
+{
+	// Only the update tasks replace the snapshot, and they run one at a time
+	FMeditationParams next = *m_current.load(std::memory_order_acquire);
+
+	TArray<FString> assignments;
+	Update.ParseIntoArrayWS(assignments);
+	FString error = assignments.Num() == 0 ? TEXT("nothing to set") : FString();
+	for (const FString& assignment : assignments)
+	{
+		FString name;
+		FString value;
+		float parsed;
+		if (!assignment.Split(TEXT("="), &name, &value) || !LexTryParseString(parsed, *value))
+			error = FString::Printf(TEXT("'%s' is not name=value"), *assignment);
+		else if (!next.Set(name, parsed))
+			error = FString::Printf(TEXT("unknown parameter '%s'"), *name);
+		if (!error.IsEmpty())
+			break;
+	}
+	if (error.IsEmpty())
+		error = next.Validate();
+	if (!error.IsEmpty())
+	{
+		m_numRejected.fetch_add(1, std::memory_order_relaxed);
+		UE_LOG(LogMeditation, Warning, TEXT("Rejected the parameter update \"%s\" of %s: %s"), *Update, *m_participant, *error);
+		return;
+	}
+
+	next.Derive();
+	++next.version;
+	const FMeditationParams* previous = m_current.exchange(new FMeditationParams(next));
+	// Readers that pin from now on see the new snapshot, the previous one is freed once the readers of older epochs are gone
+	m_retired.Add({ previous, m_epoch.fetch_add(1) });
+	m_numApplied.fetch_add(1, std::memory_order_relaxed);
+	UE_LOG(LogMeditation, Log, TEXT("Parameters of %s at version %u: %s"), *m_participant, next.version, *Update);
+
+	Reclaim();
+}
+
+void FMeditationParamService::Reclaim()
+{
+	uint64 oldestPinned = MAX_uint64;
+	for (const FReaderSlot& reader : m_readers)
+	{
+		const uint64 epoch = reader.epoch.load();
+		if (epoch != 0)
+			oldestPinned = FMath::Min(oldestPinned, epoch);
+	}
+	for (int32 i = m_retired.Num() - 1; i >= 0; --i)
+	{
+		if (m_retired[i].epoch < oldestPinned)
+		{
+			delete m_retired[i].params;
+			m_retired.RemoveAtSwap(i, 1, false);
+		}
+	}
+}
+
+int32 FMeditationParamService::Dispatch(const FString& Line)
+{
+	FString participant;
+	FString update;
+	if (!Line.TrimStartAndEnd().Split(TEXT(" "), &participant, &update))
+		return 0;
+
+	int32 numServices = 0;
+	FScopeLock lock(&GServicesLock);
+	for (FMeditationParamService* service : GServices)
+	{
+		if (participant == TEXT("*") || participant.Equals(service->m_participant, ESearchCase::IgnoreCase))
+		{
+			service->Submit(update);
+			++numServices;
+		}
+	}
+	return numServices;
+}
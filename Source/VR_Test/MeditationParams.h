@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tasks/Task.h"
+#include <atomic>
+
+struct FFloatingData;
+struct FMeditationData;
+
+/** Meditation and floating parameters an operator retunes during a session, and the values derived from them */
+struct VR_TEST_API FMeditationParams
+{
+	/** FMeditationData */
+	float riseVelocity = 10.f;
+	float fallVelocity = -10.f;
+	float relaxedThreshold = 50.f;
+	float oppositeStateThreshold = .7f;
+	float interpDuration = 3.f;
+	/** FFloatingData */
+	float drag = .5f;
+	float cdMin = .1f;
+	float cdMax = 1.2f;
+	float AMin = .0015f;
+	float AMax = .0145f;
+	float mass = 65.f;
+
+	/** Derived by Derive: speed reaching the rise or fall velocity in interpDuration, and speed of the intro interpolation */
+	float interpSpeed = 0.f;
+	float introInterpSpeed = 0.f;
+	/** Number of updates published before this snapshot */
+	uint32 version = 0;
+
+	FMeditationParams() = default;
+	FMeditationParams(const FMeditationData& Meditation, const FFloatingData& Floating);
+
+	/**
+	 * Sets a tuned parameter by name (case insensitive).
+	 * @return	False if there is no such parameter
+	 */
+	bool Set(const FString& Name, float Value);
+	/** @return	Empty if the parameters are consistent, else why they are not */
+	FString Validate() const;
+	/** Computes the derived values from the tuned ones */
+	void Derive();
+	/** Copies the tuned and derived values, the meditation state is left as is */
+	void ApplyTo(FMeditationData& Meditation, FFloatingData& Floating, bool bIntro) const;
+};
+
+/**
+ * Live retuning of the parameters of a participant. The parameters are immutable snapshots published by swapping an atomic pointer (read-copy-update):
+ * an update copies the current snapshot, applies the changes, validates them and derives the constants on a worker, then publishes the copy.
+ * Readers never lock nor wait: they pin the snapshot with an FReader, and a replaced snapshot is only freed once every reader that could see it unpinned.
+ *
+ * Updates are text, "name=value name=value ...", applied all or nothing. They come from Submit, the Meditation.Params console command, or datagrams
+ * "<participant|*> name=value ..." sent to the local listener (see UMeditationParamsCommandlet).
+ */
+class VR_TEST_API FMeditationParamService
+{
+public:
+	/** Threads reading at once at most */
+	static constexpr int32 MaxReaders = 16;
+	static constexpr int32 DefaultPort = 5681;
+
+	/** Reader slot of a thread. Pinning is an atomic store and two loads, it never allocates */
+	class VR_TEST_API FReader
+	{
+		FMeditationParamService& m_service;
+		int32 m_slot;
+
+	public:
+		explicit FReader(FMeditationParamService& Service);
+		~FReader();
+		FReader(const FReader&) = delete;
+		FReader& operator=(const FReader&) = delete;
+
+		/** @return	Current snapshot, which stays valid until Unpin */
+		const FMeditationParams& Pin();
+		void Unpin();
+	};
+
+private:
+	/** Epoch a reader pinned, 0 when not reading. One cache line each, so that readers do not contend */
+	struct alignas(PLATFORM_CACHE_LINE_SIZE) FReaderSlot
+	{
+		std::atomic<uint64> epoch{0};
+		std::atomic<bool> bUsed{false};
+	};
+
+	/** Replaced snapshot, freed once every reader pinned a later epoch */
+	struct FRetired
+	{
+		const FMeditationParams* params;
+		uint64 epoch;
+	};
+
+	FString m_participant;
+	std::atomic<const FMeditationParams*> m_current;
+	std::atomic<uint64> m_epoch{1};
+	FReaderSlot m_readers[MaxReaders];
+
+	/** Writer side: updates run one after the other, chained on the last one */
+	FCriticalSection m_submitLock;
+	UE::Tasks::FTask m_lastUpdate;
+	TArray<FRetired> m_retired;
+	std::atomic<uint32> m_numApplied{0};
+	std::atomic<uint32> m_numRejected{0};
+
+	/** Applies an update and publishes the result, update task only */
+	void ApplyUpdate(const FString& Update);
+	/** Frees the retired snapshots no reader can see anymore, update task only */
+	void Reclaim();
+
+public:
+	/**
+	 * @param Participant	Participant the updates are addressed to
+	 * @param Initial		Parameters until the first update, derived here
+	 * @param ListenPort	Local UDP port to receive updates on, shared by every service. 0 to not listen
+	 */
+	FMeditationParamService(const FString& Participant, const FMeditationParams& Initial, int32 ListenPort = 0);
+	~FMeditationParamService();
+	FMeditationParamService(const FMeditationParamService&) = delete;
+	FMeditationParamService& operator=(const FMeditationParamService&) = delete;
+
+	/**
+	 * Queues an update, applied and published on a worker. Any thread.
+	 * @param Update	"name=value name=value ..."
+	 */
+	void Submit(const FString& Update);
+	/** Waits for the queued updates */
+	void Flush();
+
+	const FString& GetParticipant() const { return m_participant; }
+	uint32 GetNumApplied() const { return m_numApplied.load(std::memory_order_relaxed); }
+	uint32 GetNumRejected() const { return m_numRejected.load(std::memory_order_relaxed); }
+
+	/**
+	 * Submits an update to the services of a participant. Any thread.
+	 * @param Line	"<participant|*> name=value ...", * addressing every participant
+	 * @return		Number of services the update was submitted to
+	 */
+	static int32 Dispatch(const FString& Line);
+};
@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationParamsCommandlet.h"
+
+#include "Common/UdpSocketBuilder.h"
+#include "MeditationParams.h"
+#include "SocketSubsystem.h"
+#include "Sockets.h"
+#include "VR_Test.h"
+
+UMeditationParamsCommandlet::UMeditationParamsCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UMeditationParamsCommandlet::Main(const FString& Params)
+{
+	int32 port = FMeditationParamService::DefaultPort;
+	FString participant = TEXT("*");
+	FParse::Value(*Params, TEXT("Port="), port);
+	FParse::Value(*Params, TEXT("Participant="), participant);
+
+	TArray<FString> tokens;
+	TArray<FString> switches;
+	ParseCommandLine(*Params, tokens, switches);
+	if (tokens.Num() == 0)
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Nothing to set, usage: -run=MeditationParams [-Port=5681] [-Participant=<participant|*>] name=value ..."));
+		return 1;
+	}
+
+	ISocketSubsystem* sockets = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	TSharedRef<FInternetAddr> address = sockets->CreateInternetAddr();
+	bool bValidAddress = false;
+	address->SetIp(TEXT("127.0.0.1"), bValidAddress);
+	address->SetPort(port);
+	FSocket* socket = FUdpSocketBuilder(TEXT("MeditationParamsSender")).Build();
+	if (!socket)
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Could not create a UDP socket"));
+		return 1;
+	}
+
+	const FString line = participant + TEXT(" ") + FString::Join(tokens, TEXT(" "));
+	const FTCHARToUTF8 datagram(*line);
+	int32 bytesSent = 0;
+	const bool bSent = socket->SendTo(reinterpret_cast<const uint8*>(datagram.Get()), datagram.Length(), bytesSent, *address) && bytesSent == datagram.Length();
+	sockets->DestroySocket(socket);
+	if (!bSent)
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Could not send the update to port %d"), port);
+		return 1;
+	}
+	UE_LOG(LogMeditation, Display, TEXT("Sent \"%s\" to port %d"), *line, port);
+	return 0;
+}
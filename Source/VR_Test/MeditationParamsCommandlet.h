@@ -0,0 +1,23 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MeditationParamsCommandlet.generated.h"
+
+/**
+ * Retunes the parameters of a running VR session of this machine (see FMeditationParamService), from the operator screen:
+ * UnrealEditor-Cmd VR_Test.uproject -run=MeditationParams -nullrhi [-Port=5681] [-Participant=<participant|*>] name=value ...
+ * e.g. riseVelocity=12 interpDuration=2. The session logs whether the update was applied or why it was rejected.
+ */
+UCLASS()
+class UMeditationParamsCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UMeditationParamsCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,407 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationQueryCommandlet.h"
+
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "MeditationColumnStore.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "VR_Test.h"
+
+namespace
+{
+	constexpr int32 SimdWidth = 4;
+
+	/** Column/constant comparison of a -Where clause */
+	struct FQueryPredicate
+	{
+		enum EOp { Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual };
+
+		EMeditationColumn column = EMeditationColumn::Num;
+		EOp op = Equal;
+		float value = 0.f;
+
+		/** @return	False if no row of a chunk with these bounds can match */
+		bool CanMatch(float Min, float Max) const
+		{
+			switch (op)
+			{
+			case Less: return Min < value;
+			case LessEqual: return Min <= value;
+			case Greater: return Max > value;
+			case GreaterEqual: return Max >= value;
+			case Equal: return Min <= value && value <= Max;
+			default: return Min != value || Max != value;
+			}
+		}
+
+		/** @return	All bits set in the lanes that match */
+		VectorRegister4Float Evaluate(VectorRegister4Float Values) const
+		{
+			const VectorRegister4Float constant = VectorSetFloat1(value);
+			switch (op)
+			{
+			case Less: return VectorCompareGT(constant, Values);
+			case LessEqual: return VectorCompareGE(constant, Values);
+			case Greater: return VectorCompareGT(Values, constant);
+			case GreaterEqual: return VectorCompareGE(Values, constant);
+			case Equal: return VectorCompareEQ(Values, constant);
+			default: return VectorCompareNE(Values, constant);
+			}
+		}
+	};
+
+	/** Parses "column op value" clauses separated by commas */
+	bool ParsePredicates(const FString& Where, TArray<FQueryPredicate>& OutPredicates)
+	{
+		// Two character operators first, so that "<=" is not read as "<"
+		static const TCHAR* operators[] = { TEXT("<="), TEXT(">="), TEXT("=="), TEXT("!="), TEXT("<"), TEXT(">") };
+		static const FQueryPredicate::EOp ops[] = {
+			FQueryPredicate::LessEqual, FQueryPredicate::GreaterEqual, FQueryPredicate::Equal, FQueryPredicate::NotEqual, FQueryPredicate::Less, FQueryPredicate::Greater
+		};
+
+		TArray<FString> clauses;
+		Where.ParseIntoArray(clauses, TEXT(","));
+		for (const FString& clause : clauses)
+		{
+			FQueryPredicate predicate;
+			int32 position = INDEX_NONE;
+			for (int32 i = 0; i < UE_ARRAY_COUNT(operators) && position == INDEX_NONE; ++i)
+			{
+				position = clause.Find(operators[i]);
+				if (position != INDEX_NONE)
+				{
+					predicate.op = ops[i];
+					predicate.column = MeditationColumnStore::FindColumn(clause.Left(position).TrimStartAndEnd());
+					predicate.value = FCString::Atof(*clause.RightChop(position + FCString::Strlen(operators[i])).TrimStartAndEnd());
+				}
+			}
+
+			if (predicate.column == EMeditationColumn::Num)
+			{
+				UE_LOG(LogMeditation, Error, TEXT("Invalid clause '%s', expected <column><op><value> with a column among relaxationValue, bRelaxed, curZVelocity, altitude, phase"), *clause);
+				return false;
+			}
+			OutPredicates.Add(predicate);
+		}
+		return true;
+	}
+
+	struct FQueryOptions
+	{
+		TArray<FQueryPredicate> predicates;
+		float ascentVelocity = 5.f;
+		float minAltitude = 0.f;
+		float maxAltitude = 1.f;
+		int32 numBins = 20;
+	};
+
+	/** Aggregates of one session */
+	struct FSessionResult
+	{
+		bool bValid = false;
+		double duration = 0.0;
+		double relaxedTime = 0.0;
+		int32 flips = 0;
+		/** Time (s) between each relaxed flip and the ascent */
+		TArray<float> latencies;
+		float maxAltitude = 0.f;
+		/** Rows matching the predicates, and their sums */
+		int64 matchedRows = 0;
+		double sums[MeditationColumnStore::NumColumns] = {};
+		TArray<int64> histogram;
+	};
+
+	float HorizontalSum(VectorRegister4Float Vector)
+	{
+		alignas(16) float lanes[SimdWidth];
+		VectorStoreAligned(Vector, lanes);
+		return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+
+	FSessionResult ScanSession(FMeditationColumnReader& Reader, const FQueryOptions& Options)
+	{
+		using namespace MeditationColumnStore;
+		FSessionResult result;
+		result.histogram.SetNumZeroed(Options.numBins);
+		result.maxAltitude = -MAX_flt;
+
+		// Padded to whole vectors, the relaxed column keeps the last value of the previous chunk in front
+		TArray<float> columns[NumColumns];
+		for (TArray<float>& column : columns)
+			column.SetNumZeroed(ChunkRows + SimdWidth);
+		float* relaxed = columns[static_cast<int32>(EMeditationColumn::Relaxed)].GetData();
+
+		const VectorRegister4Float laneIndex = MakeVectorRegisterFloat(0.f, 1.f, 2.f, 3.f);
+		const VectorRegister4Float one = VectorSetFloat1(1.f);
+		const VectorRegister4Float ascentVelocity = VectorSetFloat1(Options.ascentVelocity);
+		const float binScale = Options.numBins / FMath::Max(Options.maxAltitude - Options.minAltitude, KINDA_SMALL_NUMBER);
+		const double samplePeriod = 1.0 / Reader.GetSampleRate();
+		// Row 0 of the relaxed column is at relaxed + 1
+		const auto columnData = [&columns, relaxed](EMeditationColumn Column) { return Column == EMeditationColumn::Relaxed ? relaxed + 1 : columns[static_cast<int32>(Column)].GetData(); };
+
+		int64 firstRow = 0;
+		int64 pendingFlipRow = INDEX_NONE;
+		for (int32 chunk = 0; chunk < Reader.GetNumChunks(); ++chunk)
+		{
+			const FMeditationChunkInfo& info = Reader.GetChunk(chunk);
+			const int32 numRows = info.numRows;
+			result.maxAltitude = FMath::Max(result.maxAltitude, info.max[static_cast<int32>(EMeditationColumn::Altitude)]);
+
+			bool bFiltered = true;
+			for (const FQueryPredicate& predicate : Options.predicates)
+				bFiltered &= predicate.CanMatch(info.min[static_cast<int32>(predicate.column)], info.max[static_cast<int32>(predicate.column)]);
+
+			// Only decode what this chunk needs
+			bool bNeeded[NumColumns] = {};
+			bNeeded[static_cast<int32>(EMeditationColumn::Relaxed)] = true;
+			bNeeded[static_cast<int32>(EMeditationColumn::ZVelocity)] = true;
+			if (bFiltered)
+			{
+				bNeeded[static_cast<int32>(EMeditationColumn::RelaxationValue)] = true;
+				bNeeded[static_cast<int32>(EMeditationColumn::Altitude)] = true;
+				for (const FQueryPredicate& predicate : Options.predicates)
+					bNeeded[static_cast<int32>(predicate.column)] = true;
+			}
+
+			const float previousRelaxed = chunk > 0 ? relaxed[ChunkRows] : -1.f;
+			for (int32 column = 0; column < NumColumns; ++column)
+			{
+				const EMeditationColumn id = static_cast<EMeditationColumn>(column);
+				if (bNeeded[column] && !Reader.ReadColumn(chunk, id, columnData(id)))
+					return result;
+			}
+			// A session starts with its own state, not with a flip
+			relaxed[0] = previousRelaxed >= 0.f ? previousRelaxed : relaxed[1];
+			const float lastRelaxed = relaxed[numRows];
+
+			const float* zVelocity = columnData(EMeditationColumn::ZVelocity);
+			const float* altitude = columnData(EMeditationColumn::Altitude);
+			VectorRegister4Float relaxedSum = VectorZeroFloat();
+			VectorRegister4Float matchedSum = VectorZeroFloat();
+			VectorRegister4Float sums[NumColumns] = { VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat(), VectorZeroFloat() };
+
+			for (int32 row = 0; row < numRows; row += SimdWidth)
+			{
+				const VectorRegister4Float valid = VectorCompareGT(VectorSetFloat1(static_cast<float>(numRows - row)), laneIndex);
+				const VectorRegister4Float state = VectorLoad(relaxed + 1 + row);
+				relaxedSum = VectorAdd(relaxedSum, VectorBitwiseAnd(state, valid));
+
+				const int32 flipBits = VectorMaskBits(VectorBitwiseAnd(VectorCompareNE(state, VectorLoad(relaxed + row)), valid));
+				const int32 ascentBits = VectorMaskBits(VectorBitwiseAnd(VectorCompareGE(VectorLoad(zVelocity + row), ascentVelocity), valid));
+				// Most rows neither flip nor end a pending ascent
+				if (flipBits != 0 || (pendingFlipRow != INDEX_NONE && ascentBits != 0))
+					for (int32 lane = 0; lane < SimdWidth; ++lane)
+					{
+						const int64 globalRow = firstRow + row + lane;
+						if (flipBits & (1 << lane))
+						{
+							++result.flips;
+							pendingFlipRow = relaxed[1 + row + lane] > .5f ? globalRow : INDEX_NONE;
+						}
+						if (pendingFlipRow != INDEX_NONE && (ascentBits & (1 << lane)))
+						{
+							result.latencies.Add(static_cast<float>((globalRow - pendingFlipRow) * samplePeriod));
+							pendingFlipRow = INDEX_NONE;
+						}
+					}
+
+				if (!bFiltered)
+					continue;
+
+				VectorRegister4Float match = valid;
+				for (const FQueryPredicate& predicate : Options.predicates)
+					match = VectorBitwiseAnd(match, predicate.Evaluate(VectorLoad(columnData(predicate.column) + row)));
+				const int32 matchBits = VectorMaskBits(match);
+				if (matchBits == 0)
+					continue;
+
+				matchedSum = VectorAdd(matchedSum, VectorBitwiseAnd(one, match));
+				for (EMeditationColumn column : { EMeditationColumn::RelaxationValue, EMeditationColumn::ZVelocity, EMeditationColumn::Altitude })
+					sums[static_cast<int32>(column)] = VectorAdd(sums[static_cast<int32>(column)], VectorBitwiseAnd(VectorLoad(columnData(column) + row), match));
+
+				for (int32 lane = 0; lane < SimdWidth; ++lane)
+					if (matchBits & (1 << lane))
+					{
+						const int32 bin = FMath::Clamp(FMath::FloorToInt((altitude[row + lane] - Options.minAltitude) * binScale), 0, Options.numBins - 1);
+						++result.histogram[bin];
+					}
+			}
+
+			// Lane sums stay exact within a chunk, sessions are accumulated in double
+			result.relaxedTime += HorizontalSum(relaxedSum) * samplePeriod;
+			result.matchedRows += FMath::RoundToInt(HorizontalSum(matchedSum));
+			for (int32 column = 0; column < NumColumns; ++column)
+				result.sums[column] += HorizontalSum(sums[column]);
+
+			relaxed[ChunkRows] = lastRelaxed;
+			firstRow += numRows;
+		}
+
+		result.duration = firstRow * samplePeriod;
+		result.bValid = firstRow > 0;
+		return result;
+	}
+
+	/** @param Values	Sorted values */
+	float Percentile(const TArray<float>& Values, float Fraction)
+	{
+		return Values.Num() > 0 ? Values[FMath::Clamp(FMath::FloorToInt(Fraction * (Values.Num() - 1) + .5f), 0, Values.Num() - 1)] : 0.f;
+	}
+
+	void MeanAndDeviation(const TArray<float>& Values, float& OutMean, float& OutDeviation)
+	{
+		double sum = 0.0;
+		double squares = 0.0;
+		for (float value : Values)
+		{
+			sum += value;
+			squares += static_cast<double>(value) * value;
+		}
+		const double mean = Values.Num() > 0 ? sum / Values.Num() : 0.0;
+		OutMean = static_cast<float>(mean);
+		OutDeviation = Values.Num() > 1 ? static_cast<float>(FMath::Sqrt(FMath::Max(0.0, (squares - sum * mean) / (Values.Num() - 1)))) : 0.f;
+	}
+}
+
+UMeditationQueryCommandlet::UMeditationQueryCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UMeditationQueryCommandlet::Main(const FString& Params)
+{
+	FString input = FPaths::ProjectSavedDir() / TEXT("Meditation") / TEXT("Sessions");
+	FString where;
+	FString csvPath;
+	FQueryOptions options;
+	FParse::Value(*Params, TEXT("In="), input);
+	FParse::Value(*Params, TEXT("Where="), where, false);
+	FParse::Value(*Params, TEXT("Csv="), csvPath);
+	FParse::Value(*Params, TEXT("AscentVelocity="), options.ascentVelocity);
+	FParse::Value(*Params, TEXT("Bins="), options.numBins);
+	options.numBins = FMath::Clamp(options.numBins, 1, 1000);
+	if (!ParsePredicates(where, options.predicates))
+		return 1;
+
+	TArray<FString> files;
+	IFileManager::Get().FindFilesRecursive(files, *input, TEXT("*.mcol"), true, false);
+
+	// Opening only reads the chunk indices, whose zone maps give the histogram range without decoding anything
+	TArray<TUniquePtr<FMeditationColumnReader>> readers;
+	TArray<FString> names;
+	options.minAltitude = MAX_flt;
+	options.maxAltitude = -MAX_flt;
+	for (const FString& file : files)
+	{
+		TUniquePtr<FMeditationColumnReader> reader = FMeditationColumnReader::Open(file);
+		if (!reader)
+		{
+			UE_LOG(LogMeditation, Warning, TEXT("Could not read %s"), *file);
+			continue;
+		}
+		for (int32 chunk = 0; chunk < reader->GetNumChunks(); ++chunk)
+		{
+			options.minAltitude = FMath::Min(options.minAltitude, reader->GetChunk(chunk).min[static_cast<int32>(EMeditationColumn::Altitude)]);
+			options.maxAltitude = FMath::Max(options.maxAltitude, reader->GetChunk(chunk).max[static_cast<int32>(EMeditationColumn::Altitude)]);
+		}
+		names.Add(FPaths::GetBaseFilename(file));
+		readers.Add(MoveTemp(reader));
+	}
+
+	if (readers.Num() == 0)
+	{
+		UE_LOG(LogMeditation, Error, TEXT("No session store found in %s"), *input);
+		return 1;
+	}
+
+	TArray<FSessionResult> results;
+	results.SetNum(readers.Num());
+	const double startTime = FPlatformTime::Seconds();
+	// Sessions have very different lengths, let the workers steal them one by one
+	ParallelFor(readers.Num(), [&](int32 Index)
+	{
+		results[Index] = ScanSession(*readers[Index], options);
+	}, EParallelForFlags::Unbalanced);
+	const double scanDuration = FPlatformTime::Seconds() - startTime;
+
+	TArray<float> relaxedFractions, flipRates, maxAltitudes, latencies;
+	TArray<int64> histogram;
+	histogram.SetNumZeroed(options.numBins);
+	double totalDuration = 0.0;
+	int64 totalRows = 0;
+	int64 matchedRows = 0;
+	double sums[MeditationColumnStore::NumColumns] = {};
+	FString csv = TEXT("session,participant,start,duration,relaxedFraction,flipsPerMinute,meanAscentLatency,maxAltitude,matchedFraction\n");
+	for (int32 i = 0; i < results.Num(); ++i)
+	{
+		const FSessionResult& result = results[i];
+		if (!result.bValid)
+		{
+			UE_LOG(LogMeditation, Warning, TEXT("Could not decode %s"), *names[i]);
+			continue;
+		}
+
+		totalDuration += result.duration;
+		totalRows += readers[i]->GetNumRows();
+		matchedRows += result.matchedRows;
+		for (int32 column = 0; column < MeditationColumnStore::NumColumns; ++column)
+			sums[column] += result.sums[column];
+		for (int32 bin = 0; bin < options.numBins; ++bin)
+			histogram[bin] += result.histogram[bin];
+		latencies.Append(result.latencies);
+
+		const float relaxedFraction = static_cast<float>(result.relaxedTime / result.duration);
+		const float flipRate = static_cast<float>(result.flips * 60.0 / result.duration);
+		float meanLatency, latencyDeviation;
+		MeanAndDeviation(result.latencies, meanLatency, latencyDeviation);
+		relaxedFractions.Add(relaxedFraction);
+		flipRates.Add(flipRate);
+		maxAltitudes.Add(result.maxAltitude);
+
+		csv += FString::Printf(TEXT("%s,%s,%s,%.1f,%.4f,%.3f,%.3f,%.1f,%.4f\n"), *names[i], *readers[i]->GetSessionName(), *readers[i]->GetStartTime().ToIso8601(),
+			result.duration, relaxedFraction, flipRate, meanLatency, result.maxAltitude, static_cast<double>(result.matchedRows) / readers[i]->GetNumRows());
+	}
+
+	UE_LOG(LogMeditation, Display, TEXT("%d sessions, %.1f h, %lld rows scanned in %.3f s (%.0f Mrows/s)"), relaxedFractions.Num(), totalDuration / 3600.0,
+		totalRows, scanDuration, totalRows / FMath::Max(scanDuration, 1e-6) * 1e-6);
+
+	float mean, deviation;
+	MeanAndDeviation(relaxedFractions, mean, deviation);
+	UE_LOG(LogMeditation, Display, TEXT("Time relaxed: %.1f%% +- %.1f%% per session"), mean * 100.f, deviation * 100.f);
+	MeanAndDeviation(flipRates, mean, deviation);
+	UE_LOG(LogMeditation, Display, TEXT("Flip rate: %.2f +- %.2f per minute"), mean, deviation);
+
+	latencies.Sort();
+	UE_LOG(LogMeditation, Display, TEXT("Ascent latency (curZVelocity >= %g after a relaxed flip): %d ascents, median %.2f s, p90 %.2f s"),
+		options.ascentVelocity, latencies.Num(), Percentile(latencies, .5f), Percentile(latencies, .9f));
+
+	maxAltitudes.Sort();
+	UE_LOG(LogMeditation, Display, TEXT("Max altitude per session: p10 %.0f, median %.0f, p90 %.0f"),
+		Percentile(maxAltitudes, .1f), Percentile(maxAltitudes, .5f), Percentile(maxAltitudes, .9f));
+
+	UE_LOG(LogMeditation, Display, TEXT("Rows matching '%s': %.1f%%, mean relaxationValue %.3f, curZVelocity %.2f, altitude %.1f"), *where,
+		100.0 * matchedRows / FMath::Max<int64>(totalRows, 1), sums[static_cast<int32>(EMeditationColumn::RelaxationValue)] / FMath::Max<int64>(matchedRows, 1),
+		sums[static_cast<int32>(EMeditationColumn::ZVelocity)] / FMath::Max<int64>(matchedRows, 1), sums[static_cast<int32>(EMeditationColumn::Altitude)] / FMath::Max<int64>(matchedRows, 1));
+
+	const float binWidth = (options.maxAltitude - options.minAltitude) / options.numBins;
+	for (int32 bin = 0; bin < options.numBins; ++bin)
+		UE_LOG(LogMeditation, Display, TEXT("  altitude [%7.0f, %7.0f): %5.1f%%"), options.minAltitude + bin * binWidth, options.minAltitude + (bin + 1) * binWidth,
+			100.0 * histogram[bin] / FMath::Max<int64>(matchedRows, 1));
+
+	if (!csvPath.IsEmpty())
+	{
+		if (!FFileHelper::SaveStringToFile(csv, *csvPath))
+		{
+			UE_LOG(LogMeditation, Error, TEXT("Could not write %s"), *csvPath);
+			return 1;
+		}
+		UE_LOG(LogMeditation, Display, TEXT("Per session results written to %s"), *csvPath);
+	}
+	return 0;
+}
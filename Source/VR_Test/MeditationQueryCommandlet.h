@@ -0,0 +1,25 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MeditationQueryCommandlet.generated.h"
+
+/**
+ * Aggregates every session store (.mcol, see FMeditationColumnWriter) of a directory into a study report, e.g.:
+ * UnrealEditor-Cmd VR_Test.uproject -run=MeditationQuery -nullrhi [-In=<dir>] [-Where="phase==1,altitude>50"] [-AscentVelocity=5] [-Bins=20] [-Csv=<file>]
+ * Per session: time relaxed, flip rate, max altitude, and latency between a relaxed flip and curZVelocity reaching -AscentVelocity.
+ * -Where is a conjunction of column/constant comparisons (<, <=, >, >=, ==, !=) selecting the rows of the altitude histogram and of the column means.
+ * Sessions are scanned in parallel and predicates four rows at a time. Chunks whose zone map cannot match the predicates only decode the flip and ascent columns.
+ */
+UCLASS()
+class UMeditationQueryCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UMeditationQueryCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
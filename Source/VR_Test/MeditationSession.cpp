@@ -0,0 +1,136 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationSession.h"
+
+#include "EEGCodec.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+bool FMeditationSession::LoadFromCsv(const FString& Path, int32 ValueColumn)
+{
+	TArray<FString> lines;
+	if (!FFileHelper::LoadFileToStringArray(lines, *Path))
+		return false;
+
+	name = FPaths::GetBaseFilename(Path);
+	times.Reset(lines.Num());
+	values.Reset(lines.Num());
+
+	TArray<FString> cells;
+	// First line is the header
+	for (int32 i = 1; i < lines.Num(); ++i)
+	{
+		lines[i].ParseIntoArray(cells, TEXT(","), false);
+		if (cells.Num() <= ValueColumn || cells[ValueColumn].IsEmpty())
+			continue;
+
+		times.Add(FCString::Atod(*cells[0]));
+		values.Add(FCString::Atof(*cells[ValueColumn]));
+	}
+
+	return values.Num() > 0;
+}
+
+bool FMeditationSession::LoadFromCodec(const FString& Path, int32 Channel)
+{
+	TUniquePtr<FEEGCodecReader> reader = FEEGCodecReader::Open(Path);
+	if (!reader || Channel < 0 || Channel >= reader->GetHeader().numChannels)
+		return false;
+
+	name = FPaths::GetBaseFilename(Path);
+	const int32 numChannels = reader->GetHeader().numChannels;
+	const double samplePeriod = 1.0 / reader->GetHeader().sampleRate;
+	const int32 numFrames = static_cast<int32>(reader->GetNumFrames());
+	times.SetNumUninitialized(numFrames);
+	values.SetNumUninitialized(numFrames);
+
+	// Decode one block worth of frames at a time
+	TArray<double> frames;
+	frames.SetNumUninitialized(reader->GetHeader().blockSize * numChannels);
+	for (int32 frame = 0; frame < numFrames;)
+	{
+		const int32 count = reader->Read(frames.GetData(), reader->GetHeader().blockSize);
+		if (count == 0)
+			return false;
+
+		for (int32 i = 0; i < count; ++i, ++frame)
+		{
+			times[frame] = frame * samplePeriod;
+			values[frame] = static_cast<float>(frames[i * numChannels + Channel]);
+		}
+	}
+
+	return numFrames > 0;
+}
+
+double FMeditationSession::GetDuration() const
+{
+	return times.Num() > 0 ? times.Last() - times[0] : 0.0;
+}
+
+FMeditationReplayResult FMeditationReplay::Run(const FMeditationData& Params, const FMeditationSession& Session, float TickRate, float FalseFlipWindow)
+{
+	FMeditationReplayResult result;
+	if (Session.values.Num() == 0)
+		return result;
+
+	FMeditationData md = Params;
+	md.m_meditationValues.Empty();
+	md.relaxationInterpTime = 0.f;
+	md.currAvg = md.prevAvg = 0.f;
+	md.relaxationValue = 0.f;
+	md.curZVelocity = 0.f;
+	md.bRelaxed = false;
+	md.Init();
+	md.SetInterpDuration(md.interpDuration);
+
+	const float deltaTime = 1.f / TickRate;
+	const double startTime = Session.times[0];
+	// Let the last value settle before stopping
+	const double endTime = Session.times.Last() + md.interpDuration;
+	double time = startTime;
+	double lastFlipTime = -DBL_MAX;
+	float altitude = 0.f;
+	double squaredAccelerationSum = 0.0;
+	result.timeToRise = -1.f;
+
+	for (int32 next = 0; time <= endTime; time += deltaTime)
+	{
+		// Values are registered and averaged as they arrive, like the Blueprint does with the sensor values
+		for (; next < Session.values.Num() && Session.times[next] <= time; ++next)
+		{
+			md.RegisterValue(Session.values[next]);
+			md.ComputeAvg();
+		}
+
+		md.LerpRelaxation(deltaTime);
+		if (md.ShouldChangeState())
+		{
+			md.ChangeState();
+			if (time - lastFlipTime < FalseFlipWindow)
+				++result.falseFlips;
+			lastFlipTime = time;
+			++result.flips;
+		}
+
+		// Same as AVRPawn::UpdateUpVelocity, the ground being at altitude 0
+		if (md.bRelaxed || altitude > 0.f)
+		{
+			const float prevZVelocity = md.curZVelocity;
+			md.InterpZVelocity(deltaTime);
+			altitude = FMath::Max(0.f, altitude + md.curZVelocity * deltaTime);
+			squaredAccelerationSum += FMath::Square((md.curZVelocity - prevZVelocity) / deltaTime) * deltaTime;
+		}
+
+		if (result.timeToRise < 0.f && md.bRelaxed && md.curZVelocity >= md.riseVelocity)
+			result.timeToRise = time - startTime;
+	}
+
+	const double duration = endTime - startTime;
+	if (result.timeToRise < 0.f)
+		result.timeToRise = duration;
+	result.roughness = duration > 0.0 ? squaredAccelerationSum / duration : 0.f;
+
+	return result;
+}
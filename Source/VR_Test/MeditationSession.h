@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VRPawn.h"
+
+/** Meditation values received during a recorded session, along with their reception time. */
+struct VR_TEST_API FMeditationSession
+{
+	FString name;
+	/** Reception time of each value, in seconds */
+	TArray<double> times;
+	TArray<float> values;
+
+	/**
+	 * Loads a session recorded by OpenViBE's "CSV File Writer" box (first column is the time, then one column per channel).
+	 * @param Path			CSV file path
+	 * @param ValueColumn	Index of the column holding the meditation value
+	 * @return				False if the file could not be read or holds no value.
+	 */
+	bool LoadFromCsv(const FString& Path, int32 ValueColumn);
+	/**
+	 * Loads one channel of a session archived with FEEGCodecWriter. Times are given back by the sample rate.
+	 * @param Path			.eegc file path
+	 * @param Channel		Channel holding the meditation value
+	 * @return				False if the file could not be read or holds no value.
+	 */
+	bool LoadFromCodec(const FString& Path, int32 Channel);
+	double GetDuration() const;
+};
+
+/** Objectives measured on a replayed session. All of them should be minimised. */
+struct FMeditationReplayResult
+{
+	/** Time (s) until the rise velocity is reached for the first time. Session duration if never reached */
+	float timeToRise = 0.f;
+	/** Number of state flips reverted in less than the false flip window */
+	int32 falseFlips = 0;
+	/** Total number of state flips */
+	int32 flips = 0;
+	/** Mean squared vertical acceleration, the lower the smoother curZVelocity is */
+	float roughness = 0.f;
+};
+
+/**
+ * Replays recorded sessions through FMeditationData, the same way AVRPawn does during the rise steps, without any world or rendering.
+ */
+struct VR_TEST_API FMeditationReplay
+{
+	/**
+	 * @param Params			Meditation parameters to evaluate. Runtime state is reset before replaying
+	 * @param Session			Session to replay
+	 * @param TickRate			Simulated frame rate
+	 * @param FalseFlipWindow	A flip followed by another one in less than this duration (s) is considered as false
+	 * @return					Measured objectives
+	 */
+	static FMeditationReplayResult Run(const FMeditationData& Params, const FMeditationSession& Session, float TickRate, float FalseFlipWindow);
+};
@@ -0,0 +1,79 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationSnapshot.h"
+
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "VRPawn.h"
+
+void FMeditationSnapshot::Capture(const FMeditationData& Data, const FRiemannClassifier& Classifier)
+{
+	magic = Magic;
+	version = Version;
+	savedUtcTicks = FDateTime::UtcNow().GetTicks();
+
+	windowSize = FMath::Min(Data.m_meditationValues.Num(), MaxWindowSize);
+	for (int32 i = 0; i < windowSize; ++i)
+		window[i] = Data.m_meditationValues[i];
+	currAvg = Data.currAvg;
+	prevAvg = Data.prevAvg;
+	bRelaxed = Data.bRelaxed;
+
+	classifier = Classifier.GetCalibration();
+}
+
+void FMeditationSnapshot::Restore(FMeditationData& Data, FRiemannClassifier& Classifier, float DecayTime) const
+{
+	const double elapsed = FMath::Max(0.0, (FDateTime::UtcNow() - FDateTime(savedUtcTicks)).GetTotalSeconds());
+	const float weight = static_cast<float>(FMath::Exp(-elapsed / FMath::Max(DecayTime, KINDA_SMALL_NUMBER)));
+	const float neutral = Data.relaxedThreshold;
+	auto decay = [&](float Value) { return neutral + (Value - neutral) * weight; };
+
+	// The window may have been resized since, missing values are neutral
+	for (int32 i = 0; i < Data.m_meditationValues.Num(); ++i)
+		Data.m_meditationValues[i] = i < windowSize ? decay(window[i]) : neutral;
+
+	Data.currAvg = decay(currAvg);
+	Data.prevAvg = decay(prevAvg);
+	Data.relaxationValue = Data.currAvg;
+	// Once mostly decayed the saved state does not mean anything anymore, start unrelaxed as without snapshot
+	Data.bRelaxed = bRelaxed && weight > .5f;
+	Data.targetZVelocity = Data.bRelaxed ? Data.riseVelocity : Data.fallVelocity;
+	// Interpolation is already over, the restored value holds until the next one
+	Data.relaxationInterpTime = 1.f;
+
+	if (classifier.bCalibrated)
+		Classifier.SetCalibration(classifier);
+}
+
+FString FMeditationSnapshot::GetPath(const FString& ParticipantId)
+{
+	return FPaths::ProjectSavedDir() / TEXT("Meditation") / FPaths::MakeValidFileName(ParticipantId) + TEXT(".medsnap");
+}
+
+bool FMeditationSnapshot::Load(const FString& ParticipantId, FMeditationSnapshot& OutSnapshot)
+{
+	IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+	const FString path = GetPath(ParticipantId);
+	if (platformFile.FileSize(*path) != sizeof(FMeditationSnapshot))
+		return false;
+
+	TUniquePtr<IMappedFileHandle> handle(platformFile.OpenMapped(*path));
+	if (!handle)
+		return false;
+	TUniquePtr<IMappedFileRegion> region(handle->MapRegion(0, sizeof(FMeditationSnapshot)));
+	if (!region)
+		return false;
+
+	FMemory::Memcpy(&OutSnapshot, region->GetMappedPtr(), sizeof(FMeditationSnapshot));
+	return OutSnapshot.magic == Magic && OutSnapshot.version == Version
+		&& OutSnapshot.windowSize >= 0 && OutSnapshot.windowSize <= MaxWindowSize;
+}
+
+bool FMeditationSnapshot::Save(const FString& ParticipantId) const
+{
+	return FFileHelper::SaveArrayToFile(TArrayView<const uint8>(reinterpret_cast<const uint8*>(this), sizeof(FMeditationSnapshot)), *GetPath(ParticipantId));
+}
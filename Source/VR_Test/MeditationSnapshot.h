@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RiemannClassifier.h"
+
+struct FMeditationData;
+
+/**
+ * Meditation state of a participant persisted between sessions, so that a new session starts from the last known state instead of a window of zeros.
+ * Plain data written as is, so loading is a single memory mapping of about 5.5 KB, mostly the six classifier calibration matrices.
+ */
+struct VR_TEST_API FMeditationSnapshot
+{
+	static constexpr uint32 Magic = 0x4E534D4D;	// "MMSN"
+	static constexpr uint32 Version = 3;
+	static constexpr int32 MaxWindowSize = 64;
+
+	uint32 magic = Magic;
+	uint32 version = Version;
+	/** FDateTime::UtcNow() ticks when the snapshot was taken */
+	int64 savedUtcTicks = 0;
+
+	/** m_meditationValues, most recent first */
+	int32 windowSize = 0;
+	float window[MaxWindowSize] = {};
+	float currAvg = 0.f;
+	float prevAvg = 0.f;
+	uint8 bRelaxed = 0;
+
+	/** Class means of the relaxation classifier, calibration does not decay */
+	FRiemannClassifier::FCalibration classifier;
+
+	/**
+	 * Captures the current state of the meditation data and classifier.
+	 * @param Data			Meditation data
+	 * @param Classifier	Relaxation classifier
+	 */
+	void Capture(const FMeditationData& Data, const FRiemannClassifier& Classifier);
+	/**
+	 * Restores the state into the meditation data and classifier. Values decay towards the relaxed threshold (neutral) with the time elapsed since the snapshot.
+	 * @param Data			Initialised meditation data
+	 * @param Classifier	Set up relaxation classifier
+	 * @param DecayTime		Time constant (s) of the exponential decay
+	 */
+	void Restore(FMeditationData& Data, FRiemannClassifier& Classifier, float DecayTime) const;
+
+	/**
+	 * @param ParticipantId	Participant identifier
+	 * @return				Snapshot file of the participant
+	 */
+	static FString GetPath(const FString& ParticipantId);
+	/**
+	 * Memory maps the participant snapshot and copies it.
+	 * @param ParticipantId	Participant identifier
+	 * @param OutSnapshot	Loaded snapshot
+	 * @return				False if there is no valid snapshot for the participant
+	 */
+	static bool Load(const FString& ParticipantId, FMeditationSnapshot& OutSnapshot);
+	/**
+	 * @param ParticipantId	Participant identifier
+	 * @return				False if the snapshot could not be written
+	 */
+	bool Save(const FString& ParticipantId) const;
+};
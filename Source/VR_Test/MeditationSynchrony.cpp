@@ -0,0 +1,425 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationSynchrony.h"
+
+#include "Async/ParallelFor.h"
+#include "VRPawn.h"
+#include "VR_Test.h"
+
+namespace
+{
+	constexpr int32 N = FMeditationSynchronyEngine::MaxParticipants;
+	constexpr int32 B = FMeditationSynchronyEngine::BlockSize;
+	/** Below this many pair updates per batch, waking the workers costs more than the updates */
+	constexpr int64 GParallelPairUpdates = 16 * 1024;
+}
+
+FMeditationSynchronyEngine::FMeditationSynchronyEngine()
+{
+	for (int64& age : m_ages)
+		age = INDEX_NONE;
+	Setup(m_windowLength, m_phaseWeight);
+}
+
+void FMeditationSynchronyEngine::Setup(int32 WindowLength, float PhaseWeight)
+{
+	m_windowLength = FMath::Max(WindowLength, 2);
+	m_phaseWeight = FMath::Clamp(PhaseWeight, 0.f, 1.f);
+	m_values.SetNumZeroed(m_windowLength * N);
+	m_cos.SetNumZeroed(m_windowLength * N);
+	m_sin.SetNumZeroed(m_windowLength * N);
+	m_position = 0;
+
+	m_tiles.Reset();
+	for (int32 row = 0; row < NumBlocks; ++row)
+		for (int32 column = row; column < NumBlocks; ++column)
+		{
+			FTile& tile = m_tiles.AddZeroed_GetRef();
+			tile.rowBlock = row;
+			tile.columnBlock = column;
+		}
+
+	// Everyone starts over with the new window
+	for (int32 slot = 0; slot < N; ++slot)
+		if (m_ages[slot] != INDEX_NONE)
+			Join(slot);
+}
+
+void FMeditationSynchronyEngine::Join(int32 Slot)
+{
+	m_ages[Slot] = 0;
+	m_sums[Slot] = 0.0;
+	m_squares[Slot] = 0.0;
+	m_bValid[Slot] = false;
+	m_participantSynchrony[Slot] = 0.f;
+	for (int32 sample = 0; sample < m_windowLength; ++sample)
+	{
+		m_values[sample * N + Slot] = 0.f;
+		m_cos[sample * N + Slot] = 0.f;
+		m_sin[sample * N + Slot] = 0.f;
+	}
+
+	// Pairs of the slot: a row of the tiles of its block row, a column of the tiles of its block column
+	const int32 block = Slot / B;
+	const int32 local = Slot % B;
+	for (FTile& tile : m_tiles)
+	{
+		if (tile.rowBlock == block)
+			for (int32 column = 0; column < B; ++column)
+			{
+				tile.products[local * B + column] = 0.0;
+				tile.phaseCos[local * B + column] = 0.0;
+				tile.phaseSin[local * B + column] = 0.0;
+			}
+		if (tile.columnBlock == block)
+			for (int32 row = 0; row < B; ++row)
+			{
+				tile.products[row * B + local] = 0.0;
+				tile.phaseCos[row * B + local] = 0.0;
+				tile.phaseSin[row * B + local] = 0.0;
+			}
+	}
+}
+
+void FMeditationSynchronyEngine::Leave(int32 Slot)
+{
+	Join(Slot);
+	m_ages[Slot] = INDEX_NONE;
+}
+
+void FMeditationSynchronyEngine::AddSamples(const float* Values, const float* Phases, int32 NumSamples)
+{
+	if (NumSamples <= 0)
+		return;
+
+	const uint32 startCycles = FPlatformTime::Cycles();
+	for (int32 buffer = 0; buffer < 3; ++buffer)
+	{
+		m_batchIn[buffer].SetNumUninitialized(NumSamples * N, false);
+		m_batchOut[buffer].SetNumUninitialized(NumSamples * N, false);
+	}
+
+	// Per participant part, O(N) per sample: swap the samples in the ring and keep what the pairs need
+	for (int32 sample = 0; sample < NumSamples; ++sample)
+	{
+		const int32 ring = m_position * N;
+		const int32 batch = sample * N;
+		for (int32 slot = 0; slot < N; ++slot)
+		{
+			float value = 0.f, cos = 0.f, sin = 0.f;
+			if (m_ages[slot] != INDEX_NONE)
+			{
+				value = Values[batch + slot];
+				if (Phases)
+					FMath::SinCos(&sin, &cos, Phases[batch + slot]);
+				++m_ages[slot];
+			}
+
+			const float outgoing = m_values[ring + slot];
+			m_sums[slot] += static_cast<double>(value) - outgoing;
+			m_squares[slot] += static_cast<double>(value) * value - static_cast<double>(outgoing) * outgoing;
+
+			m_batchIn[0][batch + slot] = value;
+			m_batchIn[1][batch + slot] = cos;
+			m_batchIn[2][batch + slot] = sin;
+			m_batchOut[0][batch + slot] = outgoing;
+			m_batchOut[1][batch + slot] = m_cos[ring + slot];
+			m_batchOut[2][batch + slot] = m_sin[ring + slot];
+			m_values[ring + slot] = value;
+			m_cos[ring + slot] = cos;
+			m_sin[ring + slot] = sin;
+		}
+		m_position = (m_position + 1) % m_windowLength;
+	}
+
+	for (int32 slot = 0; slot < N; ++slot)
+		m_bValid[slot] = m_ages[slot] >= m_windowLength;
+
+	// Pair part, O(N^2) per sample, tile by tile
+	const int64 pairUpdates = static_cast<int64>(NumSamples) * N * (N - 1) / 2;
+	ParallelFor(m_tiles.Num(), [this](int32 Index)
+	{
+		UpdateTile(m_tiles[Index]);
+	}, pairUpdates < GParallelPairUpdates ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+	double synchronySum = 0.0;
+	int32 validPairs = 0;
+	double participantSums[N] = {};
+	int32 participantPairs[N] = {};
+	for (const FTile& tile : m_tiles)
+	{
+		synchronySum += tile.synchronySum;
+		validPairs += tile.validPairs;
+		for (int32 local = 0; local < B; ++local)
+		{
+			participantSums[tile.rowBlock * B + local] += tile.participantSums[0][local];
+			participantPairs[tile.rowBlock * B + local] += tile.participantPairs[0][local];
+			participantSums[tile.columnBlock * B + local] += tile.participantSums[1][local];
+			participantPairs[tile.columnBlock * B + local] += tile.participantPairs[1][local];
+		}
+	}
+
+	m_groupSynchrony = validPairs > 0 ? static_cast<float>(synchronySum / validPairs) : 0.f;
+	for (int32 slot = 0; slot < N; ++slot)
+		m_participantSynchrony[slot] = participantPairs[slot] > 0 ? static_cast<float>(participantSums[slot] / participantPairs[slot]) : 0.f;
+
+	m_updateCycles += FPlatformTime::Cycles() - startCycles;
+	m_pairUpdates += pairUpdates;
+}
+
+void FMeditationSynchronyEngine::UpdateTile(FTile& Tile) const
+{
+	const int32 firstRow = Tile.rowBlock * B;
+	const int32 firstColumn = Tile.columnBlock * B;
+	const bool bDiagonal = Tile.rowBlock == Tile.columnBlock;
+
+	Tile.synchronySum = 0.0;
+	Tile.validPairs = 0;
+	FMemory::Memzero(Tile.participantSums, sizeof(Tile.participantSums));
+	FMemory::Memzero(Tile.participantPairs, sizeof(Tile.participantPairs));
+
+	// Skip blocks nobody plays in, their sums stay zero
+	bool bRowActive = false, bColumnActive = false;
+	for (int32 local = 0; local < B; ++local)
+	{
+		bRowActive |= m_ages[firstRow + local] != INDEX_NONE;
+		bColumnActive |= m_ages[firstColumn + local] != INDEX_NONE;
+	}
+	if (!bRowActive || !bColumnActive)
+		return;
+
+	const int32 numSamples = m_batchIn[0].Num() / N;
+	for (int32 sample = 0; sample < numSamples; ++sample)
+	{
+		const int32 batch = sample * N;
+		const float* valuesIn = m_batchIn[0].GetData() + batch + firstColumn;
+		const float* cosIn = m_batchIn[1].GetData() + batch + firstColumn;
+		const float* sinIn = m_batchIn[2].GetData() + batch + firstColumn;
+		const float* valuesOut = m_batchOut[0].GetData() + batch + firstColumn;
+		const float* cosOut = m_batchOut[1].GetData() + batch + firstColumn;
+		const float* sinOut = m_batchOut[2].GetData() + batch + firstColumn;
+
+		for (int32 row = 0; row < B; ++row)
+		{
+			const int32 i = batch + firstRow + row;
+			const float xIn = m_batchIn[0][i], cIn = m_batchIn[1][i], sIn = m_batchIn[2][i];
+			const float xOut = m_batchOut[0][i], cOut = m_batchOut[1][i], sOut = m_batchOut[2][i];
+			double* products = Tile.products + row * B;
+			double* phaseCos = Tile.phaseCos + row * B;
+			double* phaseSin = Tile.phaseSin + row * B;
+
+			// Contiguous columns, vectorised by the compiler. cos(a - b) = cos a cos b + sin a sin b, sin(a - b) = sin a cos b - cos a sin b
+			// A term leaves the sums with the exact float it entered with, so nothing drifts however long the session
+			for (int32 column = bDiagonal ? row + 1 : 0; column < B; ++column)
+			{
+				products[column] += static_cast<double>(xIn * valuesIn[column]) - static_cast<double>(xOut * valuesOut[column]);
+				phaseCos[column] += static_cast<double>(cIn * cosIn[column] + sIn * sinIn[column]) - static_cast<double>(cOut * cosOut[column] + sOut * sinOut[column]);
+				phaseSin[column] += static_cast<double>(sIn * cosIn[column] - cIn * sinIn[column]) - static_cast<double>(sOut * cosOut[column] - cOut * sinOut[column]);
+			}
+		}
+	}
+
+	for (int32 row = 0; row < B; ++row)
+		for (int32 column = bDiagonal ? row + 1 : 0; column < B; ++column)
+		{
+			if (!m_bValid[firstRow + row] || !m_bValid[firstColumn + column])
+				continue;
+
+			const double synchrony = GetPairSynchrony(Tile, firstRow + row, firstColumn + column);
+			Tile.synchronySum += synchrony;
+			++Tile.validPairs;
+			Tile.participantSums[0][row] += synchrony;
+			++Tile.participantPairs[0][row];
+			Tile.participantSums[1][column] += synchrony;
+			++Tile.participantPairs[1][column];
+		}
+}
+
+int32 FMeditationSynchronyEngine::GetTileIndex(int32 RowBlock, int32 ColumnBlock)
+{
+	// Upper triangle, row after row
+	return RowBlock * NumBlocks - RowBlock * (RowBlock - 1) / 2 + ColumnBlock - RowBlock;
+}
+
+void FMeditationSynchronyEngine::GetPairStats(const FTile& Tile, int32 SlotA, int32 SlotB, double& OutCorrelation, double& OutPhaseLocking) const
+{
+	const int32 pair = (SlotA % B) * B + SlotB % B;
+	const double n = m_windowLength;
+	const double covariance = n * Tile.products[pair] - m_sums[SlotA] * m_sums[SlotB];
+	const double varianceA = n * m_squares[SlotA] - m_sums[SlotA] * m_sums[SlotA];
+	const double varianceB = n * m_squares[SlotB] - m_sums[SlotB] * m_sums[SlotB];
+	// A flat signal is not correlated with anything
+	OutCorrelation = varianceA > DOUBLE_SMALL_NUMBER && varianceB > DOUBLE_SMALL_NUMBER
+		? FMath::Clamp(covariance / FMath::Sqrt(varianceA * varianceB), -1.0, 1.0) : 0.0;
+	OutPhaseLocking = FMath::Min(FMath::Sqrt(FMath::Square(Tile.phaseCos[pair]) + FMath::Square(Tile.phaseSin[pair])) / n, 1.0);
+}
+
+double FMeditationSynchronyEngine::GetPairSynchrony(const FTile& Tile, int32 SlotA, int32 SlotB) const
+{
+	double correlation, phaseLocking;
+	GetPairStats(Tile, SlotA, SlotB, correlation, phaseLocking);
+	// Anti-correlated meditators are not in sync
+	return (1.0 - m_phaseWeight) * FMath::Max(correlation, 0.0) + m_phaseWeight * phaseLocking;
+}
+
+bool FMeditationSynchronyEngine::GetPair(int32 SlotA, int32 SlotB, double& OutCorrelation, double& OutPhaseLocking) const
+{
+	if (SlotA == SlotB || !m_bValid[SlotA] || !m_bValid[SlotB])
+		return false;
+	if (SlotA > SlotB)
+		Swap(SlotA, SlotB);
+
+	GetPairStats(m_tiles[GetTileIndex(SlotA / B, SlotB / B)], SlotA, SlotB, OutCorrelation, OutPhaseLocking);
+	return true;
+}
+
+float FMeditationSynchronyEngine::GetCorrelation(int32 SlotA, int32 SlotB) const
+{
+	double correlation, phaseLocking;
+	return GetPair(SlotA, SlotB, correlation, phaseLocking) ? static_cast<float>(correlation) : 0.f;
+}
+
+float FMeditationSynchronyEngine::GetPhaseLocking(int32 SlotA, int32 SlotB) const
+{
+	double correlation, phaseLocking;
+	return GetPair(SlotA, SlotB, correlation, phaseLocking) ? static_cast<float>(phaseLocking) : 0.f;
+}
+
+double FMeditationSynchronyEngine::GetPairUpdateCost() const
+{
+	return m_pairUpdates > 0 ? FPlatformTime::ToSeconds64(m_updateCycles) / m_pairUpdates : 0.0;
+}
+
+bool UMeditationSynchronySubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* world = Cast<UWorld>(Outer);
+	return world && world->IsGameWorld() && Super::ShouldCreateSubsystem(Outer);
+}
+
+void UMeditationSynchronySubsystem::Deinitialize()
+{
+	if (m_numPawns > 0 || m_engine.GetPairUpdateCost() > 0.0)
+		UE_LOG(LogMeditation, Log, TEXT("Synchrony: %.2f ns per pair update"), m_engine.GetPairUpdateCost() * 1e9);
+	Super::Deinitialize();
+}
+
+TStatId UMeditationSynchronySubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMeditationSynchronySubsystem, STATGROUP_Tickables);
+}
+
+bool UMeditationSynchronySubsystem::Register(AVRPawn* Pawn, const FMeditationSynchronySettings& Settings)
+{
+	if (m_numPawns == 0)
+	{
+		m_sampleRate = Settings.sampleRate;
+		m_sampleTime = 0.f;
+		m_engine.Setup(FMath::CeilToInt(Settings.windowDuration * Settings.sampleRate), Settings.phaseWeight);
+
+		// RBJ constant 0 dB peak gain band-pass, one octave wide
+		const float w0 = 2.f * PI * FMath::Min(Settings.phaseBand, Settings.sampleRate * .4f) / Settings.sampleRate;
+		const float alpha = FMath::Sin(w0) / (2.f * 1.4142f);
+		const float a0 = 1.f + alpha;
+		m_b0 = alpha / a0;
+		m_b2 = -alpha / a0;
+		m_a1 = -2.f * FMath::Cos(w0) / a0;
+		m_a2 = (1.f - alpha) / a0;
+		m_cosOmega = FMath::Cos(w0);
+		m_sinOmega = FMath::Sin(w0);
+
+		// Values and phases of a second of samples, the most a tick samples
+		const int32 frameBytes = FMath::CeilToInt(Settings.sampleRate) * N * static_cast<int32>(sizeof(float));
+		m_frameArena = FEEGFrameArena(2 * (frameBytes + 16));
+	}
+
+	for (int32 slot = 0; slot < FMeditationSynchronyEngine::MaxParticipants; ++slot)
+		if (m_pawns[slot].IsExplicitlyNull())
+		{
+			m_pawns[slot] = Pawn;
+			m_phases[slot] = FPhaseTracker();
+			m_engine.Join(slot);
+			++m_numPawns;
+			return true;
+		}
+
+	UE_LOG(LogMeditation, Warning, TEXT("Synchrony: more than %d meditators, %s is left out"), FMeditationSynchronyEngine::MaxParticipants, *Pawn->GetName());
+	return false;
+}
+
+void UMeditationSynchronySubsystem::Unregister(AVRPawn* Pawn)
+{
+	for (int32 slot = 0; slot < FMeditationSynchronyEngine::MaxParticipants; ++slot)
+		if (m_pawns[slot] == Pawn)
+		{
+			m_pawns[slot].Reset();
+			m_engine.Leave(slot);
+			--m_numPawns;
+		}
+	if (m_numPawns < 2)
+		ResetSynchrony();
+}
+
+void UMeditationSynchronySubsystem::ResetSynchrony()
+{
+	for (int32 slot = 0; slot < N; ++slot)
+		if (AVRPawn* pawn = m_pawns[slot].Get())
+			pawn->SetSynchrony(0.f, 0.f);
+}
+
+void UMeditationSynchronySubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	if (m_numPawns < 2)
+	{
+		ResetSynchrony();
+		return;
+	}
+
+	// Same value repeated for every sample period elapsed, at most a second after a hitch
+	m_sampleTime += DeltaTime;
+	const int32 numSamples = FMath::Min(FMath::FloorToInt(m_sampleTime * m_sampleRate), FMath::CeilToInt(m_sampleRate));
+	m_sampleTime = FMath::Min(m_sampleTime - numSamples / m_sampleRate, 1.f / m_sampleRate);
+	if (numSamples == 0)
+		return;
+
+	m_frameArena.Reset();
+	float* values = m_frameArena.Alloc<float>(numSamples * N);
+	float* phases = m_frameArena.Alloc<float>(numSamples * N);
+	FMemory::Memzero(values, numSamples * N * sizeof(float));
+	FMemory::Memzero(phases, numSamples * N * sizeof(float));
+	for (int32 slot = 0; slot < N; ++slot)
+	{
+		const AVRPawn* pawn = m_pawns[slot].Get();
+		if (!pawn)
+		{
+			// Destroyed without EndPlay
+			if (!m_pawns[slot].IsExplicitlyNull())
+			{
+				m_pawns[slot].Reset();
+				m_engine.Leave(slot);
+				--m_numPawns;
+			}
+			continue;
+		}
+
+		FPhaseTracker& tracker = m_phases[slot];
+		const float value = pawn->GetRelaxationValue();
+		for (int32 sample = 0; sample < numSamples; ++sample)
+		{
+			// For a narrow band signal y[n] = A cos(phi), y[n - 1] = A cos(phi - w0) gives A sin(phi) = (y[n - 1] - y[n] cos(w0)) / sin(w0)
+			const float filtered = m_b0 * value + tracker.z1;
+			tracker.z1 = tracker.z2 - m_a1 * filtered;
+			tracker.z2 = m_b2 * value - m_a2 * filtered;
+			values[sample * N + slot] = value;
+			phases[sample * N + slot] = FMath::Atan2((tracker.previous - filtered * m_cosOmega) / m_sinOmega, filtered);
+			tracker.previous = filtered;
+		}
+	}
+
+	m_engine.AddSamples(values, phases, numSamples);
+
+	for (int32 slot = 0; slot < N; ++slot)
+		if (AVRPawn* pawn = m_pawns[slot].Get())
+			pawn->SetSynchrony(m_engine.GetGroupSynchrony(), m_engine.GetParticipantSynchrony(slot));
+}
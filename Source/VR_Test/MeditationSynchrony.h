@@ -0,0 +1,184 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EEGSampleBlock.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "MeditationSynchrony.generated.h"
+
+USTRUCT(BlueprintType)
+struct FMeditationSynchronySettings
+{
+	GENERATED_BODY()
+
+	/** Measure the synchrony of the meditators of a networked session, on the server */
+	UPROPERTY(EditAnywhere, Category = "Synchrony")
+	bool bEnabled = false;
+	/** Rate at which the relaxation values are sampled */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1"), Category = "Synchrony")
+	float sampleRate = 30.f;
+	/** Duration (s) of the sliding window */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1"), Category = "Synchrony")
+	float windowDuration = 20.f;
+	/** Center frequency (Hz) of the relaxation oscillations whose phases are compared, around breathing rates */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0.01"), Category = "Synchrony")
+	float phaseBand = .1f;
+	/** Weight of the phase locking value in the synchrony, the correlation has the rest */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0", ClampMax="1"), Category = "Synchrony")
+	float phaseWeight = .5f;
+	/** Relative rise velocity gained at full group synchrony */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0"), Category = "Synchrony")
+	float riseGain = .5f;
+};
+
+/**
+ * Sliding window synchrony between every pair of up to MaxParticipants signals: Pearson correlation of the values and phase locking value of the phases.
+ *
+ * Each pair keeps the window sums of x_i * x_j, cos(phi_i - phi_j) and sin(phi_i - phi_j), updated in O(1) per sample by adding the incoming product and
+ * subtracting the outgoing one. The differences of phases are expanded into products of the per participant cos/sin, so nothing trigonometric runs per pair.
+ * Pairs are stored in BlockSize x BlockSize tiles of the upper triangle, a batch of samples updates tile after tile so that the rows and columns of a
+ * tile stay in cache, and the tiles of a large batch are spread over the task graph workers.
+ *
+ * Joining slots start from zeroed history, their pairs become valid once both participants have been present for a whole window.
+ */
+class VR_TEST_API FMeditationSynchronyEngine
+{
+public:
+	static constexpr int32 MaxParticipants = 64;
+	static constexpr int32 BlockSize = 16;
+	static constexpr int32 NumBlocks = MaxParticipants / BlockSize;
+
+private:
+	/** Window sums of a tile, pair (i, j) at [(i % BlockSize) * BlockSize + j % BlockSize] */
+	struct FTile
+	{
+		double products[BlockSize * BlockSize];
+		double phaseCos[BlockSize * BlockSize];
+		double phaseSin[BlockSize * BlockSize];
+		int32 rowBlock;
+		int32 columnBlock;
+		/** Results of the last update */
+		double synchronySum;
+		int32 validPairs;
+		double participantSums[2][BlockSize];
+		int32 participantPairs[2][BlockSize];
+	};
+
+	int32 m_windowLength = 1;
+	float m_phaseWeight = .5f;
+	/** Samples of the window, ring of m_windowLength frames of MaxParticipants values */
+	TArray<float> m_values;
+	TArray<float> m_cos;
+	TArray<float> m_sin;
+	int32 m_position = 0;
+	/** Per participant window sums */
+	double m_sums[MaxParticipants] = {};
+	double m_squares[MaxParticipants] = {};
+	/** Samples since each participant joined, INDEX_NONE for free slots */
+	int64 m_ages[MaxParticipants];
+	TArray<FTile> m_tiles;
+
+	/** Incoming and outgoing samples of the batch being processed, [sample][participant] */
+	TArray<float> m_batchIn[3];
+	TArray<float> m_batchOut[3];
+	/** Participants valid at the end of the batch */
+	bool m_bValid[MaxParticipants] = {};
+
+	float m_groupSynchrony = 0.f;
+	float m_participantSynchrony[MaxParticipants] = {};
+	uint64 m_updateCycles = 0;
+	int64 m_pairUpdates = 0;
+
+public:
+	FMeditationSynchronyEngine();
+
+	/**
+	 * @param WindowLength	Samples in the sliding window
+	 * @param PhaseWeight	Weight of the phase locking value in the synchrony, the correlation has the rest
+	 */
+	void Setup(int32 WindowLength, float PhaseWeight);
+
+	/** Starts tracking a slot from an empty history */
+	void Join(int32 Slot);
+	void Leave(int32 Slot);
+
+	/**
+	 * Adds samples of every slot (free slots are ignored) and updates the pair statistics.
+	 * @param Values		NumSamples frames of MaxParticipants values
+	 * @param Phases		NumSamples frames of MaxParticipants phases (rad), nullptr when there are none (the phase locking values then fade out)
+	 * @param NumSamples	Number of frames
+	 */
+	void AddSamples(const float* Values, const float* Phases, int32 NumSamples);
+
+	/** @return Mean synchrony of the valid pairs, in [0, 1] */
+	float GetGroupSynchrony() const { return m_groupSynchrony; }
+	/** @return Mean synchrony of the valid pairs of a participant, in [0, 1] */
+	float GetParticipantSynchrony(int32 Slot) const { return m_participantSynchrony[Slot]; }
+	/** @return Correlation of a pair over the window, 0 until valid */
+	float GetCorrelation(int32 SlotA, int32 SlotB) const;
+	/** @return Phase locking value of a pair over the window, 0 until valid */
+	float GetPhaseLocking(int32 SlotA, int32 SlotB) const;
+	/** @return Average cost (s) of a pair update, for profiling */
+	double GetPairUpdateCost() const;
+
+private:
+	static int32 GetTileIndex(int32 RowBlock, int32 ColumnBlock);
+	/** Updates the pair sums of a tile with the batch, then the synchrony of its valid pairs */
+	void UpdateTile(FTile& Tile) const;
+	void GetPairStats(const FTile& Tile, int32 SlotA, int32 SlotB, double& OutCorrelation, double& OutPhaseLocking) const;
+	double GetPairSynchrony(const FTile& Tile, int32 SlotA, int32 SlotB) const;
+	/** @return	False if the pair is not valid */
+	bool GetPair(int32 SlotA, int32 SlotB, double& OutCorrelation, double& OutPhaseLocking) const;
+};
+
+/**
+ * Server side group synchrony: samples the relaxation value of every meditator at a fixed rate, feeds their synchrony engine, and hands the group
+ * and individual synchrony back to the pawns, which replicate them to their owner.
+ * Phases are those of the slow oscillations of the relaxation value (a band around breathing rates), estimated from a band-pass filter and its delayed
+ * output; the EEG band phases themselves never reach the server.
+ */
+UCLASS()
+class VR_TEST_API UMeditationSynchronySubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+	/** Band-pass filter and phase estimation of a participant's relaxation value */
+	struct FPhaseTracker
+	{
+		float z1 = 0.f;
+		float z2 = 0.f;
+		float previous = 0.f;
+	};
+
+	FMeditationSynchronyEngine m_engine;
+	TWeakObjectPtr<class AVRPawn> m_pawns[FMeditationSynchronyEngine::MaxParticipants];
+	FPhaseTracker m_phases[FMeditationSynchronyEngine::MaxParticipants];
+	int32 m_numPawns = 0;
+	float m_sampleRate = 30.f;
+	float m_sampleTime = 0.f;
+	float m_b0 = 0.f, m_b2 = 0.f, m_a1 = 0.f, m_a2 = 0.f;
+	float m_cosOmega = 1.f, m_sinOmega = 0.f;
+	/** Frames sampled this tick, reset every tick */
+	FEEGFrameArena m_frameArena;
+
+	/** Clears the synchrony of the remaining meditators, alone nobody is in synchrony */
+	void ResetSynchrony();
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	/**
+	 * Adds a meditator, the first one sets the engine up.
+	 * @param Pawn		Meditator
+	 * @param Settings	Synchrony settings, only used by the first meditator
+	 * @return			False if every slot is taken
+	 */
+	bool Register(class AVRPawn* Pawn, const FMeditationSynchronySettings& Settings);
+	void Unregister(class AVRPawn* Pawn);
+
+	const FMeditationSynchronyEngine& GetEngine() const { return m_engine; }
+};
@@ -0,0 +1,191 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationSynthComponent.h"
+
+/** Frequency ratios of the drone partials, relative to the carrier frequency */
+static constexpr float GPartialRatios[] = { 1.f, 1.5f, 2.f, 3.f, 4.f, 5.f, 6.f, 8.f };
+/** Ambient noise low-pass cutoff (Hz), from not relaxed to fully relaxed */
+static constexpr float GNoiseCutoffUnrelaxed = 1800.f;
+static constexpr float GNoiseCutoffRelaxed = 350.f;
+
+UMeditationSynthComponent::UMeditationSynthComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+}
+
+void UMeditationSynthComponent::SetMeditationParams(float Relaxation, bool bRelaxed, float AscentSpeed)
+{
+	FMeditationAudioParams params;
+	params.relaxation = FMath::Clamp(Relaxation / 100.f, 0.f, 1.f);
+	params.ascentSpeed = FMath::Clamp(AscentSpeed, -1.f, 1.f);
+	params.bRelaxed = bRelaxed;
+	CopySettings(params);
+	// If the audio thread is late the queue may be full, the next frame will send a fresher state anyway
+	m_paramQueue.Push(params);
+}
+
+void UMeditationSynthComponent::CopySettings(FMeditationAudioParams& Params) const
+{
+	Params.carrierFrequency = carrierFrequency;
+	Params.unrelaxedBeatFrequency = unrelaxedBeatFrequency;
+	Params.relaxedBeatFrequency = relaxedBeatFrequency;
+	Params.ascentPitchShift = ascentPitchShift;
+	Params.smoothingTime = FMath::Max(smoothingTime, .01f);
+	Params.toneVolume = toneVolume;
+	Params.ambienceVolume = ambienceVolume;
+}
+
+bool UMeditationSynthComponent::Init(int32& SampleRate)
+{
+	NumChannels = 2;
+	m_sampleRate = SampleRate;
+
+	// Voices are allocated here once and for all, the render callback never resizes them
+	m_activeVoices = FMath::Min(Align(voicePairs * 2, SimdWidth), MaxVoices);
+	m_phaseRe.SetNumZeroed(m_activeVoices);
+	m_phaseIm.SetNumZeroed(m_activeVoices);
+	m_rotRe.SetNumZeroed(m_activeVoices);
+	m_rotIm.SetNumZeroed(m_activeVoices);
+	m_gainLeft.SetNumZeroed(m_activeVoices);
+	m_gainRight.SetNumZeroed(m_activeVoices);
+	m_voiceRatio.SetNumZeroed(m_activeVoices / 2);
+
+	const int32 numPairs = m_activeVoices / 2;
+	const float pairGain = 1.f / FMath::Sqrt(static_cast<float>(numPairs));
+	FRandomStream random(0x5eed);
+
+	for (int32 pair = 0; pair < numPairs; ++pair)
+	{
+		const int32 partial = pair % UE_ARRAY_COUNT(GPartialRatios);
+		// Slight detune so that stacked pairs on the same partial form a chorus instead of summing in phase
+		m_voiceRatio[pair] = GPartialRatios[partial] * (1.f + random.FRandRange(-.004f, .004f));
+
+		const float gain = pair < voicePairs ? pairGain / (1.f + partial) : 0.f;
+		const float phase = random.FRandRange(0.f, 2.f * PI);
+		for (int32 ear = 0; ear < 2; ++ear)
+		{
+			const int32 voice = pair * 2 + ear;
+			FMath::SinCos(&m_phaseIm[voice], &m_phaseRe[voice], phase);
+			m_gainLeft[voice] = ear == 0 ? gain : 0.f;
+			m_gainRight[voice] = ear == 1 ? gain : 0.f;
+		}
+	}
+
+	// Init runs before rendering starts, the render thread uses these settings until the first SetMeditationParams
+	CopySettings(m_audioParams);
+	m_beatFrequency = m_audioParams.unrelaxedBeatFrequency;
+	m_noiseCoef = FMath::Exp(-2.f * PI * GNoiseCutoffUnrelaxed / m_sampleRate);
+	UpdateVoiceRotations();
+
+	return true;
+}
+
+void UMeditationSynthComponent::UpdateVoiceRotations()
+{
+	const float radPerHz = 2.f * PI / m_sampleRate;
+
+	for (int32 pair = 0; pair < m_activeVoices / 2; ++pair)
+	{
+		const float leftFrequency = m_audioParams.carrierFrequency * m_carrierScale * m_voiceRatio[pair];
+		const float rightFrequency = leftFrequency + m_beatFrequency;
+		FMath::SinCos(&m_rotIm[pair * 2], &m_rotRe[pair * 2], leftFrequency * radPerHz);
+		FMath::SinCos(&m_rotIm[pair * 2 + 1], &m_rotRe[pair * 2 + 1], rightFrequency * radPerHz);
+	}
+}
+
+void UMeditationSynthComponent::RenormalizePhasors()
+{
+	const VectorRegister4Float threeHalves = VectorSetFloat1(1.5f);
+	const VectorRegister4Float half = VectorSetFloat1(.5f);
+
+	for (int32 voice = 0; voice < m_activeVoices; voice += SimdWidth)
+	{
+		const VectorRegister4Float re = VectorLoadAligned(&m_phaseRe[voice]);
+		const VectorRegister4Float im = VectorLoadAligned(&m_phaseIm[voice]);
+		// First order approximation of 1 / |z|, enough as the drift between two calls is tiny
+		const VectorRegister4Float sqrMagnitude = VectorMultiplyAdd(re, re, VectorMultiply(im, im));
+		const VectorRegister4Float correction = VectorNegateMultiplyAdd(half, sqrMagnitude, threeHalves);
+		VectorStoreAligned(VectorMultiply(re, correction), &m_phaseRe[voice]);
+		VectorStoreAligned(VectorMultiply(im, correction), &m_phaseIm[voice]);
+	}
+}
+
+int32 UMeditationSynthComponent::OnGenerateAudio(float* OutAudio, int32 NumSamples)
+{
+	FMeditationAudioParams params;
+	if (m_paramQueue.PopLatest(params))
+		m_audioParams = params;
+
+	const int32 numFrames = NumSamples / NumChannels;
+	const float blockDuration = static_cast<float>(numFrames) / m_sampleRate;
+	const float smoothing = 1.f - FMath::Exp(-blockDuration / m_audioParams.smoothingTime);
+	const float relaxation = m_audioParams.relaxation;
+
+	// Smooth parameters once per block, gains are then ramped per sample to avoid zipper noise
+	const float prevToneGain = m_toneGain;
+	const float prevNoiseGain = m_noiseGain;
+	const float targetNoiseCoef = FMath::Exp(-2.f * PI * FMath::Lerp(GNoiseCutoffUnrelaxed, GNoiseCutoffRelaxed, relaxation) / m_sampleRate);
+	m_beatFrequency += (FMath::Lerp(m_audioParams.unrelaxedBeatFrequency, m_audioParams.relaxedBeatFrequency, relaxation) - m_beatFrequency) * smoothing;
+	m_carrierScale += (1.f + m_audioParams.ascentPitchShift * m_audioParams.ascentSpeed - m_carrierScale) * smoothing;
+	m_toneGain += (m_audioParams.toneVolume * FMath::Lerp(.4f, 1.f, relaxation) - m_toneGain) * smoothing;
+	m_noiseGain += (m_audioParams.ambienceVolume * (m_audioParams.bRelaxed ? .6f : 1.f) - m_noiseGain) * smoothing;
+	m_noiseCoef += (targetNoiseCoef - m_noiseCoef) * smoothing;
+
+	UpdateVoiceRotations();
+	if ((++m_blockCount & 15) == 0)
+		RenormalizePhasors();
+
+	const float toneGainStep = (m_toneGain - prevToneGain) / numFrames;
+	const float noiseGainStep = (m_noiseGain - prevNoiseGain) / numFrames;
+	float toneGain = prevToneGain;
+	float noiseGain = prevNoiseGain;
+
+	float* phaseRe = m_phaseRe.GetData();
+	float* phaseIm = m_phaseIm.GetData();
+	const float* rotRe = m_rotRe.GetData();
+	const float* rotIm = m_rotIm.GetData();
+	const float* gainLeft = m_gainLeft.GetData();
+	const float* gainRight = m_gainRight.GetData();
+
+	for (int32 frame = 0; frame < numFrames; ++frame)
+	{
+		VectorRegister4Float accLeft = VectorZeroFloat();
+		VectorRegister4Float accRight = VectorZeroFloat();
+
+		for (int32 voice = 0; voice < m_activeVoices; voice += SimdWidth)
+		{
+			const VectorRegister4Float re = VectorLoadAligned(phaseRe + voice);
+			const VectorRegister4Float im = VectorLoadAligned(phaseIm + voice);
+			const VectorRegister4Float cr = VectorLoadAligned(rotRe + voice);
+			const VectorRegister4Float ci = VectorLoadAligned(rotIm + voice);
+
+			accLeft = VectorMultiplyAdd(re, VectorLoadAligned(gainLeft + voice), accLeft);
+			accRight = VectorMultiplyAdd(re, VectorLoadAligned(gainRight + voice), accRight);
+
+			// z *= e^(i * w)
+			VectorStoreAligned(VectorNegateMultiplyAdd(im, ci, VectorMultiply(re, cr)), phaseRe + voice);
+			VectorStoreAligned(VectorMultiplyAdd(re, ci, VectorMultiply(im, cr)), phaseIm + voice);
+		}
+
+		alignas(16) float left[SimdWidth];
+		alignas(16) float right[SimdWidth];
+		VectorStoreAligned(accLeft, left);
+		VectorStoreAligned(accRight, right);
+
+		// Two decorrelated low-passed white noises make the ambient bed, like distant wind or water
+		m_noiseSeed ^= m_noiseSeed << 13; m_noiseSeed ^= m_noiseSeed >> 17; m_noiseSeed ^= m_noiseSeed << 5;
+		const float whiteLeft = static_cast<float>(m_noiseSeed & 0xFFFF) / 32768.f - 1.f;
+		const float whiteRight = static_cast<float>(m_noiseSeed >> 16) / 32768.f - 1.f;
+		m_noiseStateLeft = whiteLeft + m_noiseCoef * (m_noiseStateLeft - whiteLeft);
+		m_noiseStateRight = whiteRight + m_noiseCoef * (m_noiseStateRight - whiteRight);
+
+		OutAudio[frame * 2] = toneGain * (left[0] + left[1] + left[2] + left[3]) + noiseGain * m_noiseStateLeft;
+		OutAudio[frame * 2 + 1] = toneGain * (right[0] + right[1] + right[2] + right[3]) + noiseGain * m_noiseStateRight;
+
+		toneGain += toneGainStep;
+		noiseGain += noiseGainStep;
+	}
+
+	return NumSamples;
+}
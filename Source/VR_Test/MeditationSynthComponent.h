@@ -0,0 +1,117 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SynthComponent.h"
+#include "SpscRingBuffer.h"
+#include "MeditationSynthComponent.generated.h"
+
+/** Meditation state and synth settings sent from the game thread to the audio render thread */
+struct FMeditationAudioParams
+{
+	/** Relaxation value remapped to [0, 1] */
+	float relaxation = 0.f;
+	/** Current up velocity divided by the rise velocity, in [-1, 1] */
+	float ascentSpeed = 0.f;
+	bool bRelaxed = false;
+
+	/** Copies of the component settings, which Blueprint and the editor may change while the render thread runs */
+	float carrierFrequency = 200.f;
+	float unrelaxedBeatFrequency = 10.f;
+	float relaxedBeatFrequency = 6.f;
+	float ascentPitchShift = .12f;
+	float smoothingTime = 1.5f;
+	float toneVolume = .25f;
+	float ambienceVolume = .15f;
+};
+
+/**
+ * Procedural audio source generating binaural beats and a layered ambience following the meditation state.
+ * Every voice is a pair of carriers, one per ear, detuned by the beat frequency. The beat frequency glides from alpha to theta range as the user relaxes.
+ * Oscillators are complex phasors rotated 4 voices at a time with SIMD registers, nothing is allocated nor locked on the audio render thread.
+ */
+UCLASS(ClassGroup = Synth, meta = (BlueprintSpawnableComponent))
+class VR_TEST_API UMeditationSynthComponent : public USynthComponent
+{
+	GENERATED_BODY()
+
+	static constexpr int32 MaxVoices = 512;
+	static constexpr int32 SimdWidth = 4;
+
+	/** Voices states, structure of arrays so that 4 voices fit in a vector register. Left and right ear carriers are separate voices */
+	TArray<float, TAlignedHeapAllocator<16>> m_phaseRe;
+	TArray<float, TAlignedHeapAllocator<16>> m_phaseIm;
+	TArray<float, TAlignedHeapAllocator<16>> m_rotRe;
+	TArray<float, TAlignedHeapAllocator<16>> m_rotIm;
+	TArray<float, TAlignedHeapAllocator<16>> m_gainLeft;
+	TArray<float, TAlignedHeapAllocator<16>> m_gainRight;
+	/** Base frequency ratio of each voice pair relative to carrierFrequency */
+	TArray<float> m_voiceRatio;
+
+	/** Parameters waiting to be consumed by the audio render thread */
+	TSpscRingBuffer<FMeditationAudioParams, 64> m_paramQueue;
+	/** Latest parameters known by the audio render thread, the only settings it reads */
+	FMeditationAudioParams m_audioParams;
+
+	/** Smoothed values, only touched by the audio render thread */
+	float m_beatFrequency = 10.f;
+	float m_carrierScale = 1.f;
+	float m_toneGain = 0.f;
+	float m_noiseGain = 0.f;
+	float m_noiseCoef = 0.f;
+	float m_noiseStateLeft = 0.f;
+	float m_noiseStateRight = 0.f;
+	uint32 m_noiseSeed = 0x9E3779B9u;
+	int32 m_sampleRate = 48000;
+	int32 m_activeVoices = 0;
+	/** Counts generated blocks, used to renormalise phasors periodically */
+	uint32 m_blockCount = 0;
+
+public:
+	UMeditationSynthComponent(const FObjectInitializer& ObjectInitializer);
+
+	/** Carrier frequency (Hz) of the fundamental voice pair */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin="40", ClampMax="1000"), Category = "Meditation Audio")
+	float carrierFrequency = 200.f;
+	/** Binaural beat frequency (Hz) when not relaxed, alpha range by default */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin="0.5", ClampMax="40"), Category = "Meditation Audio")
+	float unrelaxedBeatFrequency = 10.f;
+	/** Binaural beat frequency (Hz) when fully relaxed, theta range by default */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin="0.5", ClampMax="40"), Category = "Meditation Audio")
+	float relaxedBeatFrequency = 6.f;
+	/** How much the whole voice bank pitch rises (in ratio) at full ascent speed */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin="0", ClampMax="1"), Category = "Meditation Audio")
+	float ascentPitchShift = .12f;
+	/** Number of voice pairs of the layered drone. Two voices (one per ear) are rendered per pair */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1", ClampMax="256"), Category = "Meditation Audio")
+	int32 voicePairs = 64;
+	/** Time (s) smoothed parameters take to follow the meditation state */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin="0.01"), Category = "Meditation Audio")
+	float smoothingTime = 1.5f;
+	/** Output gain of the tones and of the ambient noise bed */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin="0", ClampMax="1"), Category = "Meditation Audio")
+	float toneVolume = .25f;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin="0", ClampMax="1"), Category = "Meditation Audio")
+	float ambienceVolume = .15f;
+
+	/**
+	 * Sends the current meditation state to the audio render thread. Lock free, to call from the game thread once per frame.
+	 * @param Relaxation	Relaxation value, in [0, 100]
+	 * @param bRelaxed		Current relaxed state
+	 * @param AscentSpeed	Current up velocity divided by the rise velocity
+	 */
+	void SetMeditationParams(float Relaxation, bool bRelaxed, float AscentSpeed);
+
+protected:
+	virtual bool Init(int32& SampleRate) override;
+	virtual int32 OnGenerateAudio(float* OutAudio, int32 NumSamples) override;
+
+private:
+	/** Copies the settings to Params, game thread */
+	void CopySettings(FMeditationAudioParams& Params) const;
+	/** Recomputes the phasor rotation of every voice from the current carrier scale and beat frequency. Audio render thread only. */
+	void UpdateVoiceRotations();
+	/** Brings phasors magnitude back to 1 to compensate float rounding drift. Audio render thread only. */
+	void RenormalizePhasors();
+};
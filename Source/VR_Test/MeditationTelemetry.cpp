@@ -0,0 +1,99 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationTelemetry.h"
+
+#include "Common/UdpSocketBuilder.h"
+#include "HAL/RunnableThread.h"
+#include "SocketSubsystem.h"
+#include "Sockets.h"
+#include "VR_Test.h"
+
+namespace
+{
+	/** Max time a sample waits before being sent in a partial packet */
+	constexpr float FlushInterval = .05f;
+	constexpr float PollInterval = .005f;
+}
+
+FMeditationTelemetry::FMeditationTelemetry(const FString& Host, int32 Port, int32 Decimation)
+	: m_host(Host)
+	, m_port(Port)
+	, m_decimation(FMath::Max(Decimation, 1))
+{
+}
+
+FMeditationTelemetry::~FMeditationTelemetry()
+{
+	if (m_thread)
+	{
+		m_thread->Kill(true);
+		delete m_thread;
+	}
+	if (m_socket)
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(m_socket);
+
+	if (m_recordCount > 0)
+		UE_LOG(LogMeditation, Log, TEXT("Telemetry: %llu samples recorded, %.0f ns per sample on the game thread, %u dropped"),
+			m_recordCount, GetAverageRecordCost() * 1e9, m_droppedSamples.load());
+}
+
+bool FMeditationTelemetry::Start()
+{
+	ISocketSubsystem* sockets = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	m_address = sockets->CreateInternetAddr();
+	bool bValidAddress = false;
+	m_address->SetIp(*m_host, bValidAddress);
+	m_address->SetPort(m_port);
+	if (!bValidAddress)
+		return false;
+
+	m_socket = FUdpSocketBuilder(TEXT("MeditationTelemetry")).AsNonBlocking().Build();
+	if (!m_socket)
+		return false;
+
+	m_thread = FRunnableThread::Create(this, TEXT("MeditationTelemetry"), 0, TPri_BelowNormal);
+	return m_thread != nullptr;
+}
+
+double FMeditationTelemetry::GetAverageRecordCost() const
+{
+	return m_recordCount > 0 ? FPlatformTime::GetSecondsPerCycle64() * m_recordCycles / m_recordCount : 0.0;
+}
+
+uint32 FMeditationTelemetry::Run()
+{
+	uint8 packet[sizeof(FMeditationTelemetryPacketHeader) + MeditationTelemetry::MaxSamplesPerPacket * sizeof(FMeditationTelemetrySample)];
+	FMeditationTelemetryPacketHeader& header = *reinterpret_cast<FMeditationTelemetryPacketHeader*>(packet);
+	FMeditationTelemetrySample* samples = reinterpret_cast<FMeditationTelemetrySample*>(packet + sizeof(FMeditationTelemetryPacketHeader));
+	header.magic = FMeditationTelemetryPacketHeader::Magic;
+	header.version = FMeditationTelemetryPacketHeader::Version;
+
+	int32 numSamples = 0;
+	double firstSampleTime = 0.0;
+	while (!m_bStopping.load(std::memory_order_relaxed))
+	{
+		if (numSamples == 0)
+			firstSampleTime = FPlatformTime::Seconds();
+		numSamples += m_ring.PopMany(samples + numSamples, MeditationTelemetry::MaxSamplesPerPacket - numSamples);
+
+		// Full packets are sent right away, partial ones once their first sample waited long enough
+		if (numSamples == MeditationTelemetry::MaxSamplesPerPacket || (numSamples > 0 && FPlatformTime::Seconds() - firstSampleTime >= FlushInterval))
+		{
+			header.numSamples = static_cast<uint16>(numSamples);
+			header.droppedSamples = m_droppedSamples.load(std::memory_order_relaxed);
+			int32 bytesSent = 0;
+			m_socket->SendTo(packet, sizeof(FMeditationTelemetryPacketHeader) + numSamples * sizeof(FMeditationTelemetrySample), bytesSent, *m_address);
+			numSamples = 0;
+			continue;
+		}
+
+		FPlatformProcess::Sleep(PollInterval);
+	}
+	return 0;
+}
+
+void FMeditationTelemetry::Stop()
+{
+	m_bStopping.store(true, std::memory_order_relaxed);
+}
@@ -0,0 +1,124 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "SpscRingBuffer.h"
+
+/** One frame of the meditation pipeline, as exported. Plain little-endian floats and ints, copied as is to the packets */
+struct FMeditationTelemetrySample
+{
+	enum EFlags : uint32
+	{
+		Relaxed = 1 << 0,
+		Grounded = 1 << 1,
+		Flying = 1 << 2
+	};
+
+	uint32 frame;
+	/** Seconds since the telemetry started */
+	float time;
+	float deltaTime;
+	float relaxationValue;
+	float currAvg;
+	float prevAvg;
+	float curZVelocity;
+	float targetZVelocity;
+	/** Hand forces computed by UpdateFlyingVelocity */
+	FVector3f leftHandForce;
+	FVector3f rightHandForce;
+	/** Game thread cost of recording the previous sample, in cycles */
+	uint32 recordCycles;
+	uint32 flags;
+};
+static_assert(sizeof(FMeditationTelemetrySample) == 64, "Telemetry samples are sent as is, keep them packed");
+
+/** UDP datagram: header followed by numSamples samples */
+struct FMeditationTelemetryPacketHeader
+{
+	static constexpr uint32 Magic = 0x4D4C544D;	// "MTLM"
+	static constexpr uint16 Version = 1;
+
+	uint32 magic;
+	uint16 version;
+	uint16 numSamples;
+	/** Samples dropped since the telemetry started because the ring was full */
+	uint32 droppedSamples;
+};
+
+namespace MeditationTelemetry
+{
+	constexpr int32 DefaultPort = 5680;
+	/** Keeps datagrams below the usual MTU */
+	constexpr int32 MaxSamplesPerPacket = (1400 - sizeof(FMeditationTelemetryPacketHeader)) / sizeof(FMeditationTelemetrySample);
+}
+
+/**
+ * Live export of the meditation pipeline to an operator screen (see UMeditationTelemetryCommandlet).
+ * The game thread only copies a sample into a lock-free ring. A background thread batches the samples into UDP datagrams.
+ */
+class VR_TEST_API FMeditationTelemetry : public FRunnable
+{
+	static constexpr uint32 RingCapacity = 1024;
+
+	TSpscRingBuffer<FMeditationTelemetrySample, RingCapacity> m_ring;
+	FString m_host;
+	int32 m_port;
+	/** Record one frame out of m_decimation */
+	int32 m_decimation;
+	int32 m_framesToSkip = 0;
+	std::atomic<uint32> m_droppedSamples{0};
+	std::atomic<bool> m_bStopping{false};
+	class FSocket* m_socket = nullptr;
+	TSharedPtr<class FInternetAddr> m_address;
+	FRunnableThread* m_thread = nullptr;
+
+	/** Record cost stats, game thread only */
+	uint64 m_recordCycles = 0;
+	uint64 m_recordCount = 0;
+
+public:
+	/**
+	 * @param Host			Viewer address
+	 * @param Port			Viewer port
+	 * @param Decimation	Export one frame out of Decimation
+	 */
+	FMeditationTelemetry(const FString& Host, int32 Port, int32 Decimation);
+	virtual ~FMeditationTelemetry() override;
+
+	/** @return False if the socket or thread could not be created */
+	bool Start();
+
+	/** @return True if the current frame should be recorded, game thread only */
+	bool ShouldRecord()
+	{
+		if (m_framesToSkip > 0)
+		{
+			--m_framesToSkip;
+			return false;
+		}
+		m_framesToSkip = m_decimation - 1;
+		return true;
+	}
+	/** Queues a sample, game thread only */
+	void Record(const FMeditationTelemetrySample& Sample)
+	{
+		if (!m_ring.Push(Sample))
+			m_droppedSamples.fetch_add(1, std::memory_order_relaxed);
+	}
+	/**
+	 * Accounts for the game thread cost of a recorded frame, see GetAverageRecordCost.
+	 * @param Cycles	Cycles spent building and recording the sample
+	 */
+	void AddRecordCost(uint32 Cycles)
+	{
+		m_recordCycles += Cycles;
+		++m_recordCount;
+	}
+	/** @return Average game thread cost of recording a sample, in seconds */
+	double GetAverageRecordCost() const;
+
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+};
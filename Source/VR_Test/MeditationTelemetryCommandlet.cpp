@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationTelemetryCommandlet.h"
+
+#include "Common/UdpSocketBuilder.h"
+#include "HAL/FileManager.h"
+#include "MeditationTelemetry.h"
+#include "SocketSubsystem.h"
+#include "Sockets.h"
+#include "VR_Test.h"
+
+UMeditationTelemetryCommandlet::UMeditationTelemetryCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UMeditationTelemetryCommandlet::Main(const FString& Params)
+{
+	int32 port = MeditationTelemetry::DefaultPort;
+	float rate = 4.f;
+	FString csvPath;
+	FParse::Value(*Params, TEXT("Port="), port);
+	FParse::Value(*Params, TEXT("Rate="), rate);
+	FParse::Value(*Params, TEXT("Csv="), csvPath);
+
+	FSocket* socket = FUdpSocketBuilder(TEXT("MeditationTelemetryViewer")).BoundToPort(port).WithReceiveBufferSize(1 << 20).Build();
+	if (!socket)
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Could not bind UDP port %d"), port);
+		return 1;
+	}
+
+	TUniquePtr<FArchive> csv;
+	if (!csvPath.IsEmpty())
+	{
+		csv.Reset(IFileManager::Get().CreateFileWriter(*csvPath));
+		FString line = TEXT("Frame,Time,DeltaTime,Relaxation,CurrAvg,PrevAvg,CurZVelocity,TargetZVelocity,LeftForceX,LeftForceY,LeftForceZ,RightForceX,RightForceY,RightForceZ,Relaxed,Grounded,Flying\n");
+		if (csv)
+			csv->Serialize(TCHAR_TO_ANSI(*line), line.Len());
+	}
+
+	UE_LOG(LogMeditation, Display, TEXT("Listening to telemetry on port %d"), port);
+
+	TArray<uint8> packet;
+	packet.SetNumUninitialized(64 * 1024);
+	FMeditationTelemetrySample latest = {};
+	uint32 droppedSamples = 0;
+	int64 received = 0;
+	uint64 recordCycles = 0;
+	float deltaTimeSum = 0.f;
+	float maxDeltaTime = 0.f;
+	int32 periodSamples = 0;
+	double nextPrint = FPlatformTime::Seconds();
+
+	while (!IsEngineExitRequested())
+	{
+		int32 bytesRead = 0;
+		if (socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromMilliseconds(100)) && socket->Recv(packet.GetData(), packet.Num(), bytesRead)
+			&& bytesRead >= static_cast<int32>(sizeof(FMeditationTelemetryPacketHeader)))
+		{
+			const FMeditationTelemetryPacketHeader& header = *reinterpret_cast<const FMeditationTelemetryPacketHeader*>(packet.GetData());
+			const FMeditationTelemetrySample* samples = reinterpret_cast<const FMeditationTelemetrySample*>(packet.GetData() + sizeof(header));
+			if (header.magic != FMeditationTelemetryPacketHeader::Magic || header.version != FMeditationTelemetryPacketHeader::Version
+				|| bytesRead < static_cast<int32>(sizeof(header) + header.numSamples * sizeof(FMeditationTelemetrySample)))
+				continue;
+
+			droppedSamples = header.droppedSamples;
+			for (int32 i = 0; i < header.numSamples; ++i)
+			{
+				const FMeditationTelemetrySample& sample = samples[i];
+				latest = sample;
+				++received;
+
+				deltaTimeSum += sample.deltaTime;
+				maxDeltaTime = FMath::Max(maxDeltaTime, sample.deltaTime);
+				recordCycles += sample.recordCycles;
+				++periodSamples;
+
+				if (csv)
+				{
+					FString line = FString::Printf(TEXT("%u,%.4f,%.5f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%d,%d,%d\n"),
+						sample.frame, sample.time, sample.deltaTime, sample.relaxationValue, sample.currAvg, sample.prevAvg, sample.curZVelocity, sample.targetZVelocity,
+						sample.leftHandForce.X, sample.leftHandForce.Y, sample.leftHandForce.Z, sample.rightHandForce.X, sample.rightHandForce.Y, sample.rightHandForce.Z,
+						(sample.flags & FMeditationTelemetrySample::Relaxed) != 0, (sample.flags & FMeditationTelemetrySample::Grounded) != 0,
+						(sample.flags & FMeditationTelemetrySample::Flying) != 0);
+					csv->Serialize(TCHAR_TO_ANSI(*line), line.Len());
+				}
+			}
+		}
+
+		if (FPlatformTime::Seconds() < nextPrint || periodSamples == 0)
+			continue;
+		nextPrint = FPlatformTime::Seconds() + 1.0 / FMath::Max(rate, .1f);
+
+		UE_LOG(LogMeditation, Display, TEXT("#%u relax %5.1f (avg %5.1f -> %5.1f) %s%s z %6.2f -> %6.2f | hands %6.1f %6.1f | frame %5.2f ms, max %5.2f ms | export %4.0f ns | received %lld, dropped %u"),
+			latest.frame, latest.relaxationValue, latest.prevAvg, latest.currAvg,
+			(latest.flags & FMeditationTelemetrySample::Relaxed) ? TEXT("RELAXED") : TEXT("unrelaxed"),
+			(latest.flags & FMeditationTelemetrySample::Flying) ? TEXT(" flying") : (latest.flags & FMeditationTelemetrySample::Grounded) ? TEXT(" grounded") : TEXT(""),
+			latest.curZVelocity, latest.targetZVelocity, latest.leftHandForce.Size(), latest.rightHandForce.Size(),
+			deltaTimeSum / periodSamples * 1000.f, maxDeltaTime * 1000.f, FPlatformTime::GetSecondsPerCycle64() * recordCycles / periodSamples * 1e9,
+			received, droppedSamples);
+
+		deltaTimeSum = 0.f;
+		maxDeltaTime = 0.f;
+		recordCycles = 0;
+		periodSamples = 0;
+	}
+
+	ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(socket);
+	return 0;
+}
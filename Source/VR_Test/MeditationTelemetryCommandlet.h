@@ -0,0 +1,23 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MeditationTelemetryCommandlet.generated.h"
+
+/**
+ * Minimal viewer of the live telemetry exported by a running VR session (see FMeditationTelemetry), for the operator screen:
+ * UnrealEditor-Cmd VR_Test.uproject -run=MeditationTelemetry -nullrhi [-Port=5680] [-Rate=4] [-Csv=<file>]
+ * Prints the latest state -Rate times per second, with the frame timing and the game thread cost of the export. -Csv also writes every sample received.
+ */
+UCLASS()
+class UMeditationTelemetryCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UMeditationTelemetryCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
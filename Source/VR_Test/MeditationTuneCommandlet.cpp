@@ -0,0 +1,228 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MeditationTuneCommandlet.h"
+
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "MeditationSession.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "VR_Test.h"
+
+namespace
+{
+	/** Values taken by one tuned parameter */
+	struct FTuneRange
+	{
+		float min = 0.f;
+		float max = 0.f;
+		float step = 1.f;
+
+		int32 Num() const { return step > 0.f ? FMath::FloorToInt((max - min) / step + KINDA_SMALL_NUMBER) + 1 : 1; }
+		float Get(int32 Index) const { return min + Index * step; }
+	};
+
+	enum ETunedParam
+	{
+		QueueSize,
+		OppositeStateThreshold,
+		RelaxedThreshold,
+		InterpDuration,
+		RiseVelocity,
+		FallVelocity,
+		TunedParamCount
+	};
+
+	const TCHAR* GTunedParamNames[TunedParamCount] = {
+		TEXT("QueueSize"), TEXT("OppositeThreshold"), TEXT("RelaxedThreshold"), TEXT("InterpDuration"), TEXT("RiseVelocity"), TEXT("FallVelocity")
+	};
+
+	/** Parses "min:max:step" or a single value. Keeps Default when the parameter is not on the command line. */
+	FTuneRange ParseRange(const FString& Params, const TCHAR* Name, float Default)
+	{
+		FTuneRange range{Default, Default, 0.f};
+		FString value;
+		if (!FParse::Value(*Params, *FString::Printf(TEXT("%s="), Name), value))
+			return range;
+
+		TArray<FString> parts;
+		value.ParseIntoArray(parts, TEXT(":"));
+		if (parts.Num() == 3)
+			range = {FCString::Atof(*parts[0]), FCString::Atof(*parts[1]), FCString::Atof(*parts[2])};
+		else if (parts.Num() == 1)
+			range = {FCString::Atof(*parts[0]), FCString::Atof(*parts[0]), 0.f};
+		return range;
+	}
+
+	struct FTuneCandidate
+	{
+		float params[TunedParamCount];
+		/** Objectives averaged over every session */
+		float timeToRise = 0.f;
+		float falseFlips = 0.f;
+		float roughness = 0.f;
+
+		bool Dominates(const FTuneCandidate& Other) const
+		{
+			return timeToRise <= Other.timeToRise && falseFlips <= Other.falseFlips && roughness <= Other.roughness
+				&& (timeToRise < Other.timeToRise || falseFlips < Other.falseFlips || roughness < Other.roughness);
+		}
+	};
+}
+
+UMeditationTuneCommandlet::UMeditationTuneCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UMeditationTuneCommandlet::Main(const FString& Params)
+{
+	FString sessionDir;
+	if (!FParse::Value(*Params, TEXT("Sessions="), sessionDir))
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Missing -Sessions=<directory of recorded csv sessions>"));
+		return 1;
+	}
+
+	int32 valueColumn = 2;
+	int32 valueChannel = 0;
+	float tickRate = 90.f;
+	float falseFlipWindow = 5.f;
+	FString outPath = FPaths::ProjectSavedDir() / TEXT("MeditationTune") / TEXT("ParetoFront.csv");
+	FParse::Value(*Params, TEXT("Column="), valueColumn);
+	FParse::Value(*Params, TEXT("Channel="), valueChannel);
+	FParse::Value(*Params, TEXT("TickRate="), tickRate);
+	FParse::Value(*Params, TEXT("FalseFlipWindow="), falseFlipWindow);
+	FParse::Value(*Params, TEXT("Out="), outPath);
+
+	// Load every session up front, replays only read them
+	TArray<FString> files;
+	TArray<FString> archives;
+	IFileManager::Get().FindFiles(files, *(sessionDir / TEXT("*.csv")), true, false);
+	IFileManager::Get().FindFiles(archives, *(sessionDir / TEXT("*.eegc")), true, false);
+	files.Append(archives);
+	TArray<FMeditationSession> sessions;
+	double sessionsDuration = 0.0;
+	for (const FString& file : files)
+	{
+		FMeditationSession session;
+		const bool bLoaded = file.EndsWith(TEXT(".eegc"))
+			? session.LoadFromCodec(sessionDir / file, valueChannel)
+			: session.LoadFromCsv(sessionDir / file, valueColumn);
+		if (bLoaded)
+		{
+			sessionsDuration += session.GetDuration();
+			sessions.Add(MoveTemp(session));
+		}
+		else
+			UE_LOG(LogMeditation, Warning, TEXT("Could not load session %s"), *file);
+	}
+
+	if (sessions.Num() == 0)
+	{
+		UE_LOG(LogMeditation, Error, TEXT("No session found in %s"), *sessionDir);
+		return 1;
+	}
+
+	const FMeditationData defaults;
+	FTuneRange ranges[TunedParamCount];
+	ranges[QueueSize] = ParseRange(Params, GTunedParamNames[QueueSize], defaults.relaxationQueueSize);
+	ranges[OppositeStateThreshold] = ParseRange(Params, GTunedParamNames[OppositeStateThreshold], defaults.oppositeStateThreshold);
+	ranges[RelaxedThreshold] = ParseRange(Params, GTunedParamNames[RelaxedThreshold], defaults.relaxedThreshold);
+	ranges[InterpDuration] = ParseRange(Params, GTunedParamNames[InterpDuration], defaults.interpDuration);
+	ranges[RiseVelocity] = ParseRange(Params, GTunedParamNames[RiseVelocity], defaults.riseVelocity);
+	ranges[FallVelocity] = ParseRange(Params, GTunedParamNames[FallVelocity], defaults.fallVelocity);
+
+	int64 combinationCount = 1;
+	for (const FTuneRange& range : ranges)
+		combinationCount *= range.Num();
+
+	if (combinationCount > MAX_int32)
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Too many combinations (%lld), narrow the ranges"), combinationCount);
+		return 1;
+	}
+
+	UE_LOG(LogMeditation, Display, TEXT("Replaying %d sessions (%.0f s) for %lld combinations"), sessions.Num(), sessionsDuration, combinationCount);
+
+	TArray<FTuneCandidate> candidates;
+	candidates.SetNum(combinationCount);
+	const double startTime = FPlatformTime::Seconds();
+
+	// Combinations have very different costs (queue size, number of flips), so let the task graph workers steal small batches
+	ParallelFor(candidates.Num(), [&](int32 Index)
+	{
+		FTuneCandidate& candidate = candidates[Index];
+		int32 remainder = Index;
+		for (int32 param = 0; param < TunedParamCount; ++param)
+		{
+			candidate.params[param] = ranges[param].Get(remainder % ranges[param].Num());
+			remainder /= ranges[param].Num();
+		}
+
+		FMeditationData md;
+		md.relaxationQueueSize = FMath::Max(2, FMath::RoundToInt(candidate.params[QueueSize]));
+		md.oppositeStateThreshold = candidate.params[OppositeStateThreshold];
+		md.relaxedThreshold = candidate.params[RelaxedThreshold];
+		md.interpDuration = candidate.params[InterpDuration];
+		md.riseVelocity = candidate.params[RiseVelocity];
+		md.fallVelocity = candidate.params[FallVelocity];
+
+		for (const FMeditationSession& session : sessions)
+		{
+			const FMeditationReplayResult result = FMeditationReplay::Run(md, session, tickRate, falseFlipWindow);
+			candidate.timeToRise += result.timeToRise;
+			candidate.falseFlips += result.falseFlips;
+			candidate.roughness += result.roughness;
+		}
+
+		candidate.timeToRise /= sessions.Num();
+		candidate.falseFlips /= sessions.Num();
+		candidate.roughness /= sessions.Num();
+	}, EParallelForFlags::Unbalanced);
+
+	const double replayDuration = FPlatformTime::Seconds() - startTime;
+	UE_LOG(LogMeditation, Display, TEXT("Replays done in %.2f s, %.0fx faster than real time"), replayDuration,
+		sessionsDuration * combinationCount / FMath::Max(replayDuration, 1e-6));
+
+	// Sorted lexicographically by the objectives, no candidate is dominated by a later one: a single sweep keeps the candidates that no member of
+	// the front found so far dominates, which is O(N log N + N * front size) instead of comparing every pair
+	TArray<const FTuneCandidate*> sorted;
+	sorted.Reserve(candidates.Num());
+	for (const FTuneCandidate& candidate : candidates)
+		sorted.Add(&candidate);
+	sorted.Sort([](const FTuneCandidate& A, const FTuneCandidate& B)
+	{
+		if (A.timeToRise != B.timeToRise)
+			return A.timeToRise < B.timeToRise;
+		if (A.falseFlips != B.falseFlips)
+			return A.falseFlips < B.falseFlips;
+		return A.roughness < B.roughness;
+	});
+
+	TArray<const FTuneCandidate*> front;
+	for (const FTuneCandidate* candidate : sorted)
+		if (!front.ContainsByPredicate([candidate](const FTuneCandidate* Member) { return Member->Dominates(*candidate); }))
+			front.Add(candidate);
+
+	FString csv = TEXT("relaxationQueueSize,oppositeStateThreshold,relaxedThreshold,interpDuration,riseVelocity,fallVelocity,timeToRise,falseFlips,roughness\n");
+	for (const FTuneCandidate* candidate : front)
+	{
+		csv += FString::Printf(TEXT("%d,%g,%g,%g,%g,%g,%g,%g,%g\n"), FMath::Max(2, FMath::RoundToInt(candidate->params[QueueSize])),
+			candidate->params[OppositeStateThreshold], candidate->params[RelaxedThreshold], candidate->params[InterpDuration],
+			candidate->params[RiseVelocity], candidate->params[FallVelocity], candidate->timeToRise, candidate->falseFlips, candidate->roughness);
+	}
+
+	if (!FFileHelper::SaveStringToFile(csv, *outPath))
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Could not write %s"), *outPath);
+		return 1;
+	}
+
+	UE_LOG(LogMeditation, Display, TEXT("%d Pareto optimal combinations written to %s"), front.Num(), *outPath);
+	return 0;
+}
@@ -0,0 +1,26 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MeditationTuneCommandlet.generated.h"
+
+/**
+ * Searches FMeditationData parameters by replaying recorded sessions for every combination of a parameter grid, and writes the Pareto front of the
+ * (time to rise, false flips, roughness) objectives to a CSV file.
+ * Runs headless, e.g.:
+ * UnrealEditor-Cmd VR_Test.uproject -run=MeditationTune -nullrhi -Sessions=<dir of csv> -Column=2 -QueueSize=3:10:1 -InterpDuration=1:5:.5 -Out=<csv>
+ * Sessions can also be .eegc archives (see UEEGCompressCommandlet), -Channel=<index> then selects the meditation value channel.
+ * Every range is min:max:step, or a single value. Parameters without range keep their default value.
+ */
+UCLASS()
+class UMeditationTuneCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UMeditationTuneCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,227 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "RiemannClassifier.h"
+
+namespace
+{
+	constexpr int32 SimdWidth = 4;
+	/** Theta, alpha and beta bands (Hz) */
+	constexpr float GBandEdges[FRiemannClassifier::NumBands][2] = { { 4.f, 8.f }, { 8.f, 13.f }, { 13.f, 30.f } };
+	/** Shrinkage applied before factorising or comparing covariances */
+	constexpr float GRegularization = 1e-4f;
+}
+
+FRiemannClassifier::FRiemannClassifier()
+{
+	Setup(m_settings);
+}
+
+void FRiemannClassifier::Setup(const FRiemannClassifierSettings& Settings)
+{
+	m_settings = Settings;
+	const int32 numChannels = FMath::Clamp(Settings.numChannels, 1, EEGMaxChannels);
+	if (numChannels != m_numChannels)
+	{
+		m_calibration = FCalibration();
+		m_numChannels = numChannels;
+	}
+
+	m_activeChannels = m_numChannels;
+	m_hopSize = FMath::Max(Settings.hopSize, 1);
+	m_lambda = FMath::Exp(-1.f / (Settings.sampleRate * Settings.forgettingTime));
+	m_samplesSinceHop = 0;
+
+	for (int32 band = 0; band < NumBands; ++band)
+	{
+		// RBJ constant 0 dB peak gain band-pass
+		FBandFilter& filter = m_filters[band];
+		const float nyquist = Settings.sampleRate * .5f;
+		const float low = FMath::Min(GBandEdges[band][0], nyquist * .9f);
+		const float high = FMath::Min(GBandEdges[band][1], nyquist * .95f);
+		const float center = FMath::Sqrt(low * high);
+		const float q = center / FMath::Max(high - low, KINDA_SMALL_NUMBER);
+		const float w0 = 2.f * PI * center / Settings.sampleRate;
+		const float alpha = FMath::Sin(w0) / (2.f * q);
+		const float a0 = 1.f + alpha;
+		filter.b0 = alpha / a0;
+		filter.b2 = -alpha / a0;
+		filter.a1 = -2.f * FMath::Cos(w0) / a0;
+		filter.a2 = (1.f - alpha) / a0;
+		FMemory::Memzero(filter.z1, sizeof(filter.z1));
+		FMemory::Memzero(filter.z2, sizeof(filter.z2));
+
+		// Start from the identity so that the first classifications are neutral instead of singular
+		m_covariances[band].SetIdentity(m_numChannels);
+	}
+}
+
+bool FRiemannClassifier::AddSample(const float* Channels)
+{
+	alignas(16) float input[EEGRowStride] = {};
+	FMemory::Memcpy(input, Channels, sizeof(float) * m_numChannels);
+
+	for (int32 band = 0; band < NumBands; ++band)
+		FilterSample(band, input);
+
+	if (++m_samplesSinceHop < m_hopSize)
+		return false;
+
+	m_samplesSinceHop = 0;
+	RecordCalibrationSample(m_covariances);
+	return true;
+}
+
+void FRiemannClassifier::FilterSample(int32 Band, const float* Input)
+{
+	FBandFilter& filter = m_filters[Band];
+	const VectorRegister4Float b0 = VectorSetFloat1(filter.b0);
+	const VectorRegister4Float b2 = VectorSetFloat1(filter.b2);
+	const VectorRegister4Float a1 = VectorSetFloat1(filter.a1);
+	const VectorRegister4Float a2 = VectorSetFloat1(filter.a2);
+	alignas(16) float filtered[EEGRowStride];
+
+	// y = b0 x + z1, z1 = b1 x - a1 y + z2 (b1 = 0), z2 = b2 x - a2 y
+	for (int32 chunk = 0; chunk < EEGRowStride; chunk += SimdWidth)
+	{
+		const VectorRegister4Float x = VectorLoadAligned(Input + chunk);
+		const VectorRegister4Float y = VectorMultiplyAdd(b0, x, VectorLoadAligned(filter.z1 + chunk));
+		VectorStoreAligned(VectorNegateMultiplyAdd(a1, y, VectorLoadAligned(filter.z2 + chunk)), filter.z1 + chunk);
+		VectorStoreAligned(VectorNegateMultiplyAdd(a2, y, VectorMultiply(b2, x)), filter.z2 + chunk);
+		VectorStoreAligned(y, filtered + chunk);
+	}
+
+	EEGMatrix::RankOneUpdate(m_covariances[Band], filtered, m_lambda, m_numChannels);
+}
+
+void FRiemannClassifier::FilterBand(int32 Band, const float* Interleaved, int32 NumFrames, int32 Stride)
+{
+	alignas(16) float input[EEGRowStride] = {};
+	for (int32 frame = 0; frame < NumFrames; ++frame)
+	{
+		FMemory::Memcpy(input, Interleaved + frame * Stride, sizeof(float) * m_numChannels);
+		FilterSample(Band, input);
+	}
+}
+
+float FRiemannClassifier::Classify()
+{
+	return Classify(m_covariances, m_scratch);
+}
+
+float FRiemannClassifier::Classify(const FEEGMatrix (&Covariances)[NumBands], FEEGMatrix (&Scratch)[3]) const
+{
+	if (!m_calibration.bCalibrated)
+		return .5f;
+
+	float distances[NumBands][NumClasses];
+	for (int32 band = 0; band < NumBands; ++band)
+		for (int32 cls = 0; cls < NumClasses; ++cls)
+			distances[band][cls] = GetClassDistance(Covariances[band], band, cls, Scratch);
+	return GetPosterior(distances);
+}
+
+float FRiemannClassifier::GetClassDistance(const FEEGMatrix& Covariance, int32 Band, int32 Class, FEEGMatrix (&Scratch)[3]) const
+{
+	if (!m_calibration.bCalibrated)
+		return 0.f;
+
+	FEEGMatrix& covariance = Scratch[2];
+	covariance = Covariance;
+	EEGMatrix::Regularize(covariance, GRegularization, m_activeChannels);
+	return EEGMatrix::SquaredRiemannDistance(covariance, m_meanFactors[Band][Class], Scratch, m_activeChannels);
+}
+
+float FRiemannClassifier::GetPosterior(const float (&Distances)[NumBands][NumClasses]) const
+{
+	if (!m_calibration.bCalibrated)
+		return .5f;
+
+	float distances[NumClasses] = {};
+	for (int32 band = 0; band < NumBands; ++band)
+		for (int32 cls = 0; cls < NumClasses; ++cls)
+			distances[cls] += Distances[band][cls];
+
+	// Softmax of the negated distances, over two classes
+	return 1.f / (1.f + FMath::Exp((distances[Relaxed] - distances[Unrelaxed]) / m_settings.posteriorTemperature));
+}
+
+void FRiemannClassifier::RecordCalibrationSample(const FEEGMatrix (&Covariances)[NumBands])
+{
+	if (m_calibrationClass == INDEX_NONE)
+		return;
+	for (int32 band = 0; band < NumBands; ++band)
+	{
+		TArray<FEEGMatrix>& samples = m_calibrationSamples[band][m_calibrationClass];
+		if (samples.Num() < samples.Max())
+			samples.Add(Covariances[band]);
+	}
+}
+
+void FRiemannClassifier::GetCovariances(FEEGMatrix (&OutCovariances)[NumBands]) const
+{
+	for (int32 band = 0; band < NumBands; ++band)
+		OutCovariances[band] = m_covariances[band];
+}
+
+void FRiemannClassifier::SetHopSize(int32 HopSize)
+{
+	m_hopSize = FMath::Max(HopSize, 1);
+	m_samplesSinceHop = FMath::Min(m_samplesSinceHop, m_hopSize - 1);
+}
+
+void FRiemannClassifier::SetActiveChannels(int32 NumChannels)
+{
+	m_activeChannels = FMath::Clamp(NumChannels, 1, m_numChannels);
+}
+
+void FRiemannClassifier::BeginCalibration(bool bRelaxedClass)
+{
+	m_calibrationClass = bRelaxedClass ? Relaxed : Unrelaxed;
+	// Hops are never shorter than the configured one
+	const int32 maxSamples = FMath::CeilToInt(m_settings.maxCalibrationDuration * m_settings.sampleRate / FMath::Max(m_settings.hopSize, 1));
+	for (int32 band = 0; band < NumBands; ++band)
+		m_calibrationSamples[band][m_calibrationClass].Reserve(maxSamples);
+}
+
+bool FRiemannClassifier::EndCalibration()
+{
+	m_calibrationClass = INDEX_NONE;
+
+	for (int32 band = 0; band < NumBands; ++band)
+		for (int32 cls = 0; cls < NumClasses; ++cls)
+			if (m_calibrationSamples[band][cls].Num() == 0)
+				return m_calibration.bCalibrated;
+
+	FCalibration calibration;
+	calibration.numChannels = m_numChannels;
+	calibration.bCalibrated = true;
+	for (int32 band = 0; band < NumBands; ++band)
+		for (int32 cls = 0; cls < NumClasses; ++cls)
+		{
+			for (FEEGMatrix& sample : m_calibrationSamples[band][cls])
+				EEGMatrix::Regularize(sample, GRegularization, m_numChannels);
+			EEGMatrix::RiemannMean(m_calibrationSamples[band][cls], calibration.means[band][cls], m_numChannels);
+			m_calibrationSamples[band][cls].Empty();
+		}
+
+	return SetCalibration(calibration);
+}
+
+bool FRiemannClassifier::SetCalibration(const FCalibration& Calibration)
+{
+	if (!Calibration.bCalibrated || Calibration.numChannels != m_numChannels)
+		return false;
+
+	for (int32 band = 0; band < NumBands; ++band)
+		for (int32 cls = 0; cls < NumClasses; ++cls)
+		{
+			FEEGMatrix mean = Calibration.means[band][cls];
+			EEGMatrix::Regularize(mean, GRegularization, m_numChannels);
+			if (!EEGMatrix::Cholesky(mean, m_meanFactors[band][cls], m_numChannels))
+				return false;
+		}
+
+	m_calibration = Calibration;
+	return true;
+}
@@ -0,0 +1,177 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EEGMatrix.h"
+#include "RiemannClassifier.generated.h"
+
+USTRUCT(BlueprintType)
+struct FRiemannClassifierSettings
+{
+	GENERATED_BODY()
+
+	/** Classify the multi-channel EEG instead of relying on the meditation value registered from Blueprint */
+	UPROPERTY(EditAnywhere, Category = "Classifier")
+	bool bEnabled = false;
+	/** EEG sample rate, 128 Hz for the Epoc+ */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1"), Category = "Classifier")
+	float sampleRate = 128.f;
+	/** Number of EEG channels, at most EEGMaxChannels */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1", ClampMax="14"), Category = "Classifier")
+	int32 numChannels = 14;
+	/** Number of samples between two classifications */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1"), Category = "Classifier")
+	int32 hopSize = 16;
+	/** Time constant (s) of the exponentially weighted covariances */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0.1"), Category = "Classifier")
+	float forgettingTime = 2.f;
+	/** Softens the posterior, the higher the smoother the relaxation value */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0.01"), Category = "Classifier")
+	float posteriorTemperature = 1.f;
+	/** Longest calibration (s) recorded per class, its examples are allocated when it begins. Later hops are not recorded */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1"), Category = "Classifier")
+	float maxCalibrationDuration = 120.f;
+	/** Run the filter and classification stages of every hop on the task graph (see FEEGStagePipeline), the game thread only hands the frames over */
+	UPROPERTY(EditAnywhere, Category = "Classifier")
+	bool bPipelined = false;
+};
+
+/**
+ * Streaming relaxation classifier working on the spatial information of the EEG.
+ * Every sample is band-passed in theta, alpha and beta bands and updates an exponentially weighted channel covariance per band (rank-1 update).
+ * Every hop, the covariances are classified with a minimum distance to Riemannian mean classifier: the posterior of the relaxed class comes from the
+ * affine invariant distances to the relaxed and unrelaxed class means, whose Cholesky factors are cached when calibrating.
+ * Matrices are fixed size and padded for vector registers, AddSample and Classify never allocate.
+ */
+class VR_TEST_API FRiemannClassifier
+{
+public:
+	static constexpr int32 NumBands = 3;
+	enum EClass { Unrelaxed = 0, Relaxed = 1, NumClasses = 2 };
+
+	/** Class means, what is needed to restore a calibrated classifier */
+	struct FCalibration
+	{
+		FEEGMatrix means[NumBands][NumClasses];
+		int32 numChannels = 0;
+		bool bCalibrated = false;
+	};
+
+private:
+	/** Band-pass biquad, transposed direct form II, run on every channel at once */
+	struct FBandFilter
+	{
+		alignas(16) float z1[EEGRowStride];
+		alignas(16) float z2[EEGRowStride];
+		float b0, b2, a1, a2;
+	};
+
+	FRiemannClassifierSettings m_settings;
+	FBandFilter m_filters[NumBands];
+	FEEGMatrix m_covariances[NumBands];
+	float m_lambda = 0.f;
+	int32 m_numChannels = 0;
+	/** Leading channels used to classify, at most m_numChannels */
+	int32 m_activeChannels = 0;
+	int32 m_hopSize = 1;
+	int32 m_samplesSinceHop = 0;
+
+	FCalibration m_calibration;
+	/** Cholesky factors of the class means */
+	FEEGMatrix m_meanFactors[NumBands][NumClasses];
+	/** Scratch matrices of Classify: two for the distances, one for the regularised covariance */
+	FEEGMatrix m_scratch[3];
+
+	/** Covariances recorded while calibrating, per class */
+	TArray<FEEGMatrix> m_calibrationSamples[NumBands][NumClasses];
+	int32 m_calibrationClass = INDEX_NONE;
+
+	/**
+	 * Filters a sample in a band and updates the band covariance.
+	 * @param Band	Band
+	 * @param Input	Sample, EEGRowStride floats, 16 bytes aligned, padding set to zero
+	 */
+	void FilterSample(int32 Band, const float* Input);
+
+public:
+	FRiemannClassifier();
+
+	/**
+	 * Resets the filters and covariances, keeps the calibration if the channel count did not change.
+	 * @param Settings	Classifier settings
+	 */
+	void Setup(const FRiemannClassifierSettings& Settings);
+	/**
+	 * Filters a sample and updates the band covariances.
+	 * @param Channels	One value per channel
+	 * @return			True when a hop is complete and Classify should be called
+	 */
+	bool AddSample(const float* Channels);
+	/** @return Posterior probability of the relaxed class, 0.5 while not calibrated */
+	float Classify();
+	/**
+	 * Classifies covariances copied with GetCovariances, without touching the classifier state, so that it can run on a worker thread.
+	 * The calibration must not change meanwhile.
+	 * @param Covariances	Band covariances
+	 * @param Scratch		Three scratch matrices
+	 * @return				Posterior probability of the relaxed class
+	 */
+	float Classify(const FEEGMatrix (&Covariances)[NumBands], FEEGMatrix (&Scratch)[3]) const;
+	void GetCovariances(FEEGMatrix (&OutCovariances)[NumBands]) const;
+
+	// Stages of AddSample and Classify, for FEEGStagePipeline. Bands only share read-only state: different bands can be filtered and classified on
+	// different threads at once, but a band must be filtered by one thread at a time
+	/**
+	 * Filters frames in a band and updates its covariance, without counting hops nor recording calibration examples.
+	 * @param Band			Band
+	 * @param Interleaved	NumFrames * Stride samples
+	 * @param NumFrames		Number of frames
+	 * @param Stride		Samples per frame, at least the channel count. Only the leading channels are filtered
+	 */
+	void FilterBand(int32 Band, const float* Interleaved, int32 NumFrames, int32 Stride);
+	const FEEGMatrix& GetCovariance(int32 Band) const { return m_covariances[Band]; }
+	/**
+	 * Squared Riemannian distance of a band covariance to a class mean, 0 while not calibrated.
+	 * @param Covariance	Covariance of the band
+	 * @param Band			Band
+	 * @param Class			Class
+	 * @param Scratch		Three scratch matrices
+	 */
+	float GetClassDistance(const FEEGMatrix& Covariance, int32 Band, int32 Class, FEEGMatrix (&Scratch)[3]) const;
+	/** @return Posterior probability of the relaxed class given the class distances of every band, 0.5 while not calibrated */
+	float GetPosterior(const float (&Distances)[NumBands][NumClasses]) const;
+	/** Records the covariances of a hop as examples of the class being calibrated, if any and if there is room left. Never allocates */
+	void RecordCalibrationSample(const FEEGMatrix (&Covariances)[NumBands]);
+
+	/** Changes the number of samples between two classifications, the cost of classifying being per hop */
+	void SetHopSize(int32 HopSize);
+	int32 GetHopSize() const { return m_hopSize; }
+	/**
+	 * Classifies with the leading channels only. The Cholesky factor of a leading block being the leading block of the factor, no recalibration is needed,
+	 * but channels should be ordered by importance.
+	 * @param NumChannels	Number of leading channels
+	 */
+	void SetActiveChannels(int32 NumChannels);
+	int32 GetActiveChannels() const { return m_activeChannels; }
+	int32 GetNumChannels() const { return m_numChannels; }
+
+	/**
+	 * Starts recording the covariances of every hop as examples of a class, allocating room for maxCalibrationDuration of them.
+	 * @param bRelaxedClass	True to record relaxed examples
+	 */
+	void BeginCalibration(bool bRelaxedClass);
+	/**
+	 * Stops recording examples, and computes the class means once both classes have examples.
+	 * @return	True if the classifier is calibrated
+	 */
+	bool EndCalibration();
+	bool IsCalibrated() const { return m_calibration.bCalibrated; }
+
+	const FCalibration& GetCalibration() const { return m_calibration; }
+	/**
+	 * @param Calibration	Previously computed class means
+	 * @return				False if the calibration does not match the current channel count
+	 */
+	bool SetCalibration(const FCalibration& Calibration);
+};
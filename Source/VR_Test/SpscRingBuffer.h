@@ -0,0 +1,104 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/**
+ * Fixed capacity single-producer / single-consumer ring buffer.
+ * Push and Pop never allocate nor lock, so it can be used to hand data from the game thread to a real-time thread (audio render, workers) or back.
+ * One thread only may push and one thread only may pop.
+ */
+template<typename T, uint32 Capacity>
+class TSpscRingBuffer
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "TSpscRingBuffer capacity must be a power of two");
+	static_assert(TIsTriviallyDestructible<T>::Value, "TSpscRingBuffer only stores trivially destructible types");
+
+	static constexpr uint32 Mask = Capacity - 1;
+
+	T m_items[Capacity];
+	/** Index of the next item to pop, only written by the consumer */
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> m_head{0};
+	/** Index of the next item to push, only written by the producer */
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> m_tail{0};
+
+public:
+	/**
+	 * Pushes an item, producer side.
+	 * @param Item	Item to push
+	 * @return		False if the buffer is full, in which case the item is not pushed.
+	 */
+	bool Push(const T& Item)
+	{
+		const uint32 tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+			return false;
+
+		m_items[tail & Mask] = Item;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Pops the oldest item, consumer side.
+	 * @param OutItem	Popped item
+	 * @return			False if the buffer is empty.
+	 */
+	bool Pop(T& OutItem)
+	{
+		const uint32 head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire))
+			return false;
+
+		OutItem = m_items[head & Mask];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Pops up to MaxItems of the oldest items at once, consumer side.
+	 * @param OutItems	Destination, must hold at least MaxItems items
+	 * @param MaxItems	Max number of items to pop
+	 * @return			Number of popped items.
+	 */
+	uint32 PopMany(T* OutItems, uint32 MaxItems)
+	{
+		const uint32 head = m_head.load(std::memory_order_relaxed);
+		const uint32 count = FMath::Min(m_tail.load(std::memory_order_acquire) - head, MaxItems);
+
+		for (uint32 i = 0; i < count; ++i)
+			OutItems[i] = m_items[(head + i) & Mask];
+
+		m_head.store(head + count, std::memory_order_release);
+		return count;
+	}
+
+	/**
+	 * Pops everything and only keeps the most recent item, consumer side. Useful for parameters where only the latest value matters.
+	 * @param OutItem	Most recent item
+	 * @return			False if the buffer was empty.
+	 */
+	bool PopLatest(T& OutItem)
+	{
+		const uint32 head = m_head.load(std::memory_order_relaxed);
+		const uint32 tail = m_tail.load(std::memory_order_acquire);
+		if (head == tail)
+			return false;
+
+		OutItem = m_items[(tail - 1) & Mask];
+		m_head.store(tail, std::memory_order_release);
+		return true;
+	}
+
+	/** Approximate number of items in the buffer, exact when called from the producer or consumer while the other side is idle. */
+	uint32 Num() const
+	{
+		return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+	}
+
+	bool IsEmpty() const { return Num() == 0; }
+
+	static constexpr uint32 GetCapacity() { return Capacity; }
+};
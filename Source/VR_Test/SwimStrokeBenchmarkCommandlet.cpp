@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SwimStrokeBenchmarkCommandlet.h"
+
+#include "SwimStrokeRecognizer.h"
+#include "VR_Test.h"
+
+namespace
+{
+	/** Movement of both hands: a bell shaped stroke along a random direction per hand, mirrored half of the time like the symmetric strokes */
+	struct FSyntheticStroke
+	{
+		FVector left;
+		FVector right;
+		float duration;
+
+		void Randomize(FRandomStream& Random)
+		{
+			left = Random.GetUnitVector() * Random.FRandRange(40.f, 100.f);
+			right = Random.FRandRange(0.f, 1.f) < .5f ? FVector(left.X, -left.Y, left.Z) : Random.GetUnitVector() * Random.FRandRange(40.f, 100.f);
+			duration = Random.FRandRange(.4f, 1.6f);
+		}
+	};
+}
+
+USwimStrokeBenchmarkCommandlet::USwimStrokeBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 USwimStrokeBenchmarkCommandlet::Main(const FString& Params)
+{
+	FSwimStrokeSettings settings;
+	settings.bEnabled = true;
+	float seconds = 600.f;
+	float budgetMs = .5f;
+	FParse::Value(*Params, TEXT("Seconds="), seconds);
+	FParse::Value(*Params, TEXT("SampleRate="), settings.sampleRate);
+	FParse::Value(*Params, TEXT("BudgetMs="), budgetMs);
+	settings.sampleRate = FMath::Clamp(settings.sampleRate, 10.f, 90.f);
+
+	FSwimStrokeRecognizer recognizer;
+	recognizer.Setup(settings);
+
+	// One sample per update, so that every update recognises once the window is full, as a frame does when the frame rate is above the sample rate
+	const float samplePeriod = 1.f / settings.sampleRate;
+	const int32 numSamples = FMath::CeilToInt(seconds * settings.sampleRate);
+	FRandomStream random(42);
+	FSyntheticStroke stroke;
+	stroke.Randomize(random);
+	float strokeTime = 0.f;
+
+	TArray<double> costs;
+	costs.Reserve(numSamples);
+	int32 numStrokes = 0;
+	FName lastStroke;
+	for (int32 sample = 0; sample < numSamples; ++sample)
+	{
+		strokeTime += samplePeriod;
+		if (strokeTime >= stroke.duration)
+		{
+			stroke.Randomize(random);
+			strokeTime = 0.f;
+		}
+
+		// Hand velocities (cm/s) with some tremor, fed as the displacement of the period
+		const float bell = FMath::Sin(PI * strokeTime / stroke.duration);
+		const FVector left = stroke.left * bell + random.GetUnitVector() * 5.f;
+		const FVector right = stroke.right * bell + random.GetUnitVector() * 5.f;
+		FVector acceleration;
+		float yawAcceleration;
+		recognizer.Update(left * samplePeriod, right * samplePeriod, samplePeriod, acceleration, yawAcceleration);
+
+		if (sample + 1 >= FSwimStrokeRecognizer::WindowLength)
+			costs.Add(recognizer.GetLastRecognitionTime());
+		if (recognizer.GetLastStroke() != lastStroke)
+			++numStrokes;
+		lastStroke = recognizer.GetLastStroke();
+	}
+
+	if (costs.Num() == 0)
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Not enough samples to fill the recognition window"));
+		return 1;
+	}
+
+	double total = 0.0;
+	for (double cost : costs)
+		total += cost;
+	costs.Sort();
+	const double mean = total / costs.Num();
+	const double p99 = costs[FMath::Min(FMath::FloorToInt(costs.Num() * .99), costs.Num() - 1)];
+	const double max = costs.Last();
+
+	UE_LOG(LogMeditation, Display, TEXT("%d templates, %d recognitions at %g Hz, %d stroke changes"), recognizer.GetNumTemplates(), costs.Num(), settings.sampleRate, numStrokes);
+	UE_LOG(LogMeditation, Display, TEXT("Recognition: mean %.4f ms, p99 %.4f ms, max %.4f ms, budget %.2f ms"), mean * 1e3, p99 * 1e3, max * 1e3, budgetMs);
+
+	// The max includes the times the thread was preempted
+	if (p99 * 1e3 > budgetMs)
+	{
+		UE_LOG(LogMeditation, Error, TEXT("Recognition over budget: p99 %.4f ms > %.2f ms"), p99 * 1e3, budgetMs);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,23 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SwimStrokeBenchmarkCommandlet.generated.h"
+
+/**
+ * Times the swim stroke recognition of the default template library on synthetic hand trajectories, e.g.:
+ * UnrealEditor-Cmd VR_Test.uproject -run=SwimStrokeBenchmark -nullrhi [-Seconds=600] [-SampleRate=30] [-BudgetMs=0.5]
+ * Reports the mean, 99th percentile and max cost of a recognition over every template, and fails if the 99th percentile exceeds the budget.
+ */
+UCLASS()
+class USwimStrokeBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	USwimStrokeBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,324 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SwimStrokeRecognizer.h"
+
+namespace
+{
+	constexpr int32 SimdWidth = 4;
+	constexpr int32 W = FSwimStrokeRecognizer::WindowLength;
+	constexpr int32 R = FSwimStrokeRecognizer::BandRadius;
+	constexpr float GPaces[] = { .5f, .7f, .9f, 1.05f };
+	constexpr float MinGain = .25f;
+	constexpr float MaxGain = 3.f;
+
+	/** Bell shaped speed profile of a stroke */
+	float Bell(float T) { return FMath::Sin(PI * T); }
+
+	FORCEINLINE float HorizontalSum(VectorRegister4Float Vector)
+	{
+		alignas(16) float lanes[SimdWidth];
+		VectorStoreAligned(Vector, lanes);
+		return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+
+	/** LB_Keogh: squared distance of the query to the envelope of the template, 4 samples at a time */
+	float LowerBound(const FSwimStrokeRecognizer::FSeries& Query, const FSwimStrokeRecognizer::FSeries& Lower, const FSwimStrokeRecognizer::FSeries& Upper)
+	{
+		const VectorRegister4Float zero = VectorZeroFloat();
+		VectorRegister4Float sum = zero;
+		for (int32 d = 0; d < FSwimStrokeRecognizer::NumDims; ++d)
+			for (int32 i = R; i < R + W; i += SimdWidth)
+			{
+				const VectorRegister4Float q = VectorLoadAligned(Query.v[d] + i);
+				const VectorRegister4Float above = VectorMax(VectorSubtract(q, VectorLoadAligned(Upper.v[d] + i)), zero);
+				const VectorRegister4Float below = VectorMax(VectorSubtract(VectorLoadAligned(Lower.v[d] + i), q), zero);
+				const VectorRegister4Float outside = VectorAdd(above, below);
+				sum = VectorMultiplyAdd(outside, outside, sum);
+			}
+		return HorizontalSum(sum) / W;
+	}
+}
+
+FSwimStrokeRecognizer::FSwimStrokeRecognizer()
+{
+	FMemory::Memzero(m_history, sizeof(m_history));
+	FMemory::Memzero(m_query);
+	Setup(m_settings);
+}
+
+void FSwimStrokeRecognizer::AddDefaultTemplates()
+{
+	for (const float pace : GPaces)
+	{
+		AddTemplate(TEXT("Breaststroke"), [](float T, FVector& OutLeft, FVector& OutRight)
+		{
+			OutLeft = FVector(-80.f * Bell(T), -40.f * FMath::Sin(2.f * PI * T), 0.f);
+			OutRight = FVector(-80.f * Bell(T), 40.f * FMath::Sin(2.f * PI * T), 0.f);
+		}, pace, FVector(120.f, 0.f, 0.f), 0.f);
+
+		// Paddling on one side pushes that side forward, turning towards the other
+		AddTemplate(TEXT("PaddleLeft"), [](float T, FVector& OutLeft, FVector& OutRight)
+		{
+			OutLeft = FVector(-80.f, 0.f, -20.f) * Bell(T);
+			OutRight = FVector::ZeroVector;
+		}, pace, FVector(60.f, 0.f, 0.f), 30.f);
+		AddTemplate(TEXT("PaddleRight"), [](float T, FVector& OutLeft, FVector& OutRight)
+		{
+			OutLeft = FVector::ZeroVector;
+			OutRight = FVector(-80.f, 0.f, -20.f) * Bell(T);
+		}, pace, FVector(60.f, 0.f, 0.f), -30.f);
+
+		AddTemplate(TEXT("TurnLeft"), [](float T, FVector& OutLeft, FVector& OutRight)
+		{
+			OutLeft = FVector(60.f * Bell(T), 0.f, 0.f);
+			OutRight = FVector(-60.f * Bell(T), 0.f, 0.f);
+		}, pace, FVector::ZeroVector, -60.f);
+		AddTemplate(TEXT("TurnRight"), [](float T, FVector& OutLeft, FVector& OutRight)
+		{
+			OutLeft = FVector(-60.f * Bell(T), 0.f, 0.f);
+			OutRight = FVector(60.f * Bell(T), 0.f, 0.f);
+		}, pace, FVector::ZeroVector, 60.f);
+
+		AddTemplate(TEXT("Rise"), [](float T, FVector& OutLeft, FVector& OutRight)
+		{
+			OutLeft = OutRight = FVector(0.f, 0.f, -80.f * Bell(T));
+		}, pace, FVector(0.f, 0.f, 80.f), 0.f);
+		AddTemplate(TEXT("Dive"), [](float T, FVector& OutLeft, FVector& OutRight)
+		{
+			OutLeft = OutRight = FVector(0.f, 0.f, 80.f * Bell(T));
+		}, pace, FVector(0.f, 0.f, -80.f), 0.f);
+	}
+}
+
+void FSwimStrokeRecognizer::Setup(const FSwimStrokeSettings& Settings)
+{
+	m_settings = Settings;
+	m_settings.sampleRate = FMath::Max(Settings.sampleRate, 1.f);
+	m_historyHead = 0;
+	m_numSamples = 0;
+	m_sampleTime = 0.f;
+	m_displacement[0] = m_displacement[1] = FVector::ZeroVector;
+	m_refractorySamples = 0;
+	m_lastStroke = NAME_None;
+	for (FImpulse& impulse : m_impulses)
+		impulse = FImpulse();
+
+	// Stroke lengths in samples depend on the sample rate
+	m_templates.Reset();
+	AddDefaultTemplates();
+}
+
+void FSwimStrokeRecognizer::AddTemplate(FName Name, FStrokeFunction Stroke, float Duration, const FVector& Impulse, float YawImpulse)
+{
+	FTemplate& stroke = m_templates.AddDefaulted_GetRef();
+	stroke.name = Name;
+	stroke.duration = Duration;
+	stroke.impulse = Impulse;
+	stroke.yawImpulse = YawImpulse;
+	stroke.strokeSamples = FMath::Clamp(FMath::RoundToInt(Duration * m_settings.sampleRate), 2, W);
+	FMemory::Memzero(stroke.series);
+
+	// Rest, then the stroke ending with the window
+	double squares = 0.0;
+	const int32 start = W - stroke.strokeSamples;
+	for (int32 i = start; i < W; ++i)
+	{
+		FVector hands[2];
+		Stroke((i - start + .5f) / stroke.strokeSamples, hands[0], hands[1]);
+		for (int32 d = 0; d < NumDims; ++d)
+		{
+			stroke.series.v[d][R + i] = hands[d / 3][d % 3];
+			squares += FMath::Square(hands[d / 3][d % 3]);
+		}
+	}
+
+	// Matched with unit RMS, the amplitude only scales the impulse
+	stroke.rms = FMath::Max(static_cast<float>(FMath::Sqrt(squares / (W * NumDims))), KINDA_SMALL_NUMBER);
+	stroke.lower = stroke.series;
+	stroke.upper = stroke.series;
+	for (int32 d = 0; d < NumDims; ++d)
+	{
+		for (int32 i = 0; i < W; ++i)
+			stroke.series.v[d][R + i] /= stroke.rms;
+		for (int32 i = 0; i < W; ++i)
+		{
+			float lower = MAX_flt;
+			float upper = -MAX_flt;
+			for (int32 j = FMath::Max(i - R, 0); j <= FMath::Min(i + R, W - 1); ++j)
+			{
+				lower = FMath::Min(lower, stroke.series.v[d][R + j]);
+				upper = FMath::Max(upper, stroke.series.v[d][R + j]);
+			}
+			stroke.lower.v[d][R + i] = lower;
+			stroke.upper.v[d][R + i] = upper;
+		}
+	}
+}
+
+float FSwimStrokeRecognizer::Dtw(const FSeries& Query, const FSeries& Template, float BestSoFar)
+{
+	float* previous = m_dtwRows[0];
+	float* current = m_dtwRows[1];
+	// Column 0 of the rows is the boundary, column j + 1 is template sample j
+	previous[0] = 0.f;
+	for (int32 j = 1; j <= W; ++j)
+		previous[j] = MAX_flt;
+
+	const float abandonThreshold = BestSoFar * W;
+	alignas(16) float costs[2 * R + 1 + SimdWidth];
+	for (int32 i = 0; i < W; ++i)
+	{
+		const int32 first = FMath::Max(i - R, 0);
+		const int32 last = FMath::Min(i + R, W - 1);
+
+		// Local costs of the band, 4 columns at a time. Template series are padded, loads past the band are ignored
+		for (int32 j = first; j <= last; j += SimdWidth)
+		{
+			VectorRegister4Float sum = VectorZeroFloat();
+			for (int32 d = 0; d < NumDims; ++d)
+			{
+				const VectorRegister4Float diff = VectorSubtract(VectorLoad(Template.v[d] + R + j), VectorSetFloat1(Query.v[d][R + i]));
+				sum = VectorMultiplyAdd(diff, diff, sum);
+			}
+			VectorStoreAligned(sum, costs + (j - first));
+		}
+
+		for (int32 j = 0; j <= W; ++j)
+			current[j] = MAX_flt;
+		float rowMin = MAX_flt;
+		for (int32 j = first; j <= last; ++j)
+		{
+			const float best = FMath::Min3(previous[j + 1], previous[j], current[j]);
+			current[j + 1] = costs[j - first] + best;
+			rowMin = FMath::Min(rowMin, current[j + 1]);
+		}
+
+		// Every path goes through this row, none can beat the best match anymore
+		if (rowMin > abandonThreshold)
+			return MAX_flt;
+		Swap(previous, current);
+	}
+
+	return previous[W] / W;
+}
+
+int32 FSwimStrokeRecognizer::Recognize(float& OutGain)
+{
+	// Query, oldest sample first
+	double squares = 0.0;
+	for (int32 i = 0; i < W; ++i)
+	{
+		const FVector* hands = m_history[(m_historyHead + i) % W];
+		for (int32 d = 0; d < NumDims; ++d)
+		{
+			m_query.v[d][R + i] = hands[d / 3][d % 3];
+			squares += FMath::Square(hands[d / 3][d % 3]);
+		}
+	}
+
+	// Hands at rest
+	const float rms = FMath::Sqrt(squares / (W * NumDims));
+	if (FMath::Sqrt(squares / (W * 2)) < m_settings.minHandSpeed)
+		return INDEX_NONE;
+
+	const VectorRegister4Float inverseRms = VectorSetFloat1(1.f / rms);
+	for (int32 d = 0; d < NumDims; ++d)
+		for (int32 i = R; i < R + W; i += SimdWidth)
+			VectorStoreAligned(VectorMultiply(VectorLoadAligned(m_query.v[d] + i), inverseRms), m_query.v[d] + i);
+
+	m_order.Reset();
+	for (int32 index = 0; index < m_templates.Num(); ++index)
+		m_order.Emplace(LowerBound(m_query, m_templates[index].lower, m_templates[index].upper), index);
+	m_order.Sort([](const TPair<float, int32>& A, const TPair<float, int32>& B) { return A.Key < B.Key; });
+
+	float bestDistance = m_settings.matchThreshold;
+	int32 bestIndex = INDEX_NONE;
+	for (const TPair<float, int32>& candidate : m_order)
+	{
+		// Sorted by lower bound, no later template can be closer
+		if (candidate.Key >= bestDistance)
+			break;
+		const float distance = Dtw(m_query, m_templates[candidate.Value].series, bestDistance);
+		if (distance < bestDistance)
+		{
+			bestDistance = distance;
+			bestIndex = candidate.Value;
+		}
+	}
+
+	if (bestIndex != INDEX_NONE)
+		OutGain = FMath::Clamp(rms / m_templates[bestIndex].rms, MinGain, MaxGain);
+	return bestIndex;
+}
+
+void FSwimStrokeRecognizer::Update(const FVector& LeftDelta, const FVector& RightDelta, float DeltaTime, FVector& OutAcceleration, float& OutYawAcceleration)
+{
+	OutAcceleration = FVector::ZeroVector;
+	OutYawAcceleration = 0.f;
+	if (DeltaTime <= 0.f)
+		return;
+
+	// Resample the hand velocities at the fixed rate, the velocity of the frame is repeated if it spans several samples
+	const float samplePeriod = 1.f / m_settings.sampleRate;
+	m_displacement[0] += LeftDelta;
+	m_displacement[1] += RightDelta;
+	m_sampleTime += DeltaTime;
+	if (m_sampleTime >= samplePeriod)
+	{
+		const FVector velocities[2] = { m_displacement[0] / m_sampleTime, m_displacement[1] / m_sampleTime };
+		const int32 numSamples = FMath::FloorToInt(m_sampleTime / samplePeriod);
+		m_sampleTime -= numSamples * samplePeriod;
+		m_displacement[0] = velocities[0] * m_sampleTime;
+		m_displacement[1] = velocities[1] * m_sampleTime;
+
+		const double start = FPlatformTime::Seconds();
+		for (int32 sample = 0; sample < FMath::Min(numSamples, W); ++sample)
+		{
+			m_history[m_historyHead][0] = velocities[0];
+			m_history[m_historyHead][1] = velocities[1];
+			m_historyHead = (m_historyHead + 1) % W;
+			m_numSamples = FMath::Min(m_numSamples + 1, W);
+
+			if (m_refractorySamples > 0)
+			{
+				--m_refractorySamples;
+				continue;
+			}
+			if (m_numSamples < W)
+				continue;
+
+			float gain = 1.f;
+			const int32 index = Recognize(gain);
+			if (index == INDEX_NONE)
+				continue;
+
+			// Replace the impulse closest to its end
+			const FTemplate& stroke = m_templates[index];
+			FImpulse* slot = &m_impulses[0];
+			for (FImpulse& impulse : m_impulses)
+				if (impulse.duration - impulse.elapsed < slot->duration - slot->elapsed)
+					slot = &impulse;
+			slot->velocity = stroke.impulse * gain * m_settings.impulseGain;
+			slot->yaw = stroke.yawImpulse * gain * m_settings.impulseGain;
+			slot->duration = stroke.duration;
+			slot->elapsed = 0.f;
+
+			m_lastStroke = stroke.name;
+			m_refractorySamples = stroke.strokeSamples;
+		}
+		m_lastRecognitionTime = FPlatformTime::Seconds() - start;
+	}
+
+	// Raised cosine acceleration profiles, each integrating to its velocity change over its duration
+	for (FImpulse& impulse : m_impulses)
+	{
+		if (impulse.elapsed >= impulse.duration)
+			continue;
+		const float t = FMath::Min(impulse.elapsed + DeltaTime * .5f, impulse.duration);
+		const float profile = (1.f - FMath::Cos(2.f * PI * t / impulse.duration)) / impulse.duration;
+		OutAcceleration += impulse.velocity * profile;
+		OutYawAcceleration += impulse.yaw * profile;
+		impulse.elapsed += DeltaTime;
+	}
+}
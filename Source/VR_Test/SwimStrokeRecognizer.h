@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SwimStrokeRecognizer.generated.h"
+
+USTRUCT(BlueprintType)
+struct FSwimStrokeSettings
+{
+	GENERATED_BODY()
+
+	/** Drive flying with recognised strokes instead of the raw hand drag only */
+	UPROPERTY(EditAnywhere, Category = "Strokes")
+	bool bEnabled = false;
+	/** Rate (Hz) at which hand trajectories are sampled, the recognition window is WindowLength samples long */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="10", ClampMax="90"), Category = "Strokes")
+	float sampleRate = 30.f;
+	/** Max normalised DTW distance per sample for a stroke to be recognised */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0"), Category = "Strokes")
+	float matchThreshold = .45f;
+	/** Hands slower than this (cm/s, RMS over the window) are at rest */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0"), Category = "Strokes")
+	float minHandSpeed = 15.f;
+	/** Scales the impulses of the templates */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0"), Category = "Strokes")
+	float impulseGain = 1.f;
+	/** Share of the raw hand drag acceleration kept on top of the stroke impulses, for small corrections */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0", ClampMax="1"), Category = "Strokes")
+	float rawDragWeight = .2f;
+};
+
+/**
+ * Recognises swim strokes from the hand trajectories, and turns them into smooth impulses.
+ * Hand velocities, in the pawn space, are sampled at a fixed rate. Every sample, the last WindowLength samples are matched against every template
+ * with a banded dynamic time warping: templates are visited by increasing LB_Keogh lower bound, and each DTW is abandoned as soon as a row exceeds the
+ * best distance so far. Costs are computed 4 columns at a time. A recognised stroke starts a raised cosine impulse over the duration of the stroke.
+ */
+class VR_TEST_API FSwimStrokeRecognizer
+{
+public:
+	static constexpr int32 WindowLength = 32;
+	/** Left and right hand velocities */
+	static constexpr int32 NumDims = 6;
+	/** Sakoe-Chiba band radius, in samples */
+	static constexpr int32 BandRadius = 4;
+	static constexpr int32 MaxImpulses = 4;
+
+	/** Velocity of both hands at normalised time T of a stroke */
+	using FStrokeFunction = TFunctionRef<void(float T, FVector& OutLeft, FVector& OutRight)>;
+
+	/** Hand velocities, dimension after dimension. Padded so that unaligned 4-wide loads around the band stay in bounds */
+	struct alignas(16) FSeries
+	{
+		float v[NumDims][WindowLength + 2 * BandRadius + 4];
+	};
+
+private:
+	struct FTemplate
+	{
+		FName name;
+		FSeries series;
+		/** LB_Keogh envelope: min and max of the series over the band */
+		FSeries lower;
+		FSeries upper;
+		float rms;
+		/** Samples of the stroke, at the end of the window */
+		int32 strokeSamples;
+		float duration;
+		/** Pawn space velocity change (cm/s) and yaw rate change (deg/s) of a stroke of template amplitude */
+		FVector impulse;
+		float yawImpulse;
+	};
+
+	struct FImpulse
+	{
+		FVector velocity = FVector::ZeroVector;
+		float yaw = 0.f;
+		float duration = 0.f;
+		float elapsed = 0.f;
+	};
+
+	FSwimStrokeSettings m_settings;
+	TArray<FTemplate> m_templates;
+
+	/** Ring of hand velocity samples */
+	FVector m_history[WindowLength][2];
+	int32 m_historyHead = 0;
+	int32 m_numSamples = 0;
+	FVector m_displacement[2] = { FVector::ZeroVector, FVector::ZeroVector };
+	float m_sampleTime = 0.f;
+	/** Samples left before another stroke can be recognised, so that a stroke is not recognised twice */
+	int32 m_refractorySamples = 0;
+
+	FImpulse m_impulses[MaxImpulses];
+	/** Recognition scratch space */
+	FSeries m_query;
+	TArray<TPair<float, int32>> m_order;
+	float m_dtwRows[2][WindowLength + 1];
+
+	FName m_lastStroke;
+	double m_lastRecognitionTime = 0.0;
+
+	/** Breaststroke, paddles, turns, rise and dive, at several paces */
+	void AddDefaultTemplates();
+	/** @return Normalised banded DTW distance, or more than BestSoFar if abandoned */
+	float Dtw(const FSeries& Query, const FSeries& Template, float BestSoFar);
+	/** @return Index of the best matching template, INDEX_NONE if none is close enough */
+	int32 Recognize(float& OutGain);
+
+public:
+	FSwimStrokeRecognizer();
+
+	/** Resets the recognition and rebuilds the default template library, templates added before are removed */
+	void Setup(const FSwimStrokeSettings& Settings);
+	/**
+	 * Adds a template.
+	 * @param Name			Stroke name
+	 * @param Stroke		Velocity of the hands (cm/s, pawn space) over the normalised stroke time
+	 * @param Duration		Stroke duration (s), at most WindowLength / sampleRate
+	 * @param Impulse		Velocity change (cm/s, pawn space) caused by the stroke
+	 * @param YawImpulse	Yaw rate change (deg/s) caused by the stroke
+	 */
+	void AddTemplate(FName Name, FStrokeFunction Stroke, float Duration, const FVector& Impulse, float YawImpulse);
+	/**
+	 * Feeds the hand displacements of the frame, recognises strokes and evaluates the active impulses.
+	 * @param LeftDelta			Left hand displacement (cm, pawn space)
+	 * @param RightDelta		Right hand displacement (cm, pawn space)
+	 * @param DeltaTime			DeltaTime
+	 * @param OutAcceleration	Pawn space acceleration (cm/s²)
+	 * @param OutYawAcceleration	Yaw acceleration (deg/s²)
+	 */
+	void Update(const FVector& LeftDelta, const FVector& RightDelta, float DeltaTime, FVector& OutAcceleration, float& OutYawAcceleration);
+
+	FName GetLastStroke() const { return m_lastStroke; }
+	/** @return Duration (s) of the last recognition over every template */
+	double GetLastRecognitionTime() const { return m_lastRecognitionTime; }
+	int32 GetNumTemplates() const { return m_templates.Num(); }
+};
@@ -6,14 +6,32 @@
 #include "AntiAliasedTextWidgetComponent.h"
 #include "Components/SphereComponent.h"
 #include "Components/WidgetComponent.h"
+#include "EEGHubClient.h"
+#include "EEGPlotWidgetComponent.h"
+#include "EEGStagePipeline.h"
+#include "EEGTimeSeriesStore.h"
+#include "LslStreams.h"
+#include "MeditationAllocGuard.h"
+#include "MeditationColumnStore.h"
 #include "MotionControllerComponent.h"
+#include "Misc/Paths.h"
+#include "Net/UnrealNetwork.h"
 #include "Camera/CameraComponent.h"
+#include "MeditationSnapshot.h"
+#include "MeditationSynthComponent.h"
+#include "MeditationTelemetry.h"
+#include "VR_Test.h"
 #include "GenericPlatform/GenericPlatformMath.h"
 
 #define CHEAT_QUOTIENT 2.f
 #define CHEAT_FACTOR 20.f
 #define CHEAT_ANGULAR_FACTOR (CHEAT_FACTOR * 2.f)
 
+/** Ticks after a phase change or an EEG source connection before the tick must not allocate */
+static constexpr uint32 GAllocGuardWarmupTicks = 300;
+/** EEG blocks: the one being pulled, and room for the stages holding on to theirs */
+static constexpr int32 GEEGPoolBlocks = 4;
+
 FVector FFloatingData::CalculateDragForce(FVector DeltaPos, float DeltaTime) const
 {
 	// m/s converter
@@ -48,6 +66,8 @@ void FMeditationData::ChangeState()
 
 void FMeditationData::Init()
 {
+	// RegisterValue pushes before popping, the deque never grows past this
+	m_meditationValues.Reserve(relaxationQueueSize + 1);
 	for (int i = 0; i < relaxationQueueSize; ++i)
 		m_meditationValues.PushFirst(0);
 
@@ -55,11 +75,92 @@ void FMeditationData::Init()
 	targetZVelocity = fallVelocity;
 }
 
+bool FMeditationData::ShouldChangeState() const
+{
+	// if relaxation value does not represent state, examine whether to change state or not
+	if (bRelaxed != (relaxationValue >= relaxedThreshold))
+	{
+		int unrelaxedValueCount = 0;
+	
+		for (int i = 0; i < relaxationQueueSize; ++i)
+			if (m_meditationValues[i] < relaxedThreshold)
+				unrelaxedValueCount++;
+		//Rate of values considered as not relaxed
+		const float unrelaxedRate = static_cast<float>(unrelaxedValueCount) / static_cast<float>(relaxationQueueSize);
+		
+		// Change state if the opposite state rate exceeds the chosen threshold
+		return bRelaxed && unrelaxedRate >= oppositeStateThreshold
+			|| !bRelaxed && 1 - unrelaxedRate >= oppositeStateThreshold;
+	}
+	
+	return false;
+}
+
+void FMeditationData::RegisterValue(float Value)
+{
+	m_meditationValues.EmplaceFirst(Value);
+	m_meditationValues.PopLast();
+	// New value registered, so reset interpTime to 0.
+	relaxationInterpTime = 0.f;
+}
+
+void FMeditationData::RegisterValues(const float* Values, int32 Num)
+{
+	// The state follows each value as if it had arrived on time and been fully interpolated, the last one is interpolated from there
+	for (int32 i = 0; i < Num - 1; ++i)
+	{
+		RegisterValue(Values[i]);
+		ComputeAvg();
+		relaxationValue = currAvg;
+		if (ShouldChangeState())
+			ChangeState();
+	}
+	if (Num > 0)
+		RegisterValue(Values[Num - 1]);
+}
+
+void FMeditationData::AssignValue()
+{
+	prevAvg = m_meditationValues.First(); 
+	currAvg = m_meditationValues.Last();
+}
+
+void FMeditationData::ComputeAvg()
+{
+	float sum = 0.f;
+	
+	for (int i = 0; i < m_meditationValues.Num() - 1; ++i)
+		sum += m_meditationValues[i];
+	
+	prevAvg = currAvg;
+	currAvg = sum / sumSize;
+}
+
+void FMeditationData::SetInterpDuration(float Value)
+{
+	interpDuration = Value;
+	interpSpeed = (riseVelocity - fallVelocity) / interpDuration;
+}
+
+void FMeditationData::InterpZVelocity(float DeltaTime)
+{
+	if (!ReachedTargetVelocity())
+		curZVelocity = FMath::FInterpConstantTo(curZVelocity, targetZVelocity, DeltaTime, interpSpeed);
+}
+
+bool FMeditationData::ReachedTargetVelocity() const
+{
+	return curZVelocity == targetZVelocity;
+}
+
 // Sets default values
 AVRPawn::AVRPawn()
 {
  	// Set this pawn to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
+	// The pose is part of the replicated meditation state
+	bReplicates = true;
+	SetReplicatingMovement(false);
 
 	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("DefaultSceneRoot"));
 	
@@ -78,8 +179,19 @@ AVRPawn::AVRPawn()
 	Camera->SetupAttachment(RootComponent);
 	HMD = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("HMD"));
 	HMD->SetupAttachment(Camera);
+
+	MeditationSynth = CreateDefaultSubobject<UMeditationSynthComponent>(TEXT("MeditationSynth"));
+	MeditationSynth->SetupAttachment(Camera);
+	// Activated in BeginPlay for the local meditator only
+	MeditationSynth->bAutoActivate = false;
+
+	RelaxationPlot = CreateDefaultSubobject<UEEGPlotWidgetComponent>(TEXT("RelaxationPlot"));
+	RelaxationPlot->SetupAttachment(RootComponent);
 }
 
+// Out of line for the forward declared members
+AVRPawn::~AVRPawn() = default;
+
 /** Interpolate between A and B, applying an ease out/in function.  Exp controls the degree of the curve. */
 template< class T >
 UE_NODISCARD static FORCEINLINE_DEBUGGABLE T InterpEaseInOut( const T& A, const T& B, float Alpha, float ExpIn, float ExpOut )
@@ -101,7 +213,38 @@ void AVRPawn::BeginPlay()
 {
 	Super::BeginPlay();
 
+	FMeditationAllocGuard::Install();
 	md.Init();
+	m_classifier.Setup(classifierSettings);
+	// The command line names the participant of this machine, not the remote ones
+	if (IsLocalMeditator())
+		FParse::Value(FCommandLine::Get(), TEXT("Participant="), participantId);
+	// Remote meditators are not classified here
+	if (classifierSettings.bEnabled && IsLocalMeditator())
+		m_governor.Setup(governorSettings, classifierSettings.hopSize, m_classifier.GetNumChannels(), participantId);
+	if (classifierSettings.bEnabled && classifierSettings.bPipelined)
+	{
+		m_pipeline = MakeUnique<FEEGStagePipeline>();
+		m_pipeline->Setup(m_classifier, FMath::Max(governorSettings.maxHopSize, classifierSettings.hopSize), &m_governor);
+	}
+	m_ingest.Setup(ingestSettings);
+	m_strokes.Setup(strokeSettings);
+	// The feedback is for the meditator wearing this headset, remote meditators stay silent
+	if (IsLocalMeditator())
+		MeditationSynth->Activate();
+	NetUpdateFrequency = netSendRate;
+	m_bWasRelaxed = md.bRelaxed;
+	m_netAnchor = GetActorLocation();
+	m_netExtrapolatedLocation = GetActorLocation();
+	m_startAltitude = GetActorLocation().Z;
+	m_baseRiseVelocity = md.riseVelocity;
+
+	if (synchronySettings.bEnabled && HasAuthority() && GetNetMode() != NM_Standalone)
+		GetWorld()->GetSubsystem<UMeditationSynchronySubsystem>()->Register(this, synchronySettings);
+
+	FMeditationSnapshot snapshot;
+	if (bWarmStart && FMeditationSnapshot::Load(participantId, snapshot))
+		snapshot.Restore(md, m_classifier, warmStartDecayTime);
 
 	SphereCollider->OnComponentBeginOverlap.AddDynamic(this, &AVRPawn::Landed);
 	SphereCollider->OnComponentEndOverlap.AddDynamic(this, &AVRPawn::BecomeAirborne);
@@ -111,13 +254,432 @@ void AVRPawn::BeginPlay()
 
 	fd.centerOfMass = Camera->GetRelativeLocation();
 	fd.centerOfMass.Z *= fd.centerOfMassHeightRateRelativeToHMD; // We use a center of mass near shoulder height as we don't have legs information
+
+	m_history = MakeShared<FEEGTimeSeriesStore>(2, historySampleRate);
+	m_history->Reserve(FMath::CeilToInt(reservedHistoryDuration * historySampleRate));
+	RelaxationPlot->SetStore(m_history);
+
+	if (bTelemetry || FParse::Param(FCommandLine::Get(), TEXT("Telemetry")))
+	{
+		m_telemetry = MakeUnique<FMeditationTelemetry>(telemetryHost, telemetryPort, telemetryDecimation);
+		m_telemetryStartTime = FPlatformTime::Seconds();
+		if (!m_telemetry->Start())
+		{
+			UE_LOG(LogMeditation, Warning, TEXT("Could not start the telemetry export to %s:%d"), *telemetryHost, telemetryPort);
+			m_telemetry.Reset();
+		}
+	}
+
+	// Markers time the events of the meditator recorded with this machine's EEG, remote replicas land and take off too
+	if (bLslMarkers && IsLocalMeditator())
+	{
+		m_markers = FLslMarkerOutlet::Create(TEXT("VR_Test Markers"), FString::Printf(TEXT("VR_Test-%s"), *participantId));
+		PushMarker(TEXT("Begin"));
+	}
+}
+
+void AVRPawn::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Super::EndPlay(EndPlayReason);
+
+	if (UMeditationSynchronySubsystem* synchrony = GetWorld()->GetSubsystem<UMeditationSynchronySubsystem>())
+		synchrony->Unregister(this);
+
+	// The stages read and write the classifier
+	if (m_pipeline)
+	{
+		const FEEGStagePipeline::FStats pipelineStats = m_pipeline->GetStats();
+		UE_LOG(LogMeditation, Log, TEXT("EEG stage pipeline: %lld hops, %lld stalls, %lld posteriors lost"), pipelineStats.hops, pipelineStats.stalls, pipelineStats.overflowed);
+		m_pipeline.Reset();
+	}
+
+	// Spectators must not overwrite the snapshot with the state of a remote meditator
+	if (IsLocalMeditator())
+	{
+		FMeditationSnapshot snapshot;
+		snapshot.Capture(md, m_classifier);
+		snapshot.Save(participantId);
+	}
+
+	if (m_params)
+	{
+		UE_LOG(LogMeditation, Log, TEXT("Parameters of %s: %u updates applied, %u rejected"), *participantId, m_params->GetNumApplied(), m_params->GetNumRejected());
+		m_paramsReader.Reset();
+		m_params.Reset();
+	}
+	m_telemetry.Reset();
+	m_markers.Reset();
+	m_sessionStore.Reset();
+	if (m_lslConnectTask.IsValid())
+		delete m_lslConnectTask.GetResult();
+	// The worker classification reads the classifier
+	if (m_classifyTask.IsValid())
+		m_classifyTask.Wait();
+
+	const FMeditationIngestStats& stats = m_ingest.GetStats();
+	UE_LOG(LogMeditation, Log, TEXT("Meditation ingest: %lld values, %lld overflowed, %lld coalesced, %lld dropped, max depth %d"),
+		stats.pushed, stats.overflowed, stats.coalesced, stats.dropped, stats.maxDepth);
+	if (FMeditationAllocGuard::IsInstalled())
+		UE_LOG(LogMeditation, Log, TEXT("Allocation guard: %lld allocations in steady state ticks"), FMeditationAllocGuard::GetViolations());
+}
+
+void AVRPawn::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	// The owner computes the state, it does not need it back
+	DOREPLIFETIME_CONDITION(AVRPawn, m_netState, COND_SkipOwner);
+	DOREPLIFETIME_CONDITION(AVRPawn, m_netAnchor, COND_SkipOwner);
+	DOREPLIFETIME(AVRPawn, m_groupSynchrony);
+	DOREPLIFETIME(AVRPawn, m_synchrony);
+}
+
+bool AVRPawn::IsLocalMeditator() const
+{
+	return GetNetMode() == NM_Standalone || IsLocallyControlled();
 }
 
 // Called every frame
 void AVRPawn::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
-	tickEvent.Broadcast(DeltaTime);
+
+	// Remote meditators are driven by the replicated state
+	if (!IsLocalMeditator())
+	{
+		ExtrapolateNetState(DeltaTime);
+		RecordHistory(DeltaTime);
+		return;
+	}
+
+	// The meditation pipeline must not allocate once warmed up, the engine calls it makes are allowed to
+	FMeditationAllocGuard::FScope allocGuard(m_steadyTicks >= GAllocGuardWarmupTicks);
+	++m_steadyTicks;
+
+	if (!m_params)
+	{
+		FMeditationAllocGuard::FAllow allow;
+		OpenParamService();
+	}
+	ApplyParams();
+
+	if (classifierSettings.bEnabled)
+	{
+		CollectClassification();
+		if (m_governor.Update(DeltaTime))
+			ApplyQualityLevel();
+	}
+	PullEEGSamples(DeltaTime);
+	m_ingest.Drain(md);
+	// Shared calm lifts everyone faster, during the rise only
+	if (synchronySettings.bEnabled && m_phase == EMeditationPhase::Rise)
+	{
+		md.riseVelocity = m_baseRiseVelocity * (1.f + synchronySettings.riseGain * m_groupSynchrony);
+		if (md.bRelaxed)
+			md.targetZVelocity = md.riseVelocity;
+	}
+	if (m_bPhaseBound && m_phase != EMeditationPhase::Flying)
+		UpdateRelaxation(DeltaTime);
+	{
+		// Moving runs the overlap events, and the session store is opened once
+		FMeditationAllocGuard::FAllow allow;
+		if (m_bPhaseBound)
+		{
+			switch (m_phase)
+			{
+			case EMeditationPhase::Intro:
+				IntroUpdateUpVelocity(DeltaTime);
+				break;
+			case EMeditationPhase::Rise:
+				UpdateUpVelocity(DeltaTime);
+				break;
+			case EMeditationPhase::Flying:
+				UpdateFlyingVelocity(DeltaTime);
+				break;
+			}
+		}
+		if (bRecordSession && !m_sessionStore)
+			OpenSessionStore();
+	}
+	RecordHistory(DeltaTime);
+
+	const bool bStateFlipped = md.bRelaxed != m_bWasRelaxed;
+	m_bWasRelaxed = md.bRelaxed;
+	{
+		FMeditationAllocGuard::FAllow allow;
+		// Audio feedback follows the meditation state computed this frame
+		MeditationSynth->SetMeditationParams(md.relaxationValue, md.bRelaxed, md.curZVelocity / FMath::Max(md.riseVelocity, KINDA_SMALL_NUMBER));
+		if (bStateFlipped)
+			PushMarker(md.bRelaxed ? TEXT("State/Relaxed") : TEXT("State/Unrelaxed"));
+		SendNetState(DeltaTime, bStateFlipped);
+	}
+	RecordTelemetry(DeltaTime);
+}
+
+void AVRPawn::RecordTelemetry(float DeltaTime)
+{
+	++m_telemetryFrame;
+	if (!m_telemetry || !m_telemetry->ShouldRecord())
+		return;
+
+	const uint32 startCycles = FPlatformTime::Cycles();
+
+	FMeditationTelemetrySample sample;
+	sample.frame = m_telemetryFrame;
+	sample.time = static_cast<float>(FPlatformTime::Seconds() - m_telemetryStartTime);
+	sample.deltaTime = DeltaTime;
+	sample.relaxationValue = md.relaxationValue;
+	sample.currAvg = md.currAvg;
+	sample.prevAvg = md.prevAvg;
+	sample.curZVelocity = md.curZVelocity;
+	sample.targetZVelocity = md.targetZVelocity;
+	sample.leftHandForce = FVector3f(m_leftHandForce);
+	sample.rightHandForce = FVector3f(m_rightHandForce);
+	sample.recordCycles = m_telemetryRecordCycles;
+	sample.flags = (md.bRelaxed ? FMeditationTelemetrySample::Relaxed : 0) | (bGrounded ? FMeditationTelemetrySample::Grounded : 0)
+		| (m_phase == EMeditationPhase::Flying ? FMeditationTelemetrySample::Flying : 0);
+	m_telemetry->Record(sample);
+
+	m_telemetryRecordCycles = FPlatformTime::Cycles() - startCycles;
+	m_telemetry->AddRecordCost(m_telemetryRecordCycles);
+}
+
+void AVRPawn::SendNetState(float DeltaTime, bool bStateFlipped)
+{
+	if (GetNetMode() == NM_Standalone)
+		return;
+
+	if (bStateFlipped)
+	{
+		if (HasAuthority())
+			MulticastChangeState(md.bRelaxed);
+		else
+			ServerChangeState(md.bRelaxed);
+	}
+
+	const float sendPeriod = 1.f / netSendRate;
+	m_netSendTime += DeltaTime;
+	if (m_netSendTime < sendPeriod)
+		return;
+	m_netSendTime = FMath::Fmod(m_netSendTime, sendPeriod);
+
+	const FVector location = GetActorLocation();
+	if ((location - m_netAnchor).GetAbsMax() > FMeditationNetState::MaxAnchorOffset)
+		m_netAnchor = location;
+
+	FMeditationNetState state;
+	state.relaxationValue = md.relaxationValue;
+	state.bRelaxed = md.bRelaxed;
+	state.bGrounded = bGrounded;
+	state.bFlying = m_phase == EMeditationPhase::Flying;
+	state.curZVelocity = md.curZVelocity;
+	state.targetZVelocity = md.targetZVelocity;
+	state.offset = location - m_netAnchor;
+	state.rotation = GetActorRotation();
+	state.velocity = velocity;
+
+	if (HasAuthority())
+		m_netState = state;
+	else
+		ServerUpdateNetState(state, m_netAnchor);
+}
+
+void AVRPawn::PushMarker(const TCHAR* Marker) const
+{
+	if (m_markers)
+		m_markers->Push(Marker);
+}
+
+void AVRPawn::ExtrapolateNetState(float DeltaTime)
+{
+	// Same constant rate interpolation as FMeditationData::InterpZVelocity
+	const float interpSpeed = (md.riseVelocity - md.fallVelocity) / FMath::Max(md.interpDuration, KINDA_SMALL_NUMBER);
+	md.curZVelocity = FMath::FInterpConstantTo(md.curZVelocity, md.targetZVelocity, DeltaTime, interpSpeed);
+
+	FVector extrapolatedVelocity = velocity;
+	if (!m_netState.bFlying)
+		extrapolatedVelocity = FVector(0.f, 0.f, !md.bRelaxed && bGrounded ? 0.f : md.curZVelocity);
+	m_netExtrapolatedLocation += extrapolatedVelocity * DeltaTime;
+
+	const FVector location = GetActorLocation() + extrapolatedVelocity * DeltaTime;
+	const float correction = FMath::Clamp(DeltaTime * netCorrectionSpeed, 0.f, 1.f);
+	SetActorLocationAndRotation(FMath::Lerp(location, m_netExtrapolatedLocation, correction),
+		FMath::RInterpTo(GetActorRotation(), m_netState.rotation, DeltaTime, netCorrectionSpeed));
+	md.relaxationValue = FMath::FInterpTo(md.relaxationValue, m_netState.relaxationValue, DeltaTime, netCorrectionSpeed);
+}
+
+void AVRPawn::SetSynchrony(float Group, float Individual)
+{
+	m_groupSynchrony = Group;
+	m_synchrony = Individual;
+}
+
+void AVRPawn::OnRep_NetState()
+{
+	m_netExtrapolatedLocation = m_netAnchor + m_netState.offset;
+	md.relaxationValue = m_netState.relaxationValue;
+	md.bRelaxed = m_netState.bRelaxed;
+	md.curZVelocity = m_netState.curZVelocity;
+	md.targetZVelocity = m_netState.targetZVelocity;
+	bGrounded = m_netState.bGrounded;
+	velocity = m_netState.velocity;
+}
+
+void AVRPawn::ServerUpdateNetState_Implementation(const FMeditationNetState& State, FVector_NetQuantize Anchor)
+{
+	m_netAnchor = Anchor;
+	m_netState = State;
+	OnRep_NetState();
+}
+
+void AVRPawn::ServerChangeState_Implementation(bool bNewRelaxed)
+{
+	MulticastChangeState(bNewRelaxed);
+}
+
+void AVRPawn::MulticastChangeState_Implementation(bool bNewRelaxed)
+{
+	if (IsLocallyControlled())
+		return;
+
+	md.bRelaxed = bNewRelaxed;
+	md.targetZVelocity = bNewRelaxed ? md.riseVelocity : md.fallVelocity;
+	m_netState.bRelaxed = bNewRelaxed;
+}
+
+void AVRPawn::RecordHistory(float DeltaTime)
+{
+	const float samplePeriod = 1.f / historySampleRate;
+	// Repeat the current state for every sample period elapsed, the store expects a fixed sample rate
+	for (m_historyTime += DeltaTime; m_historyTime >= samplePeriod; m_historyTime -= samplePeriod)
+	{
+		const float values[] = { md.relaxationValue, md.curZVelocity };
+		m_history->Append(values);
+
+		if (m_sessionStore)
+		{
+			FMeditationColumnRow row;
+			row[EMeditationColumn::RelaxationValue] = md.relaxationValue;
+			row[EMeditationColumn::Relaxed] = md.bRelaxed ? 1.f : 0.f;
+			row[EMeditationColumn::ZVelocity] = md.curZVelocity;
+			row[EMeditationColumn::Altitude] = GetActorLocation().Z - m_startAltitude;
+			row[EMeditationColumn::Phase] = static_cast<float>(m_phase);
+			m_sessionStore->Append(row);
+		}
+	}
+}
+
+void AVRPawn::OpenSessionStore()
+{
+	const FString path = FPaths::ProjectSavedDir() / TEXT("Meditation") / TEXT("Sessions")
+		/ FString::Printf(TEXT("%s-%s.mcol"), *FPaths::MakeValidFileName(participantId), *FDateTime::Now().ToString());
+	m_sessionStore = FMeditationColumnWriter::Create(path, historySampleRate, participantId);
+	if (!m_sessionStore)
+	{
+		UE_LOG(LogMeditation, Warning, TEXT("Could not create the session store %s"), *path);
+		bRecordSession = false;
+	}
+}
+
+void AVRPawn::OpenParamService()
+{
+	FMeditationParams params(md, fd);
+	params.riseVelocity = m_baseRiseVelocity;
+	m_params = MakeUnique<FMeditationParamService>(participantId, params, paramsPort);
+	m_paramsReader = MakeUnique<FMeditationParamService::FReader>(*m_params);
+}
+
+void AVRPawn::ApplyParams()
+{
+	// The whole snapshot at once, the frame never mixes parameters of two updates
+	const FMeditationParams& params = m_paramsReader->Pin();
+	if (params.version != m_paramsVersion)
+	{
+		m_paramsVersion = params.version;
+		params.ApplyTo(md, fd, m_phase == EMeditationPhase::Intro);
+		// The synchrony boost applies on top of the retuned velocity
+		m_baseRiseVelocity = params.riseVelocity;
+	}
+	m_paramsReader->Unpin();
+}
+
+void AVRPawn::PullEEGSamples(float DeltaTime)
+{
+	if (eegSource == EEEGSourceType::Blueprint || !classifierSettings.bEnabled)
+		return;
+
+	constexpr float retryPeriod = 2.f;
+	if (!m_eegSource)
+	{
+		m_eegSourceRetryTime -= DeltaTime;
+		if (m_eegSourceRetryTime > 0.f)
+			return;
+		m_eegSourceRetryTime = retryPeriod;
+
+		FMeditationAllocGuard::FAllow allow;
+		m_steadyTicks = 0;
+		if (eegSource == EEEGSourceType::Hub)
+			m_eegSource = FEEGHubClient::Connect(static_cast<uint32>(hubChannelMask), hubDecimation);
+		else if (!m_lslConnectTask.IsValid())
+		{
+			m_lslConnectTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [StreamType = lslStreamType]
+			{
+				return FLslInlet::Connect(StreamType, retryPeriod).Release();
+			});
+			return;
+		}
+		else if (m_lslConnectTask.IsCompleted())
+		{
+			m_eegSource.Reset(m_lslConnectTask.GetResult());
+			m_lslConnectTask = {};
+		}
+		else
+		{
+			m_eegSourceRetryTime = 0.f;
+			return;
+		}
+
+		if (!m_eegSource)
+			return;
+		if (m_eegSource->GetNumChannels() != classifierSettings.numChannels)
+		{
+			UE_LOG(LogMeditation, Warning, TEXT("EEG source has %d channels, the classifier expects %d"), m_eegSource->GetNumChannels(), classifierSettings.numChannels);
+			m_eegSource.Reset();
+			return;
+		}
+		if (!FMath::IsNearlyEqual(m_eegSource->GetSampleRate(), classifierSettings.sampleRate, 1.f))
+			UE_LOG(LogMeditation, Warning, TEXT("EEG source runs at %g Hz, the classifier expects %g Hz"), m_eegSource->GetSampleRate(), classifierSettings.sampleRate);
+
+		// Half a second per block. The stages must have given back the blocks of the previous connection
+		if (m_pipeline)
+			m_pipeline->Flush();
+		m_eegPool.Setup(GEEGPoolBlocks, FMath::Max(FMath::CeilToInt(m_eegSource->GetSampleRate() * .5f), 1), m_eegSource->GetNumChannels());
+	}
+
+	// Pulled again until the source is empty after a hitch
+	int32 numFrames;
+	do
+	{
+		FEEGBlockRef block = m_eegPool.Acquire();
+		if (!block)
+			return;
+		numFrames = m_eegSource->Pull(block->GetSamples(), block->GetTimestamps(), block->GetFrameCapacity());
+		if (numFrames < 0)
+		{
+			FMeditationAllocGuard::FAllow allow;
+			UE_LOG(LogMeditation, Warning, TEXT("Lost the EEG source, connecting again"));
+			m_eegSource.Reset();
+			m_eegSourceRetryTime = 0.f;
+			return;
+		}
+		block->SetFrames(m_eegSource->GetNumChannels(), numFrames);
+		// The pipeline filters the block where it was pulled, on the workers
+		if (m_pipeline)
+			m_pipeline->AddBlock(MoveTemp(block), m_eegSource->GetNumChannels());
+		else
+			RegisterEEGSamples(block->GetSamples(), numFrames);
+	}
+	while (numFrames == m_eegPool.GetFrameCapacity());
 }
 
 void AVRPawn::UpdateRelaxation(float DeltaTime)
@@ -135,9 +697,7 @@ void AVRPawn::UpdateUpVelocity(float DeltaTime)
 		return;
 	
 	// Interpolate the velocity towards the target velocity
-	if (!ReachedTargetVelocity())
-		md.curZVelocity = FMath::FInterpConstantTo(md.curZVelocity, md.targetZVelocity,
-			DeltaTime, md.interpSpeed);
+	md.InterpZVelocity(DeltaTime);
 
 	AddActorWorldOffset(DeltaTime * FVector(0.f, 0.f, md.curZVelocity));
 }
@@ -167,12 +727,16 @@ void AVRPawn::UpdateFlyingVelocity(float DeltaTime)
 	// hands delta position, distance since last frame
 	FVector leftForce = left - m_prevLeftHandLocation;
 	FVector rightForce = right - m_prevRightHandLocation;
+	const FVector leftDelta = leftForce;
+	const FVector rightDelta = rightForce;
 	m_prevLeftHandLocation = left;
 	m_prevRightHandLocation = right;
 
 	// applying drag created by water/air resistance to compute forces produced by the hands
 	leftForce = fd.CalculateDragForce(leftForce, DeltaTime);
 	rightForce = fd.CalculateDragForce(rightForce, DeltaTime);
+	m_leftHandForce = leftForce;
+	m_rightHandForce = rightForce;
 	
 	// hands position relative to shoulder height
 	FVector leftRelPos = left - fd.centerOfMass;
@@ -190,8 +754,18 @@ void AVRPawn::UpdateFlyingVelocity(float DeltaTime)
 	// constraint rotation only on z for now
 	angularAcceleration = GetActorTransform().TransformVector({0.f, 0.f, angularAcceleration.Z});
 	
+	// Recognised strokes replace most of the raw drag with smooth impulses, so that the movement follows whole strokes rather than hand jitter
+	float strokeYawAcceleration = 0.f;
+	if (strokeSettings.bEnabled)
+	{
+		FVector strokeAcceleration;
+		m_strokes.Update(leftDelta, rightDelta, DeltaTime, strokeAcceleration, strokeYawAcceleration);
+		acceleration = acceleration * strokeSettings.rawDragWeight + GetActorTransform().TransformVector(strokeAcceleration) * DeltaTime / CHEAT_FACTOR;
+		angularAcceleration *= strokeSettings.rawDragWeight;
+	}
+
 	velocity = (velocity + acceleration * CHEAT_FACTOR) * (1 - fd.drag * DeltaTime);
-	angularVelocity = (angularVelocity + angularAcceleration * FMath::Square(DeltaTime) * CHEAT_ANGULAR_FACTOR)
+	angularVelocity = (angularVelocity + angularAcceleration * FMath::Square(DeltaTime) * CHEAT_ANGULAR_FACTOR + FVector(0.f, 0.f, strokeYawAcceleration * DeltaTime))
 	* (1 - DeltaTime * fd.drag);
 
 	// Update the position and rotation of the character
@@ -205,93 +779,192 @@ void AVRPawn::Landed(UPrimitiveComponent* OverlappedComponent, AActor* OtherActo
                      int32 OtherBodyIndex, bool bFromSweep, const FHitResult & SweepResult)
 {
 	bGrounded = true;
+	PushMarker(TEXT("Landed"));
 }
 
 void AVRPawn::BecomeAirborne(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor,
 	UPrimitiveComponent* OtherComp, int32 OtherBodyIndex)
 {
 	bGrounded = false;
+	PushMarker(TEXT("Airborne"));
 }
 
 bool AVRPawn::ReachedTargetVelocity()
 {
-	return md.curZVelocity == md.targetZVelocity;
+	return md.ReachedTargetVelocity();
 }
 
 void AVRPawn::SetIntroInterpDuration(float Value)
 {
 	md.interpDuration = Value;
 	md.interpSpeed = 1.f / md.interpDuration;
+	// Later updates start from it
+	if (m_params)
+		m_params->Submit(FString::Printf(TEXT("interpDuration=%g"), Value));
 }
 
 void AVRPawn::SetInterpDuration(float Value)
 {
-	md.interpDuration = Value;
-	md.interpSpeed = (md.riseVelocity - md.fallVelocity) / md.interpDuration;
+	md.SetInterpDuration(Value);
+	if (m_params)
+		m_params->Submit(FString::Printf(TEXT("interpDuration=%g"), Value));
 }
 
 bool AVRPawn::ShouldChangeState()
 {
-	// if relaxation value does not represent state, examine whether to change state or not
-	if (md.bRelaxed != (md.relaxationValue >= md.relaxedThreshold))
+	return md.ShouldChangeState();
+}
+
+void AVRPawn::RegisterValue(float Value)
+{
+	md.RegisterValue(Value);
+}
+
+void AVRPawn::PushMeditationSample(float Value)
+{
+	m_ingest.Push(Value);
+}
+
+FMeditationIngestStats AVRPawn::GetIngestStats() const
+{
+	return m_ingest.GetStats();
+}
+
+void AVRPawn::RegisterEEGSamples(const float* Interleaved, int32 NumFrames)
+{
+	if (!classifierSettings.bEnabled)
+		return;
+	if (m_pipeline)
 	{
-		int unrelaxedValueCount = 0;
-	
-		for (int i = 0; i < md.relaxationQueueSize; ++i)
-			if (md.m_meditationValues[i] < md.relaxedThreshold)
-				unrelaxedValueCount++;
-		//Rate of values considered as not relaxed
-		const float unrelaxedRate = static_cast<float>(unrelaxedValueCount) / static_cast<float>(md.relaxationQueueSize);
-		
-		// Change state if the opposite state rate exceeds the chosen threshold
-		return md.bRelaxed && unrelaxedRate >= md.oppositeStateThreshold
-			|| !md.bRelaxed && 1 - unrelaxedRate >= md.oppositeStateThreshold;
+		m_pipeline->AddSamples(Interleaved, NumFrames, classifierSettings.numChannels);
+		return;
+	}
+
+	const int32 numChannels = classifierSettings.numChannels;
+	for (int32 frame = 0; frame < NumFrames; ++frame)
+	{
+		const uint64 filterStart = FPlatformTime::Cycles64();
+		const bool bHop = m_classifier.AddSample(Interleaved + frame * numChannels);
+		m_governor.AddStageCost(FEEGQualityGovernor::Filter, FPlatformTime::Cycles64() - filterStart);
+		if (!bHop || !m_classifier.IsCalibrated())
+			continue;
+
+		if (!m_governor.GetLevel().bWorker)
+		{
+			const uint64 classifyStart = FPlatformTime::Cycles64();
+			m_ingest.Push(m_classifier.Classify() * 100.f);
+			m_governor.AddStageCost(FEEGQualityGovernor::Classify, FPlatformTime::Cycles64() - classifyStart);
+			continue;
+		}
+
+		// One classification in flight at most, the hop is skipped if the previous one is not done
+		if (m_bClassifyPending)
+			continue;
+		m_classifier.GetCovariances(m_workerCovariances);
+		m_bClassifyPending = true;
+		// Task launches go through the task system allocator
+		FMeditationAllocGuard::FAllow allow;
+		m_classifyTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this]
+		{
+			FMeditationAllocGuard::FScope allocGuard;
+			const uint64 classifyStart = FPlatformTime::Cycles64();
+			const float posterior = m_classifier.Classify(m_workerCovariances, m_workerScratch);
+			m_governor.AddStageCost(FEEGQualityGovernor::Classify, FPlatformTime::Cycles64() - classifyStart);
+			return posterior;
+		});
 	}
-	
-	return false;
 }
 
-void AVRPawn::RegisterValue(float Value)
+void AVRPawn::CollectClassification()
 {
-	md.m_meditationValues.EmplaceFirst(Value);
-	md.m_meditationValues.PopLast();
-	// New value registered, so reset interpTime to 0.
-	md.relaxationInterpTime = 0.f;
+	float posterior;
+	while (m_pipeline && m_pipeline->PopPosterior(posterior))
+		m_ingest.Push(posterior * 100.f);
+
+	if (m_bClassifyPending && m_classifyTask.IsCompleted())
+	{
+		m_ingest.Push(m_classifyTask.GetResult() * 100.f);
+		m_bClassifyPending = false;
+	}
+}
+
+void AVRPawn::ApplyQualityLevel()
+{
+	const FEEGQualityGovernor::FLevel& level = m_governor.GetLevel();
+	// A new level may resize the classifier buffers
+	FMeditationAllocGuard::FAllow allow;
+	m_steadyTicks = 0;
+	// The worker reads the active channel count
+	if (m_pipeline)
+		m_pipeline->Flush();
+	if (m_bClassifyPending)
+	{
+		m_classifyTask.Wait();
+		CollectClassification();
+	}
+	m_classifier.SetHopSize(level.hopSize);
+	m_classifier.SetActiveChannels(level.numChannels);
+	if (m_pipeline)
+		m_pipeline->SetHopSize(level.hopSize);
+}
+
+void AVRPawn::RegisterEEGFrame(const TArray<float>& Channels)
+{
+	if (Channels.Num() >= classifierSettings.numChannels)
+		RegisterEEGSamples(Channels.GetData(), 1);
+}
+
+void AVRPawn::BeginClassifierCalibration(bool bRelaxed)
+{
+	// The stages record the calibration examples
+	if (m_pipeline)
+		m_pipeline->Flush();
+	m_classifier.BeginCalibration(bRelaxed);
+}
+
+bool AVRPawn::EndClassifierCalibration()
+{
+	// The worker classification reads the calibration
+	if (m_pipeline)
+		m_pipeline->Flush();
+	if (m_bClassifyPending)
+	{
+		m_classifyTask.Wait();
+		CollectClassification();
+	}
+	return m_classifier.EndCalibration();
 }
 
 void AVRPawn::AssignValue()
 {
-	md.prevAvg = md.m_meditationValues.First(); 
-	md.currAvg = md.m_meditationValues.Last();
+	md.AssignValue();
 }
 
 void AVRPawn::ComputeAvg()
 {	
-	float sum = 0.f;
-	
-	for (int i = 0; i < md.m_meditationValues.Num() - 1; ++i)
-		sum += md.m_meditationValues[i];
-	
-	md.prevAvg = md.currAvg;
-	md.currAvg = sum / md.sumSize;
+	md.ComputeAvg();
 }
 
 void AVRPawn::BindIntroTick()
 {
-	tickEvent.Clear();
-	tickEvent.AddUObject(this, &AVRPawn::UpdateRelaxation);	
-	tickEvent.AddUObject(this, &AVRPawn::IntroUpdateUpVelocity);
+	m_phase = EMeditationPhase::Intro;
+	m_bPhaseBound = true;
+	m_steadyTicks = 0;
+	PushMarker(TEXT("Phase/Intro"));
 }
 
 void AVRPawn::BindDefaultRiseTick()
 {
-	tickEvent.Clear();
-	tickEvent.AddUObject(this, &AVRPawn::UpdateRelaxation);	
-	tickEvent.AddUObject(this, &AVRPawn::UpdateUpVelocity);
+	m_phase = EMeditationPhase::Rise;
+	m_bPhaseBound = true;
+	m_steadyTicks = 0;
+	PushMarker(TEXT("Phase/Rise"));
 }
 
 void AVRPawn::BindFlyingTick()
 {
-	tickEvent.Clear();
-	tickEvent.AddUObject(this, &AVRPawn::UpdateFlyingVelocity);
+	m_phase = EMeditationPhase::Flying;
+	m_bPhaseBound = true;
+	m_steadyTicks = 0;
+	PushMarker(TEXT("Phase/Flying"));
 }
@@ -5,9 +5,38 @@
 #include "CoreMinimal.h"
 #include "Containers/Deque.h"
 #include "GameFramework/Pawn.h"
+#include "EEGQualityGovernor.h"
+#include "EEGSampleBlock.h"
+#include "EEGSampleSource.h"
+#include "MeditationIngestQueue.h"
+#include "MeditationNetState.h"
+#include "MeditationParams.h"
+#include "MeditationSynchrony.h"
+#include "RiemannClassifier.h"
+#include "SwimStrokeRecognizer.h"
+#include "Tasks/Task.h"
 #include "VRPawn.generated.h"
 
-DECLARE_EVENT_OneParam(AVRPawn, TickEvent, float)
+/** Where the multi-channel EEG fed to the classifier comes from */
+UENUM(BlueprintType)
+enum class EEEGSourceType : uint8
+{
+	/** Frames are pushed from Blueprint with RegisterEEGFrame */
+	Blueprint,
+	/** Subscription to the local EEG hub, see UEEGHubCommandlet */
+	Hub,
+	/** Lab Streaming Layer stream of this machine, needs liblsl (see VR_Test.Build.cs) */
+	Lsl
+};
+
+/** Step of the experience, selected from Blueprint with the Bind functions */
+UENUM(BlueprintType)
+enum class EMeditationPhase : uint8
+{
+	Intro,
+	Rise,
+	Flying
+};
 
 USTRUCT(BlueprintType)
 struct FFloatingData
@@ -104,6 +133,39 @@ struct FMeditationData
 	void LerpRelaxation(float DeltaTime);
 	void ChangeState();
 	void Init();
+	/**
+	 * Evaluates whether or not bRelaxed should change.
+	 * @return True if bRelaxed should get inverted. False otherwise.
+	 */
+	bool ShouldChangeState() const;
+	/**
+	 * Registers a new value into m_meditationValues, and pops/deletes the last one.
+	 * @param Value			New value to be registered
+	 */
+	void RegisterValue(float Value);
+	/**
+	 * Registers values that arrived together one after the other, updating the averages and the state after each but the last.
+	 * The relaxation value is then interpolated towards the average of the last one, ComputeAvg must be called.
+	 * @param Values		Values, oldest first
+	 * @param Num			Number of values
+	 */
+	void RegisterValues(const float* Values, int32 Num);
+	/** Assigns the first and last values of m_meditationValues to m_prevAvg and m_currAvg. */
+	void AssignValue();
+	/** Updates m_prevAvg and m_currAvg based on the just retrieved new value, and the past values together. */
+	void ComputeAvg();
+	/**
+	 * Sets the duration the interpolation to reach the max rise speed should take, and the resulting interpolation speed.
+	 * @param Value			duration
+	 */
+	void SetInterpDuration(float Value);
+	/**
+	 * Interpolates the current up velocity towards the target velocity.
+	 * @param DeltaTime	DeltaTime
+	 */
+	void InterpZVelocity(float DeltaTime);
+	/** @return True if velocity equals target velocity. */
+	bool ReachedTargetVelocity() const;
 };
 
 UCLASS()
@@ -114,6 +176,13 @@ class VR_TEST_API AVRPawn : public APawn
 	/** Used to compute the velocity of each of the hands on each frame */
 	FVector m_prevLeftHandLocation;
 	FVector m_prevRightHandLocation;
+	UPROPERTY(EditAnywhere, DisplayName="Swim Strokes", meta = (AllowPrivateAccess = "true"), Category="MainFeatures")
+	FSwimStrokeSettings strokeSettings;
+	/** Turns recognised hand strokes into smooth impulses while flying */
+	FSwimStrokeRecognizer m_strokes;
+	/** Hand forces of the last flying frame, for telemetry */
+	FVector m_leftHandForce = FVector::ZeroVector;
+	FVector m_rightHandForce = FVector::ZeroVector;
 
 	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category="MainFeatures", DisplayName="Floating", meta=(AllowPrivateAccess=true))
 	FFloatingData fd;
@@ -133,11 +202,199 @@ class VR_TEST_API AVRPawn : public APawn
 	class UStaticMeshComponent* HMD;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (AllowPrivateAccess = "true"))
 	class UCameraComponent* Camera;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (AllowPrivateAccess = "true"))
+	class UMeditationSynthComponent* MeditationSynth;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (AllowPrivateAccess = "true"))
+	class UEEGPlotWidgetComponent* RelaxationPlot;
+
+	/** Relaxation value (channel 0) and up velocity (channel 1) history, sampled at historySampleRate for the in-VR plots */
+	TSharedPtr<class FEEGTimeSeriesStore> m_history;
+	/** Time accumulated since the last history sample */
+	float m_historyTime = 0.f;
+
+	/** Rate at which the relaxation history is sampled */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1", AllowPrivateAccess = "true"), Category="MainFeatures")
+	float historySampleRate = 30.f;
+	/** Duration (s) of history allocated at BeginPlay, the history only allocates again in longer sessions */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0", AllowPrivateAccess = "true"), Category="MainFeatures")
+	float reservedHistoryDuration = 3600.f;
+	/** Also write the sampled state to a columnar store in Saved/Meditation/Sessions, for study-wide queries (see UMeditationQueryCommandlet) */
+	UPROPERTY(EditAnywhere, meta = (AllowPrivateAccess = "true"), Category="MainFeatures")
+	bool bRecordSession = false;
+	TUniquePtr<class FMeditationColumnWriter> m_sessionStore;
+	/** Actor Z at BeginPlay, stored altitudes are relative to it */
+	float m_startAltitude = 0.f;
+
+	/** Participant whose meditation state is restored on BeginPlay and saved on EndPlay. Overridden by -Participant= on the command line */
+	UPROPERTY(EditAnywhere, meta = (AllowPrivateAccess = "true"), Category="MainFeatures")
+	FString participantId = TEXT("Default");
+	/** Restore the meditation window of the previous session of the participant instead of starting unrelaxed */
+	UPROPERTY(EditAnywhere, meta = (AllowPrivateAccess = "true"), Category="MainFeatures")
+	bool bWarmStart = true;
+	/** Time constant (s) of the decay of the restored state towards neutral, depending on the time elapsed since it was saved */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1", AllowPrivateAccess = "true"), Category="MainFeatures")
+	float warmStartDecayTime = 600.f;
+	/** Local UDP port the operator tools send parameter updates to (see UMeditationParamsCommandlet), 0 to only take them from the Meditation.Params command */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0", AllowPrivateAccess = "true"), Category="MainFeatures")
+	int32 paramsPort = FMeditationParamService::DefaultPort;
+	/** Parameters of the participant retuned live, created on the first tick of the locally controlled pawn */
+	TUniquePtr<FMeditationParamService> m_params;
+	TUniquePtr<FMeditationParamService::FReader> m_paramsReader;
+	/** Version of the snapshot applied to md and fd */
+	uint32 m_paramsVersion = 0;
+
+	UPROPERTY(EditAnywhere, DisplayName="Classifier", meta = (AllowPrivateAccess = "true"), Category="MainFeatures")
+	FRiemannClassifierSettings classifierSettings;
+	/** Relaxation classifier fed with multi-channel EEG, its posterior replaces the Blueprint registered meditation value when enabled */
+	FRiemannClassifier m_classifier;
+
+	/** Bounds within which the classifier quality is lowered to keep the frame rate */
+	UPROPERTY(EditAnywhere, DisplayName="Quality Governor", meta = (AllowPrivateAccess = "true"), Category="MainFeatures")
+	FEEGQualitySettings governorSettings;
+	FEEGQualityGovernor m_governor;
+	/** Classification running on a worker, when the governor moved it off the game thread */
+	UE::Tasks::TTask<float> m_classifyTask;
+	bool m_bClassifyPending = false;
+	/** Covariances and scratch space of the worker classification */
+	FEEGMatrix m_workerCovariances[FRiemannClassifier::NumBands];
+	FEEGMatrix m_workerScratch[3];
+	/** Every classifier stage on the task graph, when classifierSettings.bPipelined */
+	TUniquePtr<class FEEGStagePipeline> m_pipeline;
+
+	UPROPERTY(EditAnywhere, meta = (AllowPrivateAccess = "true"), Category="MainFeatures")
+	EEEGSourceType eegSource = EEEGSourceType::Blueprint;
+	/** Hub channels to subscribe to, bit i for device channel i. Their count must match the classifier channel count */
+	UPROPERTY(EditAnywhere, meta = (AllowPrivateAccess = "true", EditCondition = "eegSource == EEEGSourceType::Hub"), Category="MainFeatures")
+	int32 hubChannelMask = (1 << 14) - 1;
+	/** The hub averages and keeps one frame out of hubDecimation, so that the classifier sample rate can be lower than the device's */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1", AllowPrivateAccess = "true", EditCondition = "eegSource == EEEGSourceType::Hub"), Category="MainFeatures")
+	int32 hubDecimation = 1;
+	/** Type of the LSL stream to resolve */
+	UPROPERTY(EditAnywhere, meta = (AllowPrivateAccess = "true", EditCondition = "eegSource == EEEGSourceType::Lsl"), Category="MainFeatures")
+	FString lslStreamType = TEXT("EEG");
+	TUniquePtr<IEEGSampleSource> m_eegSource;
+	/** Resolving an LSL stream blocks, it runs on a worker */
+	UE::Tasks::TTask<class FLslInlet*> m_lslConnectTask;
+	/** Time left before trying to connect the EEG source again */
+	float m_eegSourceRetryTime = 0.f;
+	/** Blocks the EEG source is pulled into, set up when it connects */
+	FEEGBlockPool m_eegPool;
+
+	/** How meditation values pushed with PushMeditationSample or produced by the classifier are registered */
+	UPROPERTY(EditAnywhere, DisplayName="Ingest", meta = (AllowPrivateAccess = "true"), Category="MainFeatures")
+	FMeditationIngestSettings ingestSettings;
+	/** Pending meditation values, drained once per tick */
+	FMeditationIngestQueue m_ingest;
+
+	/**
+	 * Replicated meditation state. The locally controlled pawn owns it: it is set directly on a listen server, and sent with ServerUpdateNetState by a client.
+	 * Test with local processes: UnrealEditor VR_Test.uproject <map>?listen -game, then UnrealEditor VR_Test.uproject 127.0.0.1 -game
+	 */
+	UPROPERTY(ReplicatedUsing=OnRep_NetState)
+	FMeditationNetState m_netState;
+	/** Origin of the replicated location offset, only replicated again when the pawn gets far from it */
+	UPROPERTY(Replicated)
+	FVector_NetQuantize m_netAnchor = FVector::ZeroVector;
+	/** Rate at which the meditation state is sent, state flips are sent immediately */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1", AllowPrivateAccess = "true"), Category="Network")
+	float netSendRate = 10.f;
+	/** Speed at which remote pawns correct the extrapolation error */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="0", AllowPrivateAccess = "true"), Category="Network")
+	float netCorrectionSpeed = 4.f;
+	float m_netSendTime = 0.f;
+	/** bRelaxed at the end of the previous frame, to detect flips */
+	bool m_bWasRelaxed = false;
+	/** Replicated location of a remote pawn, moved forward by its velocities between updates */
+	FVector m_netExtrapolatedLocation = FVector::ZeroVector;
+	/** Synchrony with the other meditators, measured on the server (see UMeditationSynchronySubsystem) */
+	UPROPERTY(EditAnywhere, DisplayName="Synchrony", meta = (AllowPrivateAccess = "true"), Category="Network")
+	FMeditationSynchronySettings synchronySettings;
+	/** Mean synchrony of every pair of meditators, and of the pairs of this one, replicated from the server */
+	UPROPERTY(Replicated)
+	float m_groupSynchrony = 0.f;
+	UPROPERTY(Replicated)
+	float m_synchrony = 0.f;
+	/** riseVelocity before the synchrony boost */
+	float m_baseRiseVelocity = 0.f;
+	/** Set by the Bind functions, nothing moves the pawn before the first one */
+	EMeditationPhase m_phase = EMeditationPhase::Intro;
+	bool m_bPhaseBound = false;
+	/** Ticks since the last phase change or EEG source connection, the allocation guard (-AllocGuard) is armed past a warmup */
+	uint32 m_steadyTicks = 0;
+
+	/** Export the meditation pipeline state to a telemetry viewer (see UMeditationTelemetryCommandlet). Also enabled by -Telemetry on the command line */
+	UPROPERTY(EditAnywhere, meta = (AllowPrivateAccess = "true"), Category="Telemetry")
+	bool bTelemetry = false;
+	UPROPERTY(EditAnywhere, meta = (AllowPrivateAccess = "true", EditCondition = "bTelemetry"), Category="Telemetry")
+	FString telemetryHost = TEXT("127.0.0.1");
+	UPROPERTY(EditAnywhere, meta = (AllowPrivateAccess = "true", EditCondition = "bTelemetry"), Category="Telemetry")
+	int32 telemetryPort = 5680;
+	/** Export one frame out of telemetryDecimation */
+	UPROPERTY(EditAnywhere, meta = (ClampMin="1", AllowPrivateAccess = "true", EditCondition = "bTelemetry"), Category="Telemetry")
+	int32 telemetryDecimation = 1;
+	TUniquePtr<class FMeditationTelemetry> m_telemetry;
+	/** Publish the game events (phases, state flips, landings) as an LSL marker stream, so that LabRecorder can align them with the EEG */
+	UPROPERTY(EditAnywhere, meta = (AllowPrivateAccess = "true"), Category="Telemetry")
+	bool bLslMarkers = false;
+	TUniquePtr<class FLslMarkerOutlet> m_markers;
+	uint32 m_telemetryFrame = 0;
+	double m_telemetryStartTime = 0.0;
+	/** Cost of the previous telemetry record, sent with the next sample */
+	uint32 m_telemetryRecordCycles = 0;
 
-	TickEvent tickEvent;
+	/**
+	 * Samples the meditation state into m_history at a fixed rate.
+	 * @param DeltaTime	DeltaTime
+	 */
+	void RecordHistory(float DeltaTime);
+	/** Creates the session store of a locally controlled pawn, once */
+	void OpenSessionStore();
+	/** Creates the parameter service of a locally controlled pawn, from the current parameters */
+	void OpenParamService();
+	/** Applies the latest parameter snapshot if it changed since the last frame */
+	void ApplyParams();
+	/**
+	 * Connects the EEG source if needed, and registers the frames it received since the last frame.
+	 * @param DeltaTime	DeltaTime
+	 */
+	void PullEEGSamples(float DeltaTime);
+	/** Queues the result of the worker classification once done */
+	void CollectClassification();
+	/** Applies the classifier parameters of the current governor level */
+	void ApplyQualityLevel();
+	/**
+	 * Sends the meditation state at netSendRate, and state flips right away.
+	 * @param DeltaTime		DeltaTime
+	 * @param bStateFlipped	True if bRelaxed changed this frame
+	 */
+	void SendNetState(float DeltaTime, bool bStateFlipped);
+	/**
+	 * Publishes a game event on the LSL marker stream, if enabled.
+	 * @param Marker	Event name
+	 */
+	void PushMarker(const TCHAR* Marker) const;
+	/**
+	 * Copies this frame's meditation state to the telemetry ring.
+	 * @param DeltaTime	DeltaTime
+	 */
+	void RecordTelemetry(float DeltaTime);
+	/**
+	 * Moves a remote pawn with its last replicated velocities, and blends the error towards the replicated state.
+	 * @param DeltaTime	DeltaTime
+	 */
+	void ExtrapolateNetState(float DeltaTime);
+	UFUNCTION()
+	void OnRep_NetState();
+	UFUNCTION(Server, Unreliable)
+	void ServerUpdateNetState(const FMeditationNetState& State, FVector_NetQuantize Anchor);
+	UFUNCTION(Server, Reliable)
+	void ServerChangeState(bool bNewRelaxed);
+	UFUNCTION(NetMulticast, Reliable)
+	void MulticastChangeState(bool bNewRelaxed);
 public:
 	// Sets default values for this pawn's properties
 	AVRPawn();
+	virtual ~AVRPawn() override;
 
 	UPROPERTY(BlueprintReadOnly)
 	FVector velocity;
@@ -149,6 +406,10 @@ public:
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+	/** @return True for the meditator of this machine, false for the replicas of remote meditators */
+	bool IsLocalMeditator() const;
 	
 	/**
 	 * Calculates the new relaxation value and evaluates whether the relaxed state should change.
@@ -219,6 +480,50 @@ public:
 	 */
 	UFUNCTION(BlueprintCallable)
 	void RegisterValue(float Value);
+	/**
+	 * Queues a new meditation value, registered on the next tick according to the ingest policy.
+	 * Unlike RegisterValue, a burst of values after a hitch does not make the relaxation value jump, and ComputeAvg must not be called.
+	 * @param Value			New value to be registered
+	 */
+	UFUNCTION(BlueprintCallable)
+	void PushMeditationSample(float Value);
+	UFUNCTION(BlueprintCallable)
+	FMeditationIngestStats GetIngestStats() const;
+	float GetRelaxationValue() const { return md.relaxationValue; }
+	/**
+	 * Called by the server with the latest synchrony.
+	 * @param Group			Mean synchrony of every pair of meditators, in [0, 1]
+	 * @param Individual	Mean synchrony of the pairs of this meditator, in [0, 1]
+	 */
+	void SetSynchrony(float Group, float Individual);
+	UFUNCTION(BlueprintCallable)
+	float GetGroupSynchrony() const { return m_groupSynchrony; }
+	UFUNCTION(BlueprintCallable)
+	float GetSynchrony() const { return m_synchrony; }
+	/**
+	 * Feeds multi-channel EEG samples to the relaxation classifier. Every classified hop queues the relaxed posterior (x100) as a new value.
+	 * @param Interleaved	NumFrames * classifier channel count samples, channel after channel for each frame
+	 * @param NumFrames		Number of frames
+	 */
+	void RegisterEEGSamples(const float* Interleaved, int32 NumFrames);
+	/**
+	 * Blueprint version of RegisterEEGSamples, for a single frame.
+	 * @param Channels		One value per channel
+	 */
+	UFUNCTION(BlueprintCallable)
+	void RegisterEEGFrame(const TArray<float>& Channels);
+	/**
+	 * Starts recording the EEG as examples of the relaxed or unrelaxed state, to calibrate the classifier.
+	 * @param bRelaxed		True if the participant is being relaxed
+	 */
+	UFUNCTION(BlueprintCallable)
+	void BeginClassifierCalibration(bool bRelaxed);
+	/**
+	 * Stops recording calibration examples.
+	 * @return True once the classifier has examples of both states and is calibrated
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool EndClassifierCalibration();
 	/**
 	 * To use if the m_meditationValues array has only 1 or 2 values.
 	 * Assigns the one or two only values present in m_meditationValues to m_prevAvg and m_currAvg.
@@ -232,17 +537,17 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void ComputeAvg();
 	/**
-	* Bind intro tick implementation to tick function (slow rise at start and rise speed increasing).
+	* Switch the tick to the intro implementation (slow rise at start and rise speed increasing).
 	*/
 	UFUNCTION(BlueprintCallable)
 	void BindIntroTick();
 	/**
-	* Bind default rise tick implementation to tick function (default rise speed).
+	* Switch the tick to the default rise implementation (default rise speed).
 	*/
 	UFUNCTION(BlueprintCallable)
 	void BindDefaultRiseTick();
 	/**
-	* Bind flying in air tick implementation to tick function.
+	* Switch the tick to the flying in air implementation.
 	*/
 	UFUNCTION(BlueprintCallable)
 	void BindFlyingTick();
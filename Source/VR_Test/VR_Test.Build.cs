@@ -1,5 +1,6 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
+using System.IO;
 using UnrealBuildTool;
 
 public class VR_Test : ModuleRules
@@ -8,10 +9,31 @@ public class VR_Test : ModuleRules
 	{
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 	
-		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "Slate", "SlateCore", "UMG",  "InputCore", "HeadMountedDisplay" });
+		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "Slate", "SlateCore", "UMG",  "InputCore", "HeadMountedDisplay", "AudioMixer", "Sockets", "Networking", "RenderCore", "RHI" });
 
 		PrivateDependencyModuleNames.AddRange(new string[] {  });
 
+		// Lab Streaming Layer is optional: drop a liblsl release (include/, lib/ and bin/) in ThirdParty/liblsl to enable the LSL EEG source and markers
+		string lslPath = Path.Combine(ModuleDirectory, "..", "..", "ThirdParty", "liblsl");
+		bool bWithLsl = File.Exists(Path.Combine(lslPath, "include", "lsl_c.h"));
+		if (bWithLsl && Target.Platform == UnrealTargetPlatform.Win64)
+		{
+			PublicAdditionalLibraries.Add(Path.Combine(lslPath, "lib", "lsl.lib"));
+			PublicDelayLoadDLLs.Add("lsl.dll");
+			RuntimeDependencies.Add("$(BinaryOutputDir)/lsl.dll", Path.Combine(lslPath, "bin", "lsl.dll"));
+		}
+		else if (bWithLsl && Target.Platform == UnrealTargetPlatform.Linux)
+		{
+			PublicAdditionalLibraries.Add(Path.Combine(lslPath, "lib", "liblsl.so"));
+			RuntimeDependencies.Add("$(BinaryOutputDir)/liblsl.so", Path.Combine(lslPath, "lib", "liblsl.so"));
+		}
+		else
+			bWithLsl = false;
+
+		if (bWithLsl)
+			PublicIncludePaths.Add(Path.Combine(lslPath, "include"));
+		PublicDefinitions.Add("WITH_LSL=" + (bWithLsl ? "1" : "0"));
+
 		// Uncomment if you are using Slate UI
 		// PrivateDependencyModuleNames.AddRange(new string[] { "Slate", "SlateCore" });
 		
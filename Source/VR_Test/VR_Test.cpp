@@ -3,4 +3,6 @@
 #include "VR_Test.h"
 #include "Modules/ModuleManager.h"
 
+DEFINE_LOG_CATEGORY(LogMeditation);
+
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, VR_Test, "VR_Test" );